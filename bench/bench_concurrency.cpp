@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// records each writer adds, one load + addEntry + save per record (the same
+// sequence as a `pm add` process)
+static const int kWritesPerWriter = 25;
+static const size_t kBaseEntries = 1000;
+
+// "<prefix><writer>-<record>", appended piecewise: GCC 12 flags a bogus
+// -Wrestrict on a literal + std::string chain
+static std::string siteName(const char* prefix, int writer, int record) {
+	std::string site(prefix);
+	site.append(std::to_string(writer)).append(1, '-').append(std::to_string(record));
+	return site;
+}
+
+// Stress test: N writer threads and M reader threads on one vault, each with
+// its own Vault object (separate lock file descriptors, so they contend as
+// separate processes would). Fails if a write is lost or any read errors.
+static void BM_ConcurrentWriters(benchmark::State& state) {
+	const int writers = static_cast<int>(state.range(0));
+	const int readers = static_cast<int>(state.range(1));
+	const KeyProvider key = bench::cachedKey();
+
+	int64_t writes = 0;
+	int64_t reads = 0;
+	for (auto _ : state) {
+		state.PauseTiming();
+		const std::string path = bench::workingCopy(bench::vaultWith(kBaseEntries), "concurrent.vault");
+		std::atomic<int> writing{ writers };
+		std::atomic<int64_t> readCount{ 0 };
+		std::atomic<int> failures{ 0 };
+		state.ResumeTiming();
+
+		std::vector<std::thread> threads;
+		for (int w = 0; w < writers; ++w) {
+			threads.emplace_back([&, w]() {
+				for (int i = 0; i < kWritesPerWriter; ++i) {
+					Vault v(path);
+					const std::string site = siteName("w", w, i);
+					if (v.load(key) != VaultStatus::Ok) { ++failures; continue; }
+					v.addEntry(Entry{ site, "user", "password" });
+					if (v.save() != VaultStatus::Ok) ++failures;
+				}
+				--writing;
+			});
+		}
+		for (int r = 0; r < readers; ++r) {
+			threads.emplace_back([&]() {
+				// readers never take the lock and must always see a whole vault
+				do {
+					Vault v(path);
+					if (v.load(key) != VaultStatus::Ok) ++failures;
+					++readCount;
+				} while (writing.load() > 0);
+			});
+		}
+		for (auto& t : threads) t.join();
+
+		state.PauseTiming();
+		Vault check(path);
+		size_t missing = 0;
+		if (check.load(key) != VaultStatus::Ok) ++failures;
+		for (int w = 0; w < writers; ++w) {
+			for (int i = 0; i < kWritesPerWriter; ++i) {
+				if (check.findSite(siteName("w", w, i)).empty()) ++missing;
+			}
+		}
+		state.ResumeTiming();
+
+		if (failures > 0 || missing > 0 || check.list().size() != kBaseEntries + static_cast<size_t>(writers * kWritesPerWriter)) {
+			state.SkipWithError("concurrent access lost writes or failed a load");
+			break;
+		}
+		writes += writers * kWritesPerWriter;
+		reads += readCount;
+	}
+
+	state.counters["writes_per_sec"] = benchmark::Counter(static_cast<double>(writes), benchmark::Counter::kIsRate);
+	state.counters["reads_per_sec"] = benchmark::Counter(static_cast<double>(reads), benchmark::Counter::kIsRate);
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK(BM_ConcurrentWriters)
+	->ArgNames({ "writers", "readers" })
+	->Args({ 1, 0 })
+	->Args({ 4, 0 })
+	->Args({ 4, 4 })
+	->Args({ 8, 8 })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+// Long-lived writers (as in a server): each thread keeps one loaded Vault
+// and saves after every addEntry. Concurrent saves are group committed
+// (one append + fsync for everything queued) and catch up on each other's
+// records in memory; every writer must end up seeing all the entries.
+static void BM_GroupCommit(benchmark::State& state) {
+	const int writers = static_cast<int>(state.range(0));
+	const KeyProvider key = bench::cachedKey();
+
+	int64_t writes = 0;
+	for (auto _ : state) {
+		state.PauseTiming();
+		const std::string path = bench::workingCopy(bench::vaultWith(kBaseEntries), "group.vault");
+		std::vector<std::unique_ptr<Vault>> vaults;
+		for (int w = 0; w < writers; ++w) {
+			vaults.push_back(std::make_unique<Vault>(path));
+			if (vaults.back()->load(key) != VaultStatus::Ok) { state.SkipWithError("load failed"); return; }
+		}
+		std::atomic<int> failures{ 0 };
+		state.ResumeTiming();
+
+		std::vector<std::thread> threads;
+		for (int w = 0; w < writers; ++w) {
+			threads.emplace_back([&, w]() {
+				Vault& v = *vaults[w];
+				for (int i = 0; i < kWritesPerWriter; ++i) {
+					v.addEntry(Entry{ siteName("g", w, i), "user", "password" });
+					if (v.save() != VaultStatus::Ok) ++failures;
+				}
+			});
+		}
+		for (auto& t : threads) t.join();
+
+		state.PauseTiming();
+		// one more (empty) save brings each vault up to date with the file
+		const size_t expect = kBaseEntries + static_cast<size_t>(writers * kWritesPerWriter);
+		for (auto& v : vaults) {
+			if (v->save() != VaultStatus::Ok || v->list().size() != expect) ++failures;
+		}
+		state.ResumeTiming();
+
+		if (failures > 0) { state.SkipWithError("group commit lost writes"); break; }
+		writes += writers * kWritesPerWriter;
+	}
+
+	state.counters["writes_per_sec"] = benchmark::Counter(static_cast<double>(writes), benchmark::Counter::kIsRate);
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK(BM_GroupCommit)
+	->ArgNames({ "writers" })
+	->Arg(1)
+	->Arg(4)
+	->Arg(16)
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
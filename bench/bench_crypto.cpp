@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+#include <sodium.h>
+
+// Argon2id at different cost settings: args are opslimit, memlimit in MB
+static void BM_DeriveKey(benchmark::State& state) {
+	Crypto::KdfParams kdf;
+	kdf.opslimit = static_cast<unsigned long long>(state.range(0));
+	kdf.memlimit = static_cast<size_t>(state.range(1)) * 1024 * 1024;
+	kdf.salt = Crypto::randomBytes(crypto_pwhash_SALTBYTES);
+
+	std::vector<unsigned char> key;
+	for (auto _ : state) {
+		if (!Crypto::deriveKey("bench-master", kdf, key)) { state.SkipWithError("deriveKey failed"); break; }
+		benchmark::DoNotOptimize(key.data());
+	}
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK(BM_DeriveKey)
+	->Args({ 1, 8 })->Args({ 2, 64 })->Args({ 3, 64 })->Args({ 3, 256 })
+	->Unit(benchmark::kMillisecond);
+
+static std::vector<unsigned char> benchKey() {
+	return Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_KEYBYTES);
+}
+
+static void BM_Encrypt(benchmark::State& state) {
+	const auto key = benchKey();
+	const auto nonce = Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+	const std::string pt(static_cast<size_t>(state.range(0)), 'x');
+
+	std::vector<unsigned char> ct;
+	for (auto _ : state) {
+		Crypto::encrypt(key, nonce, pt, ct);
+		benchmark::DoNotOptimize(ct.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Encrypt)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+static void BM_Decrypt(benchmark::State& state) {
+	const auto key = benchKey();
+	const auto nonce = Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+	const std::string pt(static_cast<size_t>(state.range(0)), 'x');
+	std::vector<unsigned char> ct;
+	Crypto::encrypt(key, nonce, pt, ct);
+
+	std::string out;
+	for (auto _ : state) {
+		if (!Crypto::decrypt(key, nonce, ct.data(), ct.size(), out)) { state.SkipWithError("decrypt failed"); break; }
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Decrypt)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+// per-record sealing used by the v2 record log
+static void BM_SealOpenRecord(benchmark::State& state) {
+	const auto key = benchKey();
+	const std::string pt(static_cast<size_t>(state.range(0)), 'x');
+	std::vector<unsigned char> sealed;
+	std::string out;
+	for (auto _ : state) {
+		Crypto::seal(key, pt, "ad", sealed);
+		Crypto::open(key, sealed.data(), sealed.size(), "ad", out);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SealOpenRecord)->Arg(64)->Arg(256)->Arg(4096);
+
+static void BM_B64Encode(benchmark::State& state) {
+	const auto data = Crypto::randomBytes(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		auto s = Crypto::b64encode(data);
+		benchmark::DoNotOptimize(s.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_B64Encode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+static void BM_B64Decode(benchmark::State& state) {
+	const std::string s = Crypto::b64encode(Crypto::randomBytes(static_cast<size_t>(state.range(0))));
+	for (auto _ : state) {
+		auto v = Crypto::b64decode(s);
+		benchmark::DoNotOptimize(v.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_B64Decode)->RangeMultiplier(16)->Range(64, 16 << 20);
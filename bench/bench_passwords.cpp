@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+#include "../src/Audit.h"
+#include "../src/Breach.h"
+#include <map>
+#include <sodium.h>
+#include <sstream>
+#include "../src/Generator.h"
+
+// a batch of default-policy passwords (20 characters, every class)
+static void BM_Generate(benchmark::State& state) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	Generator::Policy policy;
+	for (auto _ : state) {
+		SecureArena arena;
+		std::vector<std::string_view> out;
+		out.reserve(n);
+		if (!Generator::generate(policy, n, arena, out)) { state.SkipWithError("generate failed"); break; }
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Generate)->Arg(1)->Arg(1000)->Arg(1000000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// full audit of a loaded vault: reveal, keyed hash, entropy, reuse grouping
+static void BM_Audit(benchmark::State& state) {
+	Vault v(bench::vaultWith(static_cast<size_t>(state.range(0))));
+	if (const VaultStatus st = v.load(bench::cachedKey()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); return; }
+
+	Audit::Report report;
+	for (auto _ : state) {
+		if (const VaultStatus st = Audit::run(v, Audit::Policy{}, report); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		benchmark::DoNotOptimize(report.findings.data());
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	state.counters["findings"] = static_cast<double>(report.findings.size());
+}
+BENCHMARK(BM_Audit)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// corpus of n random SHA-1 hashes (8 byte prefixes), built once per size
+static const std::string& corpusWith(size_t n) {
+	static std::map<size_t, std::string> built;
+	auto it = built.find(n);
+	if (it != built.end()) return it->second;
+
+	std::ostringstream dump;
+	unsigned char h[20];
+	char hex[41];
+	for (size_t i = 0; i < n; ++i) {
+		randombytes_buf(h, sizeof(h));
+		sodium_bin2hex(hex, sizeof(hex), h, sizeof(h));
+		dump << hex << ":1\n";
+	}
+	std::istringstream in(dump.str());
+	const std::string path = bench::tempPath("breach_" + std::to_string(n) + ".bin");
+	Breach::BuildStats stats;
+	std::string err;
+	if (!Breach::build(in, path, Breach::BuildOptions{}, stats, err)) throw std::runtime_error(err);
+	return built.emplace(n, path).first->second;
+}
+
+// one corpus probe (interpolation search in the mapping) per random hash,
+// almost all misses like real vault passwords
+static void BM_BreachLookup(benchmark::State& state) {
+	Breach::Corpus corpus;
+	std::string err;
+	if (!corpus.open(corpusWith(static_cast<size_t>(state.range(0))), err)) { state.SkipWithError(err.c_str()); return; }
+
+	std::vector<unsigned char> hashes(20 * 4096);
+	randombytes_buf(hashes.data(), hashes.size());
+	size_t i = 0;
+	size_t hits = 0;
+	for (auto _ : state) {
+		hits += corpus.containsHash(hashes.data() + 20 * (i++ % 4096));
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["hits"] = static_cast<double>(hits);
+}
+BENCHMARK(BM_BreachLookup)->Arg(100000)->Arg(10000000);
@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+#include "../src/VaultFile.h"
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+// Read path only (no crypto): the original readAllText (ifstream +
+// istreambuf_iterator into a string) against the memory-mapped FrameReader,
+// both walking every frame of a v2-shaped file.
+
+using namespace VaultFile;
+
+namespace {
+
+	const size_t kRecordBytes = 120; // typical sealed entry
+
+	// v2-shaped file: magic, small header, then filler records up to size
+	const std::string& sampleFile(size_t size) {
+		static std::map<size_t, std::string> files;
+		auto it = files.find(size);
+		if (it != files.end()) return it->second;
+
+		std::string out(kMagic, sizeof(kMagic));
+		const std::string header = R"({"version":2})";
+		putU32(out, static_cast<std::uint32_t>(header.size()));
+		out += header;
+
+		std::vector<unsigned char> rec(kRecordBytes, 0xA5);
+		while (out.size() + 5 + rec.size() <= size) putFrame(out, FramePut, rec.data(), rec.size());
+
+		const std::string path = bench::tempPath("read_" + std::to_string(size) + ".bin");
+		std::ofstream(path, std::ios::binary | std::ios::trunc).write(out.data(), static_cast<std::streamsize>(out.size()));
+		return files.emplace(size, path).first->second;
+	}
+
+}
+
+static void BM_ReadAllText(benchmark::State& state) {
+	const std::string& path = sampleFile(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		std::ifstream ifs(path, std::ios::binary);
+		std::string data;
+		data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+		size_t off = sizeof(kMagic);
+		off += 4 + getU32(p + off);
+
+		size_t frames = 0;
+		while (off + 5 <= data.size()) {
+			off += 5 + getU32(p + off + 1);
+			++frames;
+		}
+		benchmark::DoNotOptimize(frames);
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ReadAllText)->Arg(1 << 10)->Arg(1 << 20)->Arg(100 << 20)->Unit(benchmark::kMicrosecond);
+
+static void BM_ReadMapped(benchmark::State& state) {
+	const std::string& path = sampleFile(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		FrameReader reader;
+		reader.open(path);
+
+		const unsigned char* data = nullptr;
+		size_t len = 0;
+		reader.readHeader(data, len);
+
+		size_t frames = 0;
+		std::uint8_t kind = 0;
+		while (reader.next(kind, data, len) == FrameReader::Status::Ok) ++frames;
+		benchmark::DoNotOptimize(frames);
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ReadMapped)->Arg(1 << 10)->Arg(1 << 20)->Arg(100 << 20)->Unit(benchmark::kMicrosecond);
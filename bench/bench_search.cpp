@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+#include "../src/SearchIndex.h"
+#include "../src/SecureArena.h"
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+// SearchIndex over a vault-like corpus. The numbered sites of the vault
+// fixtures ("site00004242.example.com") share most of their trigrams, which
+// no n-gram filter can narrow, so these use names shaped like real ones:
+// words, subdomains and TLDs, people's names at mail providers.
+
+namespace {
+
+	const char* const kWords[] = {
+		"mail", "bank", "shop", "cloud", "news", "games", "photo", "music", "video", "travel",
+		"health", "school", "forum", "wiki", "code", "dev", "book", "store", "pay", "social",
+		"chat", "maps", "drive", "docs", "home", "sport", "food", "auto", "energy", "insure",
+		"stream", "market", "crypto", "learn", "job", "rent", "ticket", "fit", "craft", "garden",
+		"pixel", "nova", "blue", "green", "red", "north", "star", "river", "stone", "bright",
+	};
+	const char* const kPrefixes[] = { "", "", "", "www.", "login.", "my.", "account.", "app." };
+	const char* const kTlds[] = { ".com", ".com", ".com", ".org", ".net", ".io", ".de", ".co.uk", ".fr", ".app" };
+	const char* const kFirst[] = {
+		"alex", "sam", "maria", "chen", "priya", "lukas", "emma", "omar", "yuki", "nina",
+		"david", "sofia", "ivan", "lea", "noah", "ana", "kofi", "mei", "jonas", "zara",
+	};
+	const char* const kLast[] = { "smith", "garcia", "muller", "wang", "kumar", "rossi", "novak", "kim", "silva", "brown" };
+	const char* const kMail[] = { "gmail.com", "outlook.com", "proton.me", "yahoo.com", "example.org" };
+
+	template <size_t N>
+	const char* pick(const char* const (&words)[N], std::uint64_t& seed) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		return words[(seed >> 33) % N];
+	}
+
+	// deterministic corpus of n entries, built once per size
+	const std::vector<Entry>& corpus(size_t n) {
+		static SecureArena arena;
+		static std::map<size_t, std::vector<Entry>> built;
+		auto it = built.find(n);
+		if (it != built.end()) return it->second;
+
+		std::vector<Entry> out;
+		out.reserve(n);
+		std::uint64_t seed = 42;
+		char buf[128];
+		for (size_t i = 0; i < n; ++i) {
+			std::snprintf(buf, sizeof(buf), "%s%s%s%s", pick(kPrefixes, seed), pick(kWords, seed), pick(kWords, seed), pick(kTlds, seed));
+			std::string_view site = arena.store(buf);
+			std::snprintf(buf, sizeof(buf), "%s.%s%zu@%s", pick(kFirst, seed), pick(kLast, seed), i % 100, pick(kMail, seed));
+			out.push_back(Entry{ site, arena.store(buf), site });
+		}
+		return built.emplace(n, std::move(out)).first->second;
+	}
+
+}
+
+// corpus sizes from 100 to 1M entries
+#define SEARCH_SIZES RangeMultiplier(10)->Range(100, 1000000)
+
+// top 10 for one query over an index built beforehand (as Vault::search
+// does once per change)
+static void BM_Search(benchmark::State& state, const char* query) {
+	SearchIndex index;
+	index.build(corpus(static_cast<size_t>(state.range(0))));
+
+	size_t hits = 0;
+	for (auto _ : state) {
+		const auto found = index.search(query, 10);
+		hits = found.size();
+		benchmark::DoNotOptimize(found.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["hits"] = static_cast<double>(hits);
+}
+BENCHMARK_CAPTURE(BM_Search, substring, "cloudpix")->SEARCH_SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Search, username, "priya.kumar7")->SEARCH_SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Search, typo, "streammarkt")->SEARCH_SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Search, nomatch, "qwertyuiop")->SEARCH_SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Search, short, "io")->SEARCH_SIZES->Unit(benchmark::kMicrosecond);
+
+// building the folded text and trigram index
+static void BM_SearchIndexBuild(benchmark::State& state) {
+	const auto& entries = corpus(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		SearchIndex index;
+		index.build(entries);
+		benchmark::DoNotOptimize(index.empty());
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SearchIndexBuild)->SEARCH_SIZES->Unit(benchmark::kMillisecond);
@@ -0,0 +1,160 @@
+#include "bench_util.h"
+#include "../src/VaultCollection.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+	const char* kMaster = "bench-master";
+
+	// temp files created by the suite, cleaned up at exit
+	struct TempFiles {
+		std::vector<std::string> paths;
+		~TempFiles() {
+			std::error_code ec;
+			for (const auto& p : paths) {
+				// the vault's write lock / rewrite temp live next to it
+				std::filesystem::remove(p, ec);
+				std::filesystem::remove(p + ".lock", ec);
+				std::filesystem::remove(p + ".tmp", ec);
+			}
+		}
+	};
+
+	TempFiles& temps() {
+		static TempFiles t;
+		return t;
+	}
+
+}
+
+namespace bench {
+
+	double peakRssMb() {
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc{};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+		return static_cast<double>(pmc.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+		rusage ru{};
+		getrusage(RUSAGE_SELF, &ru);
+#if defined(__APPLE__)
+		return static_cast<double>(ru.ru_maxrss) / (1024.0 * 1024.0); // bytes
+#else
+		return static_cast<double>(ru.ru_maxrss) / 1024.0; // kilobytes
+#endif
+#endif
+	}
+
+	std::string tempPath(const std::string& name) {
+		std::string p = (std::filesystem::temp_directory_path() / ("pm_bench_" + name)).string();
+		temps().paths.push_back(p);
+		return p;
+	}
+
+	void makeEntries(size_t n, SecureArena& arena, std::vector<Entry>& out) {
+		out.clear();
+		out.reserve(n);
+		char buf[64];
+		for (size_t i = 0; i < n; ++i) {
+			std::snprintf(buf, sizeof(buf), "site%08zu.example.com", i);
+			std::string_view site = arena.store(buf);
+			std::snprintf(buf, sizeof(buf), "user%zu@example.com", i % 1000);
+			std::string_view user = arena.store(buf);
+			std::snprintf(buf, sizeof(buf), "Pw-%016zx!", i * 2654435761u);
+			out.push_back(Entry{ site, user, arena.store(buf) });
+		}
+	}
+
+	KeyProvider cachedKey() {
+		return [](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+			static std::mutex mutex; // shared by concurrent-access benchmarks
+			static std::map<std::string, std::vector<unsigned char>> cache;
+			const std::string id = Crypto::b64encode(kdf.salt);
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = cache.find(id);
+			if (it == cache.end()) {
+				std::vector<unsigned char> key;
+				if (!Crypto::deriveKey(kMaster, kdf, key)) return false;
+				it = cache.emplace(id, std::move(key)).first;
+			}
+			outKey = it->second;
+			return true;
+		};
+	}
+
+	KeyProvider derivedKey() {
+		return [](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+			return Crypto::deriveKey(kMaster, kdf, outKey);
+		};
+	}
+
+	const std::string& vaultWith(size_t n, bool compressed) {
+		static std::map<std::pair<size_t, bool>, std::string> built;
+		auto it = built.find({ n, compressed });
+		if (it != built.end()) return it->second;
+
+		const std::string path = tempPath(std::string(compressed ? "fixture_z" : "fixture_") + std::to_string(n) + ".vault");
+		{
+			Vault v(path);
+			if (const VaultStatus st = v.initNew(kMaster); st != VaultStatus::Ok) throw std::runtime_error(describe(st));
+		}
+
+		// reopen through the cached provider so the key is derived once here
+		Vault v(path);
+		if (const VaultStatus st = v.load(cachedKey()); st != VaultStatus::Ok) throw std::runtime_error(describe(st));
+		v.setCompression(compressed);
+
+		SecureArena arena;
+		std::vector<Entry> entries;
+		makeEntries(n, arena, entries);
+		// one record first, so the bulk save lands on a file with a tail and
+		// rewrites it into the paged layout of a vault that grew over time
+		const std::span<const Entry> all(entries);
+		const size_t head = std::min<size_t>(n, 1);
+		for (auto part : { all.first(head), all.subspan(head) }) {
+			v.addEntries(part);
+			if (const VaultStatus st = v.save(); st != VaultStatus::Ok) throw std::runtime_error(describe(st));
+		}
+
+		return built.emplace(std::make_pair(n, compressed), path).first->second;
+	}
+
+	const std::string& collectionWith(size_t n, size_t shards) {
+		static std::map<std::pair<size_t, size_t>, std::string> built;
+		auto it = built.find({ n, shards });
+		if (it != built.end()) return it->second;
+
+		// the shards land next to the manifest as <source stem>.<i>.vault
+		const std::string name = "split" + std::to_string(shards) + "_" + std::to_string(n);
+		const std::string source = workingCopy(vaultWith(n), name + ".vault");
+		const std::string manifest = tempPath(name + ".json");
+		for (size_t i = 0; i < shards; ++i) tempPath(name + "." + std::to_string(i) + ".vault");
+
+		Vault v(source);
+		if (const VaultStatus st = v.load(cachedKey()); st != VaultStatus::Ok) throw std::runtime_error(describe(st));
+		if (const VaultStatus st = VaultCollection::shard(v, source, kMaster, manifest, shards, VaultCollection::defaultMemBudget()); st != VaultStatus::Ok) {
+			throw std::runtime_error(describe(st));
+		}
+		return built.emplace(std::make_pair(n, shards), manifest).first->second;
+	}
+
+	std::string workingCopy(const std::string& fixture, const std::string& name) {
+		const std::string path = tempPath(name);
+		std::filesystem::copy_file(fixture, path, std::filesystem::copy_options::overwrite_existing);
+		return path;
+	}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "../src/Vault.h"
+
+// Shared fixtures for pm_bench. Vaults are created once per size and reused;
+// keys are derived once per vault so load/save numbers exclude Argon2id
+// (measured separately in BM_DeriveKey).
+namespace bench {
+
+	// peak resident set size of the process so far, in MB (process-wide, so
+	// only meaningful relative to the benchmarks that ran before)
+	double peakRssMb();
+
+	// file in the system temp directory, removed when the process exits
+	std::string tempPath(const std::string& name);
+
+	// n synthetic entries with fields stored in arena
+	void makeEntries(size_t n, SecureArena& arena, std::vector<Entry>& out);
+
+	// path of a vault holding n entries (built on first use), optionally with
+	// record compression on
+	const std::string& vaultWith(size_t n, bool compressed = false);
+
+	// key provider that runs Argon2id once per salt and caches the result
+	KeyProvider cachedKey();
+
+	// key provider that runs Argon2id on every call
+	KeyProvider derivedKey();
+
+	// manifest of vaultWith(n) split into that many site-hash shards (built
+	// on first use)
+	const std::string& collectionWith(size_t n, size_t shards);
+
+	// copy a fixture so a benchmark can mutate it
+	std::string workingCopy(const std::string& fixture, const std::string& name);
+
+}
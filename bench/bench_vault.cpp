@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+#include "Stats.h"
+#include "VaultCollection.h"
+#include <cstdio>
+#include <filesystem>
+
+// Vault sizes from 10 to 1M entries
+#define VAULT_SIZES RangeMultiplier(10)->Range(10, 1000000)
+
+// full load (read, authenticate, decrypt, parse, index) with a cached key;
+// file_bytes is the size of the vault on disk
+static void loadVault(benchmark::State& state, bool compressed) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string& path = bench::vaultWith(n, compressed);
+	const KeyProvider key = bench::cachedKey();
+
+	for (auto _ : state) {
+		Vault v(path);
+		if (const VaultStatus st = v.load(key); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		benchmark::DoNotOptimize(v.getEntries().data());
+	}
+	const auto bytes = std::filesystem::file_size(path);
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(bytes));
+	state.counters["file_bytes"] = static_cast<double>(bytes);
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+
+static void BM_VaultLoad(benchmark::State& state) { loadVault(state, false); }
+BENCHMARK(BM_VaultLoad)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+
+// BM_VaultLoad of the same entries with record compression on
+static void BM_VaultLoadCompressed(benchmark::State& state) { loadVault(state, true); }
+BENCHMARK(BM_VaultLoadCompressed)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+
+// BM_VaultLoad while --stats collects: the cost of the per-record timers
+static void BM_VaultLoadStats(benchmark::State& state) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string& path = bench::vaultWith(n);
+	const KeyProvider key = bench::cachedKey();
+
+	Stats::enable(true);
+	for (auto _ : state) {
+		Vault v(path);
+		if (const VaultStatus st = v.load(key); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		benchmark::DoNotOptimize(v.getEntries().data());
+	}
+	Stats::enable(false);
+	Stats::reset();
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_VaultLoadStats)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// one addEntry + save on an already loaded vault (incremental append path)
+static void BM_VaultAppendSave(benchmark::State& state) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string path = bench::workingCopy(bench::vaultWith(n), "append_" + std::to_string(n) + ".vault");
+
+	Vault v(path);
+	if (const VaultStatus st = v.load(bench::cachedKey()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); return; }
+
+	size_t i = 0;
+	for (auto _ : state) {
+		const std::string site = "appended" + std::to_string(i++);
+		v.addEntry(Entry{ site, "user", "password" });
+		if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK(BM_VaultAppendSave)->VAULT_SIZES->Unit(benchmark::kMicrosecond);
+
+// addEntries(n) + save into an empty vault
+static void bulkSave(benchmark::State& state, bool compressed) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string& empty = bench::vaultWith(0, compressed);
+
+	SecureArena arena;
+	std::vector<Entry> batch;
+	bench::makeEntries(n, arena, batch);
+
+	std::string path;
+	for (auto _ : state) {
+		state.PauseTiming();
+		path = bench::workingCopy(empty, "bulk_" + std::to_string(n) + ".vault");
+		Vault v(path);
+		if (const VaultStatus st = v.load(bench::cachedKey()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		state.ResumeTiming();
+
+		v.addEntries(batch);
+		if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	if (!path.empty()) state.counters["file_bytes"] = static_cast<double>(std::filesystem::file_size(path));
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+
+static void BM_VaultBulkSave(benchmark::State& state) { bulkSave(state, false); }
+BENCHMARK(BM_VaultBulkSave)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+
+// BM_VaultBulkSave with record compression on: a save that rewrites the
+// vault also trains and seals the dictionary
+static void BM_VaultBulkSaveCompressed(benchmark::State& state) { bulkSave(state, true); }
+BENCHMARK(BM_VaultBulkSaveCompressed)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+
+// indexed prefix query over the loaded vault
+static void BM_VaultFindPrefix(benchmark::State& state) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	Vault v(bench::vaultWith(n));
+	if (const VaultStatus st = v.load(bench::cachedKey()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); return; }
+
+	for (auto _ : state) {
+		size_t hits = 0;
+		for (const auto& e : v.findPrefix("site0000001")) { benchmark::DoNotOptimize(e.site.data()); ++hits; }
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VaultFindPrefix)->VAULT_SIZES;
+
+// "get credential for site X" from disk: tag index lookup that verifies a
+// few pages and opens only the matching records (compare with BM_VaultLoad,
+// which opens all of them)
+static void BM_VaultGetSite(benchmark::State& state) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string& path = bench::vaultWith(n);
+	const KeyProvider key = bench::cachedKey();
+
+	char site[64];
+	std::snprintf(site, sizeof(site), "site%08zu.example.com", n / 2);
+	size_t opened = 0;
+	for (auto _ : state) {
+		Vault v(path);
+		if (const VaultStatus st = v.loadMatching(key, site, false); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		if (v.findSite(site).empty()) { state.SkipWithError("lookup missed its entry"); break; }
+		opened = v.list().size();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["records_opened"] = static_cast<double>(opened);
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK(BM_VaultGetSite)->VAULT_SIZES->Unit(benchmark::kMicrosecond);
+
+// list: load and walk site / username in site order; passwords stay sealed.
+// With reveal set every password is decrypted too, as listing did before
+// passwords were sealed on their own.
+static void BM_VaultList(benchmark::State& state, bool reveal) {
+	const size_t n = static_cast<size_t>(state.range(0));
+	const std::string& path = bench::vaultWith(n);
+	const KeyProvider key = bench::cachedKey();
+
+	for (auto _ : state) {
+		Vault v(path);
+		if (const VaultStatus st = v.load(key); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		Secret password;
+		size_t bytes = 0;
+		for (const auto& e : v.sites()) {
+			bytes += e.site.size() + e.username.size();
+			if (reveal) {
+				if (v.reveal(e, password) != VaultStatus::Ok) { state.SkipWithError("reveal failed"); break; }
+				bytes += password.view().size();
+			}
+		}
+		benchmark::DoNotOptimize(bytes);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	state.counters["peak_rss_mb"] = bench::peakRssMb();
+}
+BENCHMARK_CAPTURE(BM_VaultList, metadata, false)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_VaultList, reveal_all, true)->VAULT_SIZES->Unit(benchmark::kMillisecond);
+
+// one password decrypted on demand from a loaded vault
+static void BM_VaultReveal(benchmark::State& state) {
+	Vault v(bench::vaultWith(1000));
+	if (const VaultStatus st = v.load(bench::cachedKey()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); return; }
+
+	const Entry e = v.list().front();
+	Secret password;
+	for (auto _ : state) {
+		if (v.reveal(e, password) != VaultStatus::Ok) { state.SkipWithError("reveal failed"); break; }
+		benchmark::DoNotOptimize(password.view().data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VaultReveal);
+
+// opening a 10k entry vault split into that many shards, one Argon2id per
+// shard run side by side on the collection's pool
+static void BM_CollectionOpen(benchmark::State& state) {
+	const std::string& manifest = bench::collectionWith(10000, static_cast<size_t>(state.range(0)));
+	const KeyProvider key = bench::derivedKey();
+
+	for (auto _ : state) {
+		VaultCollection c(manifest);
+		if (const VaultStatus st = c.loadManifest(); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		if (const VaultStatus st = c.open(key, VaultCollection::defaultMemBudget()); st != VaultStatus::Ok) { state.SkipWithError(describe(st)); break; }
+		benchmark::DoNotOptimize(c.vault(0));
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 10000);
+}
+BENCHMARK(BM_CollectionOpen)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// ranked search fanned out over the shards of a 100k entry vault and merged
+static void BM_CollectionSearch(benchmark::State& state) {
+	VaultCollection c(bench::collectionWith(100000, static_cast<size_t>(state.range(0))));
+	if (c.loadManifest() != VaultStatus::Ok || c.open(bench::cachedKey(), VaultCollection::defaultMemBudget()) != VaultStatus::Ok) {
+		state.SkipWithError("open failed");
+		return;
+	}
+	c.search("warm", 1); // build every shard's search index
+
+	size_t hits = 0;
+	for (auto _ : state) {
+		const auto found = c.search("site0004242", 20);
+		hits = found.size();
+		benchmark::DoNotOptimize(found.data());
+	}
+	state.counters["hits"] = static_cast<double>(hits);
+}
+BENCHMARK(BM_CollectionSearch)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Compare a pm_bench JSON run against the checked-in baseline.
+
+    compare_baseline.py baseline.json current.json [--threshold 0.25]
+
+Exits non-zero when any benchmark's real time is slower than the baseline by
+more than the threshold (a fraction, default 25%). Runs made with
+repetitions are compared by their medians; a single-run baseline is too
+noisy to gate on, so against one regressions are listed but don't fail the
+check. Benchmarks missing from either file are listed but don't fail the
+check either. Runs of different pm build types (the pm_build_type context
+pm_bench_check records) aren't compared.
+
+Refresh the baseline from a Release build on a quiet reference host, the
+way pm_bench_check runs the suite:
+    pm_bench --benchmark_context=pm_build_type=Release \
+        --benchmark_repetitions=5 --benchmark_report_aggregates_only=true \
+        --benchmark_out=bench/baseline.json --benchmark_out_format=json
+"""
+import argparse
+import json
+import sys
+
+UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    ctx = data.get("context", {})
+    out = {}
+    medians = 0  # repetitions behind each median, 0 for a single run
+    for b in data.get("benchmarks", []):
+        # aggregates (mean/median/stddev) only when run with repetitions
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") != "median":
+                continue
+            medians = b.get("repetitions", 1)
+        elif medians:
+            continue  # repetitions listed beside their aggregates
+        name = b.get("run_name", b["name"])
+        out[name] = b["real_time"] * UNIT_NS[b.get("time_unit", "ns")]
+    return ctx, out, medians
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    ap.add_argument("--threshold", type=float, default=0.25)
+    args = ap.parse_args()
+
+    base_ctx, base, base_medians = load(args.baseline)
+    cur_ctx, cur, cur_medians = load(args.current)
+
+    for label, ctx, medians in (("baseline", base_ctx, base_medians), ("current", cur_ctx, cur_medians)):
+        print(f"{label}: {ctx.get('host_name', '?')}, {ctx.get('num_cpus', '?')} cpu(s), "
+              f"pm {ctx.get('pm_build_type', 'unknown')} build, "
+              f"{f'medians of {medians} runs' if medians else 'single run'}")
+    # timings of a Debug build say nothing about a Release baseline
+    if base_ctx.get("pm_build_type") != cur_ctx.get("pm_build_type"):
+        print("\nbuild types differ; rebuild to match or refresh the baseline")
+        return 2
+    print()
+
+    regressions = 0
+    print(f"{'benchmark':<40} {'baseline':>12} {'current':>12} {'change':>8}")
+    for name in sorted(base.keys() | cur.keys()):
+        if name not in base or name not in cur:
+            print(f"{name:<40} {'(missing in ' + ('current' if name in base else 'baseline') + ')':>34}")
+            continue
+        b, c = base[name], cur[name]
+        change = (c - b) / b if b else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<40} {b / 1e6:>10.3f}ms {c / 1e6:>10.3f}ms {change:>+7.1%}{flag}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower than baseline by more than {args.threshold:.0%}")
+        if not base_medians:
+            print("baseline is a single run: not failing; re-record it with repetitions (see above)")
+            return 0
+        return 1
+    print("\nno regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,165 @@
+// Load generator for `pm serve`: concurrent clients on persistent
+// connections issue a mix of GET / FIND / ADD requests for a fixed time and
+// the latency of each kind is reported as percentiles.
+//
+//   pm_loadgen [--socket PATH] [--clients N] [--seconds S] [--writes PCT]
+//              [--entries N] [--workers N] [--batch-ms N]
+//
+// Without --socket a vault of --entries synthetic entries is built and
+// served in-process (--workers / --batch-ms configure that server); with it,
+// an already running server is driven and GET / FIND use the synthetic
+// site names, so only a server over such a vault gets hits.
+#include "bench_util.h"
+#include "../src/Server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	enum Op { Get, Find, Add, OpCount };
+	const char* const kOpNames[OpCount] = { "GET", "FIND", "ADD" };
+
+	struct Args {
+		std::string socket;
+		unsigned clients = 8;
+		unsigned seconds = 5;
+		unsigned writes = 10; // percent of requests that are ADDs
+		size_t entries = 10000;
+		unsigned workers = 0;
+		unsigned batchMs = 5;
+	};
+
+	bool parseArgs(int argc, char** argv, Args& out) {
+		for (int i = 1; i + 1 < argc; i += 2) {
+			const std::string flag = argv[i];
+			const char* v = argv[i + 1];
+			if (flag == "--socket") out.socket = v;
+			else if (flag == "--clients") out.clients = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+			else if (flag == "--seconds") out.seconds = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+			else if (flag == "--writes") out.writes = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+			else if (flag == "--entries") out.entries = std::strtoull(v, nullptr, 10);
+			else if (flag == "--workers") out.workers = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+			else if (flag == "--batch-ms") out.batchMs = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+			else return false;
+		}
+		return argc % 2 == 1 && out.clients > 0 && out.writes <= 100 && out.entries > 0;
+	}
+
+	// latencies in microseconds, per op
+	struct Samples {
+		std::vector<double> us[OpCount];
+		size_t errors = 0;
+	};
+
+	double percentile(const std::vector<double>& sorted, double p) {
+		if (sorted.empty()) return 0;
+		const size_t i = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+		return sorted[i];
+	}
+
+	void client(const Args& args, const std::string& socket, unsigned id, Clock::time_point end, Samples& out) {
+		Server::Client c;
+		if (!c.connect(socket)) { ++out.errors; return; }
+
+		std::mt19937_64 rng(id * 7919 + 1);
+		std::uniform_int_distribution<size_t> pickEntry(0, args.entries - 1);
+		std::uniform_int_distribution<unsigned> pickPct(0, 99);
+		char buf[64];
+		std::string reply;
+		size_t added = 0;
+
+		while (Clock::now() < end) {
+			Op op = Get;
+			std::string request;
+			if (pickPct(rng) < args.writes) {
+				op = Add;
+				std::snprintf(buf, sizeof(buf), "load%u-%zu.example.com", id, added++);
+				request = "ADD " + Server::field(buf) + " " + Server::field("loadgen") + " " + Server::field("Pw-loadgen!");
+			}
+			else if (pickPct(rng) < 10) {
+				op = Find;
+				std::snprintf(buf, sizeof(buf), "site%08zu", pickEntry(rng));
+				request = "FIND " + Server::field(buf);
+			}
+			else {
+				std::snprintf(buf, sizeof(buf), "site%08zu.example.com", pickEntry(rng));
+				request = "GET " + Server::field(buf);
+			}
+
+			const auto start = Clock::now();
+			if (!c.call(request, reply)) { ++out.errors; return; }
+			const auto took = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+			if (reply.rfind("OK", 0) != 0) ++out.errors;
+			out.us[op].push_back(took);
+		}
+	}
+
+}
+
+int main(int argc, char** argv) {
+	Args args;
+	if (!parseArgs(argc, argv, args)) {
+		std::fprintf(stderr, "usage: %s [--socket PATH] [--clients N] [--seconds S] [--writes PCT] [--entries N] [--workers N] [--batch-ms N]\n", argv[0]);
+		return 1;
+	}
+
+	// in-process server over a fresh copy of the fixture vault
+	std::string socket = args.socket;
+	Vault vault(args.socket.empty() ? bench::workingCopy(bench::vaultWith(args.entries), "serve.vault") : std::string());
+	std::thread server;
+	if (socket.empty()) {
+		if (const VaultStatus st = vault.load(bench::cachedKey()); st != VaultStatus::Ok) {
+			std::fprintf(stderr, "load: %s\n", describe(st));
+			return 1;
+		}
+		socket = bench::tempPath("serve.sock");
+		Server::Options options;
+		options.socketPath = socket;
+		options.workers = args.workers;
+		options.batchMs = args.batchMs;
+		server = std::thread([&vault, options]() { Server::run(vault, options); });
+
+		Server::Client probe;
+		for (int i = 0; i < 500 && !probe.connect(socket); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::vector<Samples> samples(args.clients);
+	std::vector<std::thread> clients;
+	const auto begin = Clock::now();
+	const auto end = begin + std::chrono::seconds(args.seconds);
+	for (unsigned i = 0; i < args.clients; ++i) clients.emplace_back(client, std::cref(args), std::cref(socket), i, end, std::ref(samples[i]));
+	for (auto& t : clients) t.join();
+	const double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+	if (server.joinable()) {
+		Server::Client stop;
+		std::string reply;
+		if (stop.connect(socket)) stop.call("STOP", reply);
+		server.join();
+	}
+
+	size_t errors = 0;
+	size_t total = 0;
+	std::printf("%u clients, %.1f s, %u%% writes\n", args.clients, elapsed, args.writes);
+	std::printf("%-6s %10s %10s %10s %10s %10s %10s\n", "op", "count", "req/s", "p50 us", "p99 us", "p99.9 us", "max us");
+	for (int op = 0; op < OpCount; ++op) {
+		std::vector<double> all;
+		for (auto& s : samples) all.insert(all.end(), s.us[op].begin(), s.us[op].end());
+		std::sort(all.begin(), all.end());
+		total += all.size();
+		std::printf("%-6s %10zu %10.0f %10.1f %10.1f %10.1f %10.1f\n", kOpNames[op], all.size(), all.size() / elapsed,
+			percentile(all, 0.50), percentile(all, 0.99), percentile(all, 0.999), all.empty() ? 0.0 : all.back());
+	}
+	for (auto& s : samples) errors += s.errors;
+	std::printf("total  %10zu %10.0f   errors %zu\n", total, total / elapsed, errors);
+	return errors == 0 ? 0 : 1;
+}
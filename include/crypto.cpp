@@ -1,17 +1,16 @@
 #include "crypto.h"
+#include "../src/Stats.h"
 #include <sodium.h>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <stdexcept>
 
 namespace {
-	// Confirm installation of libsodium
+	// Confirm installation of libsodium (once, safe to race from worker threads)
 	bool ensure_sodium_init() {
-		static bool inited = false;
-		if (!inited) {
-			if (sodium_init() < 0) return false;
-			inited = true;
-		}
-		return true;
+		static const bool inited = sodium_init() >= 0;
+		return inited;
 	}
 
 }
@@ -26,14 +25,45 @@ namespace Crypto {
 		return v;
 	}
 
+	std::vector<unsigned char> checksum(const void* data, size_t len) {
+		if (!ensure_sodium_init()) return {};
+		std::vector<unsigned char> out(crypto_generichash_BYTES);
+		crypto_generichash(out.data(), out.size(), static_cast<const unsigned char*>(data), len, nullptr, 0);
+		return out;
+	}
+
+	bool deriveSubkey(const std::vector<unsigned char>& key, std::uint64_t id, const char (&context)[9], std::vector<unsigned char>& outSubkey) {
+		if (!ensure_sodium_init() || key.size() != crypto_kdf_KEYBYTES) return false;
+		outSubkey.assign(crypto_kdf_KEYBYTES, 0);
+		return crypto_kdf_derive_from_key(outSubkey.data(), outSubkey.size(), id, context, key.data()) == 0;
+	}
+
+	bool keyedHash(const std::vector<unsigned char>& key, const void* data, size_t len, unsigned char* out, size_t outLen) {
+		if (!ensure_sodium_init()) return false;
+		return crypto_generichash(out, outLen, static_cast<const unsigned char*>(data), len, key.data(), key.size()) == 0;
+	}
+
 	// Securely zero memory to prevent data leaks.
 	void secureZero(void* p, size_t n) {
 		if (p && n) sodium_memzero(p, n);
 	}
 
+	// Allocate guarded, locked memory for secrets.
+	void* secureAlloc(size_t n) {
+		if (!ensure_sodium_init()) return nullptr;
+		PM_COUNT(SecureAllocs, 1);
+		return sodium_malloc(n);
+	}
+
+	// Wipe and release memory from secureAlloc.
+	void secureFree(void* p) {
+		if (p) sodium_free(p);
+	}
+
 	// Encode a byte vector into a Base64 string.
 	std::string b64encode(const std::vector<unsigned char>& v) {
 		if (!ensure_sodium_init()) return {};
+		PM_TIME(Base64);
 		std::string out; 
 		out.resize(sodium_base64_ENCODED_LEN(v.size(), sodium_base64_VARIANT_ORIGINAL));
 		
@@ -48,6 +78,7 @@ namespace Crypto {
 	// decode Base64 string back into byte vector.
 	std::vector<unsigned char> b64decode(const std::string& s) {
 		if (!ensure_sodium_init()) return {};
+		PM_TIME(Base64);
 
 		std::vector<unsigned char> out(s.size(), 0);
 
@@ -64,6 +95,7 @@ namespace Crypto {
 	bool deriveKey(const std::string& master, const KdfParams& kdf, std::vector<unsigned char>& outKey) {
 		if (!ensure_sodium_init()) return false;
 		if (kdf.salt.size() != crypto_pwhash_SALTBYTES) return false;
+		PM_TIME(Kdf);
 
 		outKey.assign(crypto_aead_xchacha20poly1305_ietf_KEYBYTES, 0);
 		// argon2id password hashing to derive encryption key
@@ -73,8 +105,102 @@ namespace Crypto {
 		return true;
 
 	}
-	// encrypt plaintext using XChaCha20-Poly1305 AEAD.
-	bool encrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char> nonce24, const std::string& plaintext, std::string& outCiphertext864) {
+	bool kdfInBounds(const KdfParams& kdf) {
+		return kdf.opslimit >= crypto_pwhash_OPSLIMIT_MIN && kdf.opslimit <= kMaxOpslimit
+			&& kdf.memlimit >= crypto_pwhash_MEMLIMIT_MIN && kdf.memlimit <= kMaxMemlimit;
+	}
+
+	// wall time of one derivation in ms, negative on failure (e.g. no memory)
+	static double timeDerive(unsigned long long opslimit, size_t memlimit) {
+		KdfParams p;
+		p.opslimit = opslimit;
+		p.memlimit = memlimit;
+		p.salt = randomBytes(crypto_pwhash_SALTBYTES);
+
+		std::vector<unsigned char> key;
+		const auto start = std::chrono::steady_clock::now();
+		const bool ok = deriveKey("calibration", p, key);
+		const auto end = std::chrono::steady_clock::now();
+		if (!key.empty()) secureZero(key.data(), key.size());
+		return ok ? std::chrono::duration<double, std::milli>(end - start).count() : -1.0;
+	}
+
+	bool calibrateKdf(unsigned targetMs, size_t memBudget, KdfParams& out, double& measuredMs) {
+		const size_t mib = 1024 * 1024;
+		const size_t minMem = 8 * mib;
+		const double target = std::max(1u, targetMs);
+
+		size_t mem = std::clamp(memBudget / mib * mib, minMem, kMaxMemlimit);
+		unsigned long long ops = crypto_pwhash_OPSLIMIT_MIN;
+		// the first run pays for faulting in the memory: keep the faster one
+		double t = timeDerive(ops, mem);
+		if (t >= 0) t = std::min(t, timeDerive(ops, mem));
+
+		// over the target with a single pass: give up memory (time is
+		// roughly linear in memory x passes)
+		for (int i = 0; i < 8 && (t < 0 || t > target) && mem > minMem; ++i) {
+			const double scale = t < 0 ? 0.5 : target / t;
+			mem = std::max(minMem, static_cast<size_t>(static_cast<double>(mem) * scale) / mib * mib);
+			t = timeDerive(ops, mem);
+		}
+		if (t < 0) return false;
+
+		// under it: spend the rest on passes. Time is fixed setup (allocation,
+		// page faults) plus a per-pass cost, so fit both from 1 and 2 passes.
+		if (t < target) {
+			const double t2 = timeDerive(ops + 1, mem);
+			if (t2 < 0) return false;
+			const double perPass = std::max(t2 - t, t / 8);
+			const double setup = std::max(0.0, t - perPass);
+			ops = std::clamp(static_cast<unsigned long long>((target - setup) / perPass + 0.5), static_cast<unsigned long long>(crypto_pwhash_OPSLIMIT_MIN), kMaxOpslimit);
+			t = ops == crypto_pwhash_OPSLIMIT_MIN ? t : timeDerive(ops, mem);
+			while (t > target * 1.2 && ops > crypto_pwhash_OPSLIMIT_MIN) t = timeDerive(--ops, mem);
+		}
+		if (t < 0) return false;
+
+		out.opslimit = ops;
+		out.memlimit = mem;
+		out.salt.clear();
+		measuredMs = t;
+		return true;
+	}
+
+	bool wrapKey(const std::vector<unsigned char>& kek, const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outWrapped) {
+		if (!ensure_sodium_init()) return false;
+		if (kek.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES || dataKey.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) return false;
+
+		const size_t npub = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+		outWrapped.assign(npub + dataKey.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES, 0);
+		randombytes_buf(outWrapped.data(), npub);
+
+		static const char ad[] = "pm-wrapped-key";
+		unsigned long long clen = 0;
+		if (crypto_aead_xchacha20poly1305_ietf_encrypt(outWrapped.data() + npub, &clen, dataKey.data(), dataKey.size(),
+			reinterpret_cast<const unsigned char*>(ad), sizeof(ad) - 1, nullptr, outWrapped.data(), kek.data()) != 0) {
+			outWrapped.clear();
+			return false;
+		}
+		return true;
+	}
+
+	bool unwrapKey(const std::vector<unsigned char>& kek, const std::vector<unsigned char>& wrapped, std::vector<unsigned char>& outDataKey) {
+		if (!ensure_sodium_init()) return false;
+		const size_t npub = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+		const size_t keyBytes = crypto_aead_xchacha20poly1305_ietf_KEYBYTES;
+		if (kek.size() != keyBytes || wrapped.size() != npub + keyBytes + crypto_aead_xchacha20poly1305_ietf_ABYTES) return false;
+
+		static const char ad[] = "pm-wrapped-key";
+		outDataKey.assign(keyBytes, 0);
+		if (crypto_aead_xchacha20poly1305_ietf_decrypt(outDataKey.data(), nullptr, nullptr, wrapped.data() + npub, wrapped.size() - npub,
+			reinterpret_cast<const unsigned char*>(ad), sizeof(ad) - 1, wrapped.data(), kek.data()) != 0) {
+			outDataKey.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// encrypt plaintext using XChaCha20-Poly1305 AEAD, raw ciphertext output.
+	bool encrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const std::string& plaintext, std::vector<unsigned char>& outCiphertext) {
 		if (!ensure_sodium_init()) return false;
 		if (key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) return false;
 
@@ -83,41 +209,47 @@ namespace Crypto {
 		const unsigned char* msg = reinterpret_cast<const unsigned char*>(plaintext.data());
 		const unsigned long long mlen = static_cast<unsigned long long>(plaintext.size());
 
-		std::vector<unsigned char> ct(mlen + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+		outCiphertext.assign(mlen + crypto_aead_xchacha20poly1305_ietf_ABYTES, 0);
 
 		unsigned long long clen = 0;
 
 		// encrypt message with Authenticated Encryption with Associated Data (AEAD).
 		if (crypto_aead_xchacha20poly1305_ietf_encrypt(
-			ct.data(), &clen, msg, mlen, nullptr, 0, nullptr, nonce24.data(), key.data()) != 0) {
+			outCiphertext.data(), &clen, msg, mlen, nullptr, 0, nullptr, nonce24.data(), key.data()) != 0) {
+			outCiphertext.clear();
 			return false;
 		}
 
-		ct.resize(static_cast<size_t>(clen));
+		outCiphertext.resize(static_cast<size_t>(clen));
+		return true;
+	}
+
+	// encrypt plaintext using XChaCha20-Poly1305 AEAD, Base64 output.
+	bool encrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char> nonce24, const std::string& plaintext, std::string& outCiphertext864) {
+		std::vector<unsigned char> ct;
+		if (!encrypt(key, nonce24, plaintext, ct)) return false;
 
 		// encode ciphertext to Base64 for storage.
 		outCiphertext864 = b64encode(ct);
 		return !outCiphertext864.empty();
 	}
 
-	// decrypts ciphertext using XChaCha20-Poly1305 AEAD
-	bool decrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const std::string& ciphertext864, std::string& outPlainText) {
+	// decrypts raw ciphertext bytes using XChaCha20-Poly1305 AEAD
+	bool decrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const unsigned char* ciphertext, size_t ciphertextLen, std::string& outPlainText) {
 		if (!ensure_sodium_init()) return false;
 
 		if (key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) return false;
 		if (nonce24.size() != crypto_aead_xchacha20poly1305_ietf_NPUBBYTES) return false;
+		if (!ciphertext || ciphertextLen < crypto_aead_xchacha20poly1305_ietf_ABYTES) return false;
 
-		auto ct = b64decode(ciphertext864);
-		if (ct.empty()) return false;
-
-		std::vector<unsigned char> pt(ct.size(), 0);
+		std::vector<unsigned char> pt(ciphertextLen, 0);
 		unsigned long long plen = 0;
 
 		// Decrypts ciphertext and verifies authenticity.
 		if (crypto_aead_xchacha20poly1305_ietf_decrypt(
 			pt.data(), &plen,
-			nullptr, ct.data(),
-			static_cast<unsigned long long>(ct.size()),
+			nullptr, ciphertext,
+			static_cast<unsigned long long>(ciphertextLen),
 			nullptr, 0, nonce24.data(),
 			key.data()) != 0) {
 			return false; // if authentication fails
@@ -131,6 +263,59 @@ namespace Crypto {
 		// seurely erase plaintext buffer from memory.
 		secureZero(pt.data(), pt.size());
 		return true;
+	}
+
+	// decrypts Base64 ciphertext using XChaCha20-Poly1305 AEAD
+	bool decrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const std::string& ciphertext864, std::string& outPlainText) {
+		auto ct = b64decode(ciphertext864);
+		if (ct.empty()) return false;
 
+		return decrypt(key, nonce24, ct.data(), ct.size(), outPlainText);
 	}
-}
+
+	// seal a small record with its own random nonce (nonce || ciphertext).
+	bool seal(const std::vector<unsigned char>& key, const std::string& plaintext, const std::string& ad, std::vector<unsigned char>& outSealed) {
+		if (!ensure_sodium_init()) return false;
+		if (key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) return false;
+
+		const size_t npub = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+		outSealed.assign(npub + plaintext.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES, 0);
+		randombytes_buf(outSealed.data(), npub);
+
+		unsigned long long clen = 0;
+		if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+			outSealed.data() + npub, &clen,
+			reinterpret_cast<const unsigned char*>(plaintext.data()), plaintext.size(),
+			reinterpret_cast<const unsigned char*>(ad.data()), ad.size(),
+			nullptr, outSealed.data(), key.data()) != 0) {
+			outSealed.clear();
+			return false;
+		}
+		outSealed.resize(npub + static_cast<size_t>(clen));
+		return true;
+	}
+
+	// open a record produced by seal(), verifying the tag and associated data.
+	bool open(const std::vector<unsigned char>& key, const unsigned char* sealed, size_t sealedLen, const std::string& ad, std::string& outPlainText) {
+		if (!ensure_sodium_init()) return false;
+		if (key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) return false;
+
+		const size_t npub = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+		if (!sealed || sealedLen < npub + crypto_aead_xchacha20poly1305_ietf_ABYTES) return false;
+
+		const size_t clen = sealedLen - npub;
+		outPlainText.assign(clen - crypto_aead_xchacha20poly1305_ietf_ABYTES, '\0');
+
+		unsigned long long plen = 0;
+		if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+			reinterpret_cast<unsigned char*>(outPlainText.data()), &plen, nullptr,
+			sealed + npub, clen,
+			reinterpret_cast<const unsigned char*>(ad.data()), ad.size(),
+			sealed, key.data()) != 0) {
+			outPlainText.clear();
+			return false;
+		}
+		outPlainText.resize(static_cast<size_t>(plen));
+		return true;
+	}
+}
\ No newline at end of file
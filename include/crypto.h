@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -14,12 +15,53 @@ namespace Crypto {
 
 	bool deriveKey(const std::string& master, const KdfParams& kdf, std::vector<unsigned char>& outKey);
 
+	// Argon2id limits accepted from a vault header, so a hostile file can't
+	// make unlock hang or exhaust memory
+	const unsigned long long kMaxOpslimit = 256;
+	const size_t kMaxMemlimit = size_t(4) * 1024 * 1024 * 1024; // 4 GiB
+	bool kdfInBounds(const KdfParams& kdf);
+
+	// Time Argon2id on this machine and pick parameters for an unlock of
+	// about targetMs: the most memory within memBudget (down to 8 MiB if one
+	// pass is still too slow), then as many passes as fit. Salt is left empty.
+	bool calibrateKdf(unsigned targetMs, size_t memBudget, KdfParams& out, double& measuredMs);
+
+	// encrypt a random data key under a key-encryption key (derived from the
+	// master password); wrapped = nonce || ciphertext || tag
+	bool wrapKey(const std::vector<unsigned char>& kek, const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outWrapped);
+	bool unwrapKey(const std::vector<unsigned char>& kek, const std::vector<unsigned char>& wrapped, std::vector<unsigned char>& outDataKey);
+
 	bool encrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char> nonce24, const std::string& plaintext, std::string& outCiphertext864);
 
 	bool decrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const std::string& ciphertext864, std::string& outPlainText);
 
+	// raw-byte variants (no base64), used by the binary vault format
+	bool encrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const std::string& plaintext, std::vector<unsigned char>& outCiphertext);
+
+	bool decrypt(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce24, const unsigned char* ciphertext, size_t ciphertextLen, std::string& outPlainText);
+
+	// seal plaintext under a fresh random nonce, output is nonce || ciphertext.
+	// ad is authenticated but not encrypted (binds a record to its type).
+	bool seal(const std::vector<unsigned char>& key, const std::string& plaintext, const std::string& ad, std::vector<unsigned char>& outSealed);
+
+	bool open(const std::vector<unsigned char>& key, const unsigned char* sealed, size_t sealedLen, const std::string& ad, std::string& outPlainText);
+
 	std::vector<unsigned char> randomBytes(size_t n);
+
+	// unkeyed BLAKE2b-256 of data (integrity of file structures, not secrets)
+	std::vector<unsigned char> checksum(const void* data, size_t len);
+
+	// independent 32-byte key for one purpose (crypto_kdf: id + 8-char
+	// context), so a data key never doubles as e.g. a MAC key
+	bool deriveSubkey(const std::vector<unsigned char>& key, std::uint64_t id, const char (&context)[9], std::vector<unsigned char>& outSubkey);
+	// keyed BLAKE2b, outLen in [16, 64]
+	bool keyedHash(const std::vector<unsigned char>& key, const void* data, size_t len, unsigned char* out, size_t outLen);
+
 	void secureZero(void* p, size_t n);
+
+	// guarded, mlocked allocation (sodium_malloc); secureFree wipes before release
+	void* secureAlloc(size_t n);
+	void secureFree(void* p);
 	std::string b64encode(const std::vector<unsigned char>& v);
 	std::vector<unsigned char> b64decode(const std::string& s);
 
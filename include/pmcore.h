@@ -0,0 +1,105 @@
+#pragma once
+/*
+ * pmcore C API: open, query and edit a vault in-process without the CLI.
+ *
+ * Every call is non-interactive and reports failures through pm_status; no
+ * call prints or reads from the terminal. A pm_vault handle is not thread
+ * safe: serialize calls on the same handle. Separate handles are independent.
+ *
+ * Entry strings handed to callbacks point into the vault's locked memory and
+ * are NOT NUL-terminated; they are valid only for the duration of the
+ * callback. Copy (and later wipe) anything that has to outlive it. The
+ * password is decrypted for its callback alone and wiped when it returns.
+ */
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(PMCORE_SHARED)
+#  if defined(PMCORE_BUILD)
+#    define PMCORE_API __declspec(dllexport)
+#  else
+#    define PMCORE_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define PMCORE_API __attribute__((visibility("default")))
+#else
+#  define PMCORE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on any incompatible change to the declarations below */
+#define PMCORE_ABI_VERSION 1
+
+/* values 0-99 mirror VaultStatus; append only, never renumber */
+typedef enum pm_status {
+	PM_OK = 0,
+	PM_ERR_OPEN = 1,            /* vault file missing or unreadable */
+	PM_ERR_WRITE = 2,           /* could not write the vault file */
+	PM_ERR_TRUNCATED = 3,       /* file ends inside the header or first record */
+	PM_ERR_BAD_HEADER = 4,      /* header invalid (salt / nonce / version) */
+	PM_ERR_KEY = 5,             /* key derivation failed */
+	PM_ERR_AUTH = 6,            /* wrong password or tampered record */
+	PM_ERR_CORRUPT = 7,         /* record is not a valid entry / frame */
+	PM_ERR_LOCKED = 8,          /* vault has no key */
+	PM_ERR_CRYPTO = 9,          /* encryption failed */
+	PM_ERR_LOCK = 10,           /* could not take the vault's write lock */
+	PM_ERR_BAD_KDF = 11,        /* KDF parameters out of range */
+	PM_ERR_BAD_SLOT = 12,       /* unknown or reserved key slot label */
+	PM_ERR_BAD_MANIFEST = 13,   /* collection manifest is not valid */
+	PM_ERR_EXISTS = 14,         /* refusing to overwrite an existing file */
+	PM_ERR_INVALID_ARG = 100,   /* NULL handle / pointer or empty site */
+	PM_ERR_NO_MEMORY = 101,
+	PM_ERR_INTERNAL = 102
+} pm_status;
+
+typedef struct pm_vault pm_vault;
+
+typedef struct pm_entry {
+	const char* site;
+	size_t site_len;
+	const char* username;
+	size_t username_len;
+	const char* password;
+	size_t password_len;
+} pm_entry;
+
+/* called once per matching entry; return non-zero to stop the iteration */
+typedef int (*pm_entry_cb)(const pm_entry* entry, void* ctx);
+
+PMCORE_API int pm_abi_version(void);
+
+/* static description of a status code, never NULL */
+PMCORE_API const char* pm_strerror(pm_status status);
+
+/* create a new empty vault at path (overwrites an existing file) */
+PMCORE_API pm_status pm_vault_create(const char* path, const char* master, size_t master_len, pm_vault** out);
+
+/* open and decrypt an existing vault (v1 or v2). Runs the KDF once; keep the
+   handle around for repeated lookups. */
+PMCORE_API pm_status pm_vault_open(const char* path, const char* master, size_t master_len, pm_vault** out);
+
+/* wipes every decrypted byte and frees the handle; NULL is ignored.
+   Unsaved changes are discarded. */
+PMCORE_API void pm_vault_close(pm_vault* vault);
+
+PMCORE_API size_t pm_vault_count(const pm_vault* vault);
+
+/* case-insensitive lookups, results in site order; site / prefix are
+   NUL-terminated. pm_vault_list visits every entry. */
+PMCORE_API pm_status pm_vault_find(const pm_vault* vault, const char* site, pm_entry_cb cb, void* ctx);
+PMCORE_API pm_status pm_vault_find_prefix(const pm_vault* vault, const char* prefix, pm_entry_cb cb, void* ctx);
+PMCORE_API pm_status pm_vault_list(const pm_vault* vault, pm_entry_cb cb, void* ctx);
+
+/* add an entry (bytes are copied); not on disk until pm_vault_save */
+PMCORE_API pm_status pm_vault_add(pm_vault* vault, const pm_entry* entry);
+
+/* remove every entry whose site matches exactly; removed may be NULL */
+PMCORE_API pm_status pm_vault_remove(pm_vault* vault, const char* site, size_t* removed);
+
+PMCORE_API pm_status pm_vault_save(pm_vault* vault);
+
+#ifdef __cplusplus
+}
+#endif
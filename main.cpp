@@ -1,5 +1,13 @@
 #include "src/Vault.h"
 #include "include/crypto.h"
+#include "src/Agent.h"
+#include "src/Audit.h"
+#include "src/Breach.h"
+#include "src/Generator.h"
+#include "src/Server.h"
+#include "src/Stats.h"
+#include "src/Transfer.h"
+#include "src/VaultCollection.h"
 #include <iostream>
 #include <cstdlib>
 #include <limits>
@@ -8,6 +16,11 @@
 #include <filesystem>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
 
 #if defined(_WIN32)
 #include <conio.h>
@@ -33,6 +46,7 @@ static void clearScreen() {
 }
 
 static void userConfirm() {
+	PM_TIME(Prompt);
 	std::cout << std::endl << "Press any key to return to menu...";
 #if defined(_WIN32)
 	(void)_getch();
@@ -44,6 +58,7 @@ static void userConfirm() {
 }
 
 static std::string prompt(const std::string& label) {
+	PM_TIME(Prompt);
 	std::cout << label;
 	std::string s;
 	std::getline(std::cin, s);
@@ -55,6 +70,7 @@ static std::string prompt(const std::string& label) {
 #define NOMINMAX
 #include <Windows.h>
 static std::string promptSecret(const char* label) {
+	PM_TIME(Prompt);
 	std::cout << label;
 	HANDLE h = GetStdHandle(STD_INPUT_HANDLE);
 
@@ -75,21 +91,173 @@ static std::string promptSecret(const char* label) {
 }
 #endif
 
+// Load a vault with the key cached by the unlock agent, falling back to the
+// master password (and caching the derived key if an agent is running).
+// open does the loading with the key provider it is given.
+static VaultStatus unlockVault(const std::function<VaultStatus(const KeyProvider&)>& open) {
+	bool askedAgent = false;
+	bool agentHit = false;
+	auto fromAgent = [&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		askedAgent = true;
+		agentHit = Agent::getKey(Agent::keyId(kdf), outKey);
+		return agentHit;
+	};
+	const VaultStatus cached = open(fromAgent);
+	if (cached == VaultStatus::Ok) return cached;
+	if (!askedAgent) return cached; // failed before the key mattered (missing / bad file)
+
+	std::string master = promptSecret("Enter master password: ");
+	std::vector<unsigned char> derived;
+	std::string id;
+	auto fromPassword = [&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		if (!Crypto::deriveKey(master, kdf, outKey)) return false;
+		derived = outKey;
+		id = Agent::keyId(kdf);
+		return true;
+	};
+	const VaultStatus st = open(fromPassword);
+	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+
+	// agent may be absent; caching is best effort
+	if (st == VaultStatus::Ok && !derived.empty()) Agent::putKey(id, derived);
+	if (!derived.empty()) Crypto::secureZero(derived.data(), derived.size());
+	return st;
+}
+
+static VaultStatus unlockVault(Vault& v) {
+	return unlockVault([&](const KeyProvider& keyFor) { return v.load(keyFor); });
+}
+
+// Open a collection's members (all, or those listed) the same way: keys the
+// agent holds first, then one master password prompt for the rest. The
+// derivations run in parallel within the KDF memory budget.
+static VaultStatus unlockCollection(VaultCollection& c, const std::vector<size_t>& which = {}) {
+	std::vector<size_t> todo = which;
+	if (todo.empty()) {
+		for (size_t i = 0; i < c.members().size(); ++i) todo.push_back(i);
+	}
+	const size_t budget = VaultCollection::defaultMemBudget();
+
+	auto fromAgent = [](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		return Agent::getKey(Agent::keyId(kdf), outKey);
+	};
+	if (const VaultStatus st = c.open(fromAgent, budget, todo); st == VaultStatus::Ok) return st;
+
+	// only agent misses are worth a password; anything else is final
+	std::vector<size_t> rest;
+	for (size_t i : todo) {
+		const VaultStatus st = c.members()[i].status;
+		if (st == VaultStatus::KeyUnavailable) rest.push_back(i);
+		else if (st != VaultStatus::Ok) return st;
+	}
+
+	std::string master = promptSecret("Enter master password: ");
+	std::mutex derivedMutex;
+	std::map<std::string, std::vector<unsigned char>> derived; // agent key id -> key
+	auto fromPassword = [&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		if (!Crypto::deriveKey(master, kdf, outKey)) return false;
+		std::lock_guard<std::mutex> lk(derivedMutex);
+		derived[Agent::keyId(kdf)] = outKey;
+		return true;
+	};
+	const VaultStatus st = c.open(fromPassword, budget, rest);
+	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+
+	// cache the keys of the vaults that opened; best effort as above
+	for (size_t i : rest) {
+		if (c.members()[i].status != VaultStatus::Ok) continue;
+		auto it = derived.find(Agent::keyId(c.vault(i)->kdfParams()));
+		if (it != derived.end()) Agent::putKey(it->first, it->second);
+	}
+	for (auto& [id, key] : derived) Crypto::secureZero(key.data(), key.size());
+	return st;
+}
+
+// name of the member a collection error came from, for messages
+static std::string failedMember(const VaultCollection& c) {
+	for (const auto& m : c.members()) {
+		if (m.status != VaultStatus::Ok) return m.name + ": ";
+	}
+	return std::string();
+}
+
+// password for a new entry: typed, or generated with the default policy
+// when left empty (and shown once so it can be copied)
+static std::string promptNewPassword() {
+	std::string password = promptSecret("Password (empty to generate one): ");
+	if (!password.empty()) return password;
+
+	SecureArena arena;
+	std::vector<std::string_view> generated;
+	if (!Generator::generate(Generator::Policy{}, 1, arena, generated)) return password;
+	password.assign(generated.front());
+	std::cout << "Generated password: " << password << std::endl;
+	return password;
+}
+
 static void printUsage(const char* exe) {
 	std::cout << "Usage: pm \n"
-		<< "  " << exe << " init <vault.json>\n"
+		<< "  " << exe << " init <vault.json> [target-ms [mem-MB]]\n"
 		<< "  " << exe << " add  <vault.json>\n"
 		<< "  " << exe << " list <vault.json>\n"
-		<< "  " << exe << " del  <vault.json>\n";
+		<< "  " << exe << " del  <vault.json>\n"
+		<< "  " << exe << " find <vault.json>\n"
+		<< "  " << exe << " get  <vault.json> <site>\n"
+		<< "  " << exe << " shard <vault.json> <manifest.json> <count>   (split a vault into count shards)\n"
+		<< "  " << exe << " upgrade <vault.json>\n"
+		<< "  " << exe << " compress <vault.json> on|off [level]   (zstd record compression with a per-vault dictionary)\n"
+		<< "  " << exe << " rekdf <vault.json> [target-ms [mem-MB]]   (re-tune unlock cost, default 250 ms / 64 MB)\n"
+		<< "  " << exe << " passwd <vault.json>                      (change the master password, header only)\n"
+		<< "  " << exe << " recovery <vault.json>                    (add a recovery key slot)\n"
+		<< "  " << exe << " generate [count [length [classes]]]   (random passwords; classes from l u d s, a = no look-alikes)\n"
+		<< "  " << exe << " audit <vault.json> [min-length [min-bits]]   (weak, reused and duplicate passwords)\n"
+		<< "  " << exe << " audit-breach <vault.json> [corpus]   (passwords found in a breach corpus, default $PM_BREACH_CORPUS)\n"
+		<< "  " << exe << " breach-build <dump.txt|-> <corpus> [prefix-bytes [min-count]]   (corpus from an HIBP SHA-1 / NTLM dump)\n"
+		<< "  " << exe << " calibrate [target-ms [mem-MB]]           (show the KDF cost chosen for this host)\n"
+		<< "  " << exe << " import <vault.json> <file> [csv|json]\n"
+		<< "  " << exe << " export <vault.json> <file|-> [csv|json] [--force]   (file created 0600; --force overwrites)\n"
+		<< "  " << exe << " serve <vault.json> [socket [workers [batch-ms]]]   (answer queries over a local socket)\n"
+		<< "  " << exe << " agent [idle-seconds]   (keep derived keys unlocked)\n"
+		<< "  " << exe << " agent stop\n"
+		<< "  " << exe << " lock                   (forget keys held by the agent)\n"
+		<< "add / find / get also take a collection manifest in place of the vault:\n"
+		<< "every vault it lists is searched (find), or just the shard holding the site.\n"
+		<< "Any command also takes --stats (timing breakdown on stderr), --stats=json\n"
+		<< "(one JSON line on stderr) or --stats=json:<file> (appended to file).\n";
+}
+
+// KDF cost for this host: calibrated when a target unlock time is given,
+// otherwise the defaults (3 passes, 64 MB)
+static bool kdfFromArgs(const std::string& targetMs, const std::string& memMb, Crypto::KdfParams& out) {
+	if (targetMs.empty()) { out = Crypto::KdfParams{}; return true; }
+
+	const unsigned target = static_cast<unsigned>(std::strtoul(targetMs.c_str(), nullptr, 10));
+	const size_t budget = (memMb.empty() ? 64 : std::strtoull(memMb.c_str(), nullptr, 10)) * 1024 * 1024;
+	double ms = 0;
+	std::cout << "Calibrating Argon2id for " << target << " ms within " << budget / (1024 * 1024) << " MB..." << std::endl;
+	if (target == 0 || !Crypto::calibrateKdf(target, budget, out, ms)) {
+		std::cerr << "Calibration failed." << std::endl;
+		return false;
+	}
+	std::cout << "Using opslimit " << out.opslimit << ", memlimit " << out.memlimit / (1024 * 1024) << " MB (" << static_cast<int>(ms) << " ms)" << std::endl;
+	return true;
 }
 
-static int cmd_init(const std::string& path) {
+static int cmd_calibrate(const std::string& targetMs, const std::string& memMb) {
+	Crypto::KdfParams params;
+	return kdfFromArgs(targetMs.empty() ? "250" : targetMs, memMb, params) ? 0 : 1;
+}
+
+static int cmd_init(const std::string& path, const std::string& targetMs, const std::string& memMb) {
 	Vault v(path);
 
+	Crypto::KdfParams params;
+	if (!kdfFromArgs(targetMs, memMb, params)) return 1;
+
 	std::string master = promptSecret("Create master password: ");
 
-	if (!v.initNew(master)) {
-		std::cerr << v.getLastError() << std::endl;
+	if (const VaultStatus st = v.initNew(master, params); st != VaultStatus::Ok) {
+		std::cerr << describe(st) << std::endl;
 		
 		if (!master.empty()) Crypto::secureZero(master.data(), master.size());
 		userConfirm();
@@ -104,22 +272,23 @@ static int cmd_init(const std::string& path) {
 }
 
 // cmd add functionality
+static int cmd_add_collection(const std::string& path);
+
 static int cmd_add(const std::string& path) {
+	if (VaultCollection::isManifest(path)) return cmd_add_collection(path);
 	Vault v(path);
 
 	// prompt user for master password
-	std::string master = promptSecret("Enter master password: ");
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
 
-	if (!v.load(master)) { std::cerr << v.getLastError() << std::endl; userConfirm(); return 1; }
-	if (!master.empty()) Crypto::secureZero(const_cast<char*>(master.data()), master.size());
+	std::string site = prompt("Site: ");
+	std::string username = prompt("Username: ");
+	std::string password = promptNewPassword();
 
-	Entry e;
-	e.site = prompt("Site: ");
-	e.username = prompt("Username: ");
-	e.password = promptSecret("Password: ");
-
-	v.addEntry(e);
-	if (!v.save()) { std::cerr << v.getLastError() << std::endl; userConfirm(); return 1; }
+	// addEntry copies the fields into the vault's locked arena
+	v.addEntry(Entry{ site, username, password });
+	if (!password.empty()) Crypto::secureZero(password.data(), password.size());
+	if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
 	userConfirm();
 	return 0;
 }
@@ -136,29 +305,16 @@ static int cmd_list(const std::string& path) {
 
 	Vault v(path);
 
-	std::string master = promptSecret("Enter master password: ");
-	if (!v.load(master)) { std::cerr << v.getLastError() << std::endl; userConfirm(); return -1; }
-	if (!master.empty()) Crypto::secureZero(const_cast<char*>(master.data()), master.size());
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return -1; }
 
-	std::vector<Entry> items = v.getEntries();
+	// index is already in case-folded site order
+	const auto items = v.sites();
 
 	if (items.empty()) { std::cout << "(no entries)" << std::endl; userConfirm(); return 0; }
 
-	std::sort(items.begin(), items.end(),
-		[](const Entry& a, const Entry& b) {
-			auto toLower = [](std::string s) {
-				for (char& c : s) {
-					c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-				}
-				return s;
-				};
-			return toLower(a.site) < toLower(b.site);
-		});
-
-
-	
+	// passwords stay sealed: show one with `get <vault> <site>`
 	for (const auto& e : items) {
-		std::cout << e.site << " | " << e.username << " | " << e.password << std::endl << std::endl;
+		std::cout << e.site << " | " << e.username << std::endl << std::endl;
 	}
 
 	userConfirm();
@@ -173,10 +329,7 @@ static int cmd_del(const std::string& path) {
 	}
 
 	Vault v(path);
-	std::string master = promptSecret("Enter master password: ");
-
-	if (!v.load(master)) { std::cerr << v.getLastError() << std::endl; return 1; }
-	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
 
 	std::string site = prompt("Site to delete (exact match): ");
 	const size_t removed = v.removeBySite(site);
@@ -187,12 +340,17 @@ static int cmd_del(const std::string& path) {
 		return 0;
 	}
 
-	if (!v.save()) { std::cerr << v.getLastError() << std::endl; userConfirm(); return 1; }
+	if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
 	std::cout << "Successfully deleted " << removed << "entr" << (removed == 1 ? "y" : "ies") << std::endl;
 	userConfirm();
 	return 0;
 }
 
+// results shown by find for a text query
+static const size_t kSearchResults = 20;
+
+static int cmd_find_collection(const std::string& path, const std::string& s);
+
 static int cmd_find(const std::string& path) {
 	if (!std::filesystem::exists(path)) {
 		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
@@ -200,52 +358,585 @@ static int cmd_find(const std::string& path) {
 		return 1;
 	}
 
-	Vault v(path);
-	std::string master = promptSecret("Enter master password: ");
+	std::string s = prompt("Starting letter, or text to search site / username: ");
 
-	if (!v.load(master)) { std::cerr << v.getLastError() << std::endl; userConfirm(); return 1; }
-	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+	if (s.empty()) { std::cout << "Nothing entered" << std::endl; userConfirm(); return 0; }
+	if (VaultCollection::isManifest(path)) return cmd_find_collection(path, s);
+	Vault v(path);
 
-	std::string s = prompt("Starting letter (A-Z): ");
+	if (s.size() > 1) {
+		// ranked substring / fuzzy search needs every entry decrypted
+		if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
 
-	if (s.empty()) { std::cout << "No letter entered" << std::endl; userConfirm(); return 0; }
-	unsigned char ch = static_cast<unsigned char>(std::tolower(s[0]));
+		const auto hits = v.search(s, kSearchResults);
+		if (hits.empty()) { std::cout << "No entries match '" << s << "'." << std::endl; userConfirm(); return 0; }
 
-	// store any matches with same letter
-	std::vector<Entry> matches;
-	for (const auto& e : v.getEntries()) {
-		if (!e.site.empty() && std::tolower(static_cast<unsigned char>(e.site[0])) == ch) {
-			matches.push_back(e);
+		std::cout << "Best matches for '" << s << "':" << std::endl;
+		for (const auto& e : hits) {
+			std::cout << e.site << " | " << e.username << std::endl;
 		}
+		userConfirm();
+		return 0;
 	}
 
+	unsigned char ch = static_cast<unsigned char>(std::tolower(s[0]));
+
+	// blind index: only entries under that letter are decrypted
+	const std::string letter(1, static_cast<char>(ch));
+	auto open = [&](const KeyProvider& keyFor) { return v.loadMatching(keyFor, letter, true); };
+	if (const VaultStatus st = unlockVault(open); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+
+	// indexed prefix lookup, already sorted by site
+	const auto matches = v.findPrefix(letter);
+
 	if (matches.empty()) {
 		std::cout << "No entries start with '" << s[0] << "'." << std::endl;
 		userConfirm();
 		return 0;
 	}
 
-	std::sort(matches.begin(), matches.end(),
-		[](const Entry& a, const Entry& b) {
-			auto toLower = [](std::string s) {
-				for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-				return s;
-				};
-			return toLower(a.site) < toLower(b.site);  // <-- return a bool
-		});
-
-
 	std::cout << "Accounts starting with '" << static_cast<char>(std::toupper(ch)) << "'."
 		<< std::endl;
 
 	for (const auto& e : matches) {
-		std::cout << e.site << " | " << e.username << " | " << e.password << std::endl;
+		std::cout << e.site << " | " << e.username << std::endl;
+	}
+
+	userConfirm();
+	return 0;
+}
+
+static int cmd_get_collection(const std::string& path, const std::string& site);
+
+// print the credentials of one site; decrypts only that site's records
+static int cmd_get(const std::string& path, const std::string& site) {
+	if (site.empty()) { std::cerr << "Usage: pm get <vault.json> <site>" << std::endl; return 1; }
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	if (VaultCollection::isManifest(path)) return cmd_get_collection(path, site);
+
+	Vault v(path);
+	auto open = [&](const KeyProvider& keyFor) { return v.loadMatching(keyFor, site, false); };
+	if (const VaultStatus st = unlockVault(open); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const auto matches = v.findSite(site);
+	if (matches.empty()) { std::cerr << "No entry for " << site << std::endl; return 1; }
+	Secret password; // wiped on return
+	for (const auto& e : matches) {
+		if (const VaultStatus st = v.reveal(e, password); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+		std::cout << e.site << " | " << e.username << " | " << password.view() << std::endl;
+	}
+	return 0;
+}
+
+// re-wrap the vault key under KDF parameters calibrated for this host; only
+// the header is rewritten
+static int cmd_rekdf(const std::string& path, const std::string& targetMs, const std::string& memMb) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	Crypto::KdfParams params;
+	if (!kdfFromArgs(targetMs.empty() ? "250" : targetMs, memMb, params)) return 1;
+
+	// the password is needed to wrap the key again, so no agent unlock here
+	Vault v(path);
+	std::string master = promptSecret("Enter master password: ");
+	VaultStatus st = v.load(master);
+	const Crypto::KdfParams before = v.kdfParams();
+	if (st == VaultStatus::Ok) st = v.rekdf(master, params);
+	if (st == VaultStatus::Ok) st = v.save();
+	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+	if (st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	std::cout << "KDF changed from opslimit " << before.opslimit << " / " << before.memlimit / (1024 * 1024) << " MB to opslimit "
+		<< params.opslimit << " / " << params.memlimit / (1024 * 1024) << " MB" << std::endl;
+	return 0;
+}
+
+// new master password; the records keep their key, so only the header changes
+static int cmd_passwd(const std::string& path) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	Vault v(path);
+	std::string current = promptSecret("Current master password or recovery key: ");
+	VaultStatus st = v.load(current);
+	if (st != VaultStatus::Ok) {
+		Crypto::secureZero(current.data(), current.size());
+		std::cerr << describe(st) << std::endl;
+		return 1;
+	}
+
+	std::string next = promptSecret("New master password: ");
+	std::string again = promptSecret("Repeat new master password: ");
+	const char* problem = next.empty() ? "Empty password." : next != again ? "Passwords do not match." : nullptr;
+	if (!problem) st = v.changePassword(current, next);
+	if (!problem && st == VaultStatus::Ok) st = v.save();
+	if (!problem && st != VaultStatus::Ok) problem = describe(st);
+	for (std::string* s : { &current, &next, &again }) if (!s->empty()) Crypto::secureZero(s->data(), s->size());
+	if (problem) { std::cerr << problem << std::endl; return 1; }
+
+	std::cout << "Master password changed." << std::endl;
+	return 0;
+}
+
+// add (or replace) a recovery key slot and print the key once
+static int cmd_recovery(const std::string& path) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	// 128 random bits need no stretching: the cheapest allowed KDF
+	Crypto::KdfParams params;
+	params.opslimit = 1;
+	params.memlimit = 8 * 1024 * 1024;
+
+	static const char hex[] = "0123456789abcdef";
+	std::vector<unsigned char> raw = Crypto::randomBytes(16);
+	std::string recovery;
+	for (size_t i = 0; i < raw.size(); ++i) {
+		if (i > 0 && i % 4 == 0) recovery.push_back('-');
+		recovery.push_back(hex[raw[i] >> 4]);
+		recovery.push_back(hex[raw[i] & 0x0f]);
+	}
+	Crypto::secureZero(raw.data(), raw.size());
+
+	Vault v(path);
+	std::string master = promptSecret("Enter master password: ");
+	VaultStatus st = v.load(master);
+	if (st == VaultStatus::Ok) st = v.addSlot(master, "recovery", recovery, params);
+	if (st == VaultStatus::Ok) st = v.save();
+	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+	if (st != VaultStatus::Ok) {
+		Crypto::secureZero(recovery.data(), recovery.size());
+		std::cerr << describe(st) << std::endl;
+		return 1;
+	}
+
+	std::cout << "Recovery key (shown once, store it offline):" << std::endl << "  " << recovery << std::endl
+		<< "It unlocks the vault and can set a new password with passwd." << std::endl;
+	Crypto::secureZero(recovery.data(), recovery.size());
+	return 0;
+}
+
+// rewrite a legacy (v1 JSON) vault in the binary v2 format
+static int cmd_upgrade(const std::string& path) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const int from = v.formatVersion();
+	if (from >= 2) {
+		std::cout << "Vault is already at format version " << from << std::endl;
+		return 0;
+	}
+
+	if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+	std::cout << "Upgraded vault from format version " << from << " to " << v.formatVersion() << std::endl;
+	return 0;
+}
+
+// turn record compression on or off; the save rewrites every record
+static int cmd_compress(const std::string& path, const std::string& mode, const std::string& levelArg) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+	if (mode != "on" && mode != "off") { std::cerr << "Expected on or off." << std::endl; return 1; }
+	const int level = levelArg.empty() ? Compressor::kDefaultLevel : std::atoi(levelArg.c_str());
+	if (level < Compressor::minLevel() || level > Compressor::maxLevel()) {
+		std::cerr << "Level must be " << Compressor::minLevel() << " to " << Compressor::maxLevel() << "." << std::endl;
+		return 1;
+	}
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const bool on = mode == "on";
+	if (v.compressed() == on && (!on || v.compressionLevel() == level)) {
+		std::cout << "Compression is already " << mode << "." << std::endl;
+		return 0;
+	}
+	v.setCompression(on, level);
+	if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	// records only: the rewrite also adds the tag index and page tree, so
+	// the file size before this command isn't comparable
+	const Vault::RecordBytes bytes = v.lastRewriteBytes();
+	if (!on) std::cout << "Compression off: records take " << bytes.written << " bytes" << std::endl;
+	else if (!v.hasDictionary()) {
+		std::cout << "Compression on (zstd level " << level << "), records stay plain until the vault holds "
+			<< Compressor::kMinSamples << " entries: records take " << bytes.written << " bytes" << std::endl;
+	}
+	else {
+		// percent of the uncompressed size, dictionary included
+		const auto share = bytes.plain ? bytes.written * 100 / bytes.plain : 100;
+		std::cout << "Compression on (zstd level " << level << "): records take " << bytes.written << " bytes, "
+			<< bytes.plain << " uncompressed (" << share << "%)" << std::endl;
+	}
+	return 0;
+}
+
+// bulk import: one unlock, streamed parse, deduped batch adds, one save
+static int cmd_import(const std::string& path, const std::string& file, const std::string& format) {
+	Transfer::Format fmt;
+	if (file.empty() || !Transfer::formatFor(format, file, fmt)) {
+		std::cerr << "Usage: import <vault.json> <file.csv|file.json> [csv|json]" << std::endl;
+		return 1;
+	}
+
+	std::ifstream in(file, std::ios::binary);
+	if (!in) { std::cerr << "Could not open " << file << std::endl; return 1; }
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// parse in bounded batches so the scratch arena never holds the whole file
+	const size_t kBatch = 4096;
+	SecureArena scratch;
+	std::vector<Entry> batch;
+	batch.reserve(kBatch);
+	size_t read = 0, added = 0;
+
+	auto flush = [&]() {
+		added += v.addEntries(batch);
+		batch.clear();
+		scratch.clear();
+	};
+	auto onEntry = [&](const Entry& e) {
+		batch.push_back(e);
+		++read;
+		if (batch.size() == kBatch) flush();
+	};
+
+	std::string err;
+	const bool ok = fmt == Transfer::Format::Csv
+		? Transfer::readCsv(in, scratch, onEntry, err)
+		: Transfer::readJson(in, scratch, onEntry, err);
+	if (!ok) { std::cerr << "Import failed: " << err << std::endl; return 1; }
+	flush();
+
+	if (const VaultStatus st = added > 0 ? v.save() : VaultStatus::Ok; st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Imported " << added << " of " << read << " entries (" << (read - added) << " duplicates skipped) in "
+		<< secs << " s (" << static_cast<long long>(secs > 0 ? read / secs : 0) << " entries/sec)" << std::endl;
+	return 0;
+}
+
+// bulk export in site order; "-" writes to stdout
+static int cmd_export(const std::string& path, const std::string& file, const std::string& format, bool force) {
+	Transfer::Format fmt = Transfer::Format::Json; // stdout defaults to JSON
+	const bool known = (file == "-" && format.empty()) || Transfer::formatFor(format, file, fmt);
+	if (file.empty() || !known) {
+		std::cerr << "Usage: export <vault.json> <file.csv|file.json|-> [csv|json] [--force]" << std::endl;
+		return 1;
+	}
+	if (file != "-" && !force && std::filesystem::exists(file)) {
+		std::cerr << file << " already exists; pass --force to overwrite it." << std::endl;
+		return 1;
+	}
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// plaintext passwords: the file is created owner-only before anything is written
+	std::ofstream ofs;
+	if (file != "-") {
+		if (VaultFile::createPrivate(file, force)) ofs.open(file, std::ios::binary | std::ios::trunc);
+		if (!ofs) { std::cerr << "Could not open " << file << std::endl; return 1; }
 	}
+	std::ostream& out = file == "-" ? std::cout : ofs;
+
+	const auto items = v.sites();
+	const bool ok = fmt == Transfer::Format::Csv ? Transfer::writeCsv(out, v, items) : Transfer::writeJson(out, v, items);
+	out.flush();
+	if (!ok) { std::cerr << "Failed to write " << file << std::endl; return 1; }
+
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Exported " << items.size() << " entries in " << secs << " s ("
+		<< static_cast<long long>(secs > 0 ? items.size() / secs : 0) << " entries/sec). "
+		<< "The output holds plaintext passwords." << std::endl;
+	return 0;
+}
+
+// find over every vault of a collection: each member is searched on its own
+// thread and the results merged (best rank first, or site order for a
+// letter)
+static int cmd_find_collection(const std::string& path, const std::string& s) {
+	VaultCollection c(path);
+	if (const VaultStatus st = c.loadManifest(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+	if (const VaultStatus st = unlockCollection(c); st != VaultStatus::Ok) { std::cerr << failedMember(c) << describe(st) << std::endl; userConfirm(); return 1; }
+
+	const bool letter = s.size() == 1;
+	const auto hits = letter ? c.findPrefix(std::string(1, static_cast<char>(std::tolower(static_cast<unsigned char>(s[0])))))
+		: c.search(s, kSearchResults);
+	if (hits.empty()) { std::cout << "No entries match '" << s << "' in " << c.members().size() << " vaults." << std::endl; userConfirm(); return 0; }
 
+	std::cout << (letter ? "Accounts starting with '" : "Best matches for '") << s << "':" << std::endl;
+	for (const auto& m : hits) {
+		std::cout << c.members()[m.member].name << " | " << m.entry.site << " | " << m.entry.username << std::endl;
+	}
+	userConfirm();
+	return 0;
+}
+
+// get from a collection: a sharded one only opens the shard holding site
+static int cmd_get_collection(const std::string& path, const std::string& site) {
+	VaultCollection c(path);
+	if (const VaultStatus st = c.loadManifest(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	std::vector<size_t> which;
+	if (c.sharded()) which.push_back(c.shardOf(site));
+	if (const VaultStatus st = unlockCollection(c, which); st != VaultStatus::Ok) { std::cerr << failedMember(c) << describe(st) << std::endl; return 1; }
+
+	const auto matches = c.findSite(site);
+	if (matches.empty()) { std::cerr << "No entry for " << site << std::endl; return 1; }
+	Secret password; // wiped on return
+	for (const auto& m : matches) {
+		if (const VaultStatus st = c.vault(m.member)->reveal(m.entry, password); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+		std::cout << c.members()[m.member].name << " | " << m.entry.site << " | " << m.entry.username << " | " << password.view() << std::endl;
+	}
+	return 0;
+}
+
+// add to a collection: the site picks the shard, or the user names a vault
+static int cmd_add_collection(const std::string& path) {
+	VaultCollection c(path);
+	if (const VaultStatus st = c.loadManifest(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+
+	std::string site = prompt("Site: ");
+	size_t member = c.members().size();
+	if (c.sharded()) member = c.shardOf(site);
+	else {
+		const std::string name = prompt("Vault (" + c.members().front().name + (c.members().size() > 1 ? ", ..." : "") + "): ");
+		for (size_t i = 0; i < c.members().size(); ++i) {
+			if (c.members()[i].name == name) member = i;
+		}
+		if (member == c.members().size()) { std::cerr << "No vault named " << name << " in " << path << std::endl; userConfirm(); return 1; }
+	}
+	if (const VaultStatus st = unlockCollection(c, { member }); st != VaultStatus::Ok) { std::cerr << failedMember(c) << describe(st) << std::endl; userConfirm(); return 1; }
+
+	std::string username = prompt("Username: ");
+	std::string password = promptNewPassword();
+
+	Vault& v = *c.vault(member);
+	v.addEntry(Entry{ site, username, password });
+	if (!password.empty()) Crypto::secureZero(password.data(), password.size());
+	if (const VaultStatus st = v.save(); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+	std::cout << "Added to " << c.members()[member].name << std::endl;
 	userConfirm();
 	return 0;
 }
 
+// split one vault into count site-hash shards plus their manifest; the
+// source vault is left untouched
+static int cmd_shard(const std::string& path, const std::string& manifest, const std::string& countArg) {
+	const size_t count = std::strtoull(countArg.c_str(), nullptr, 10);
+	if (manifest.empty() || count == 0) { std::cerr << "Usage: pm shard <vault.json> <manifest.json> <count>" << std::endl; return 1; }
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	// the shards are created under the source's master password, so it is
+	// always asked for (an agent key would not do)
+	Vault v(path);
+	std::string master = promptSecret("Enter master password: ");
+	auto fromPassword = [&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		return Crypto::deriveKey(master, kdf, outKey);
+	};
+	VaultStatus st = v.load(fromPassword);
+	const auto start = std::chrono::steady_clock::now();
+	if (st == VaultStatus::Ok) st = VaultCollection::shard(v, path, master, manifest, count, VaultCollection::defaultMemBudget());
+	if (!master.empty()) Crypto::secureZero(master.data(), master.size());
+	if (st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	VaultCollection c(manifest);
+	if (c.loadManifest() != VaultStatus::Ok) { std::cerr << describe(VaultStatus::BadManifest) << std::endl; return 1; }
+	std::vector<size_t> sizes(count);
+	for (const auto& e : v.list()) ++sizes[c.shardOf(e.site)];
+	for (size_t i = 0; i < count; ++i) {
+		std::cout << c.members()[i].path << ": " << sizes[i] << " entries" << std::endl;
+	}
+	std::cout << "Split " << v.list().size() << " entries into " << count << " shards in " << secs << " s; manifest at " << manifest << std::endl;
+	return 0;
+}
+
+// print count random passwords, one per line; the batch is generated in
+// locked memory and written out in blocks that are wiped after
+static int cmd_generate(const std::string& countArg, const std::string& lengthArg, const std::string& classes) {
+	Generator::Policy policy;
+	const size_t count = countArg.empty() ? 1 : std::strtoull(countArg.c_str(), nullptr, 10);
+	if (!lengthArg.empty()) policy.length = std::strtoull(lengthArg.c_str(), nullptr, 10);
+	if (!classes.empty() && !Generator::parseClasses(classes, policy)) {
+		std::cerr << "Classes are letters from: l (lower) u (upper) d (digits) s (symbols) a (avoid look-alikes)" << std::endl;
+		return 1;
+	}
+	std::string err;
+	if (count == 0 || !Generator::valid(policy, err)) { std::cerr << (count == 0 ? "Count must be positive." : err) << std::endl; return 1; }
+
+	const auto start = std::chrono::steady_clock::now();
+	SecureArena arena;
+	std::vector<std::string_view> passwords;
+	passwords.reserve(count);
+	if (!Generator::generate(policy, count, arena, passwords)) { std::cerr << "Generation failed." << std::endl; return 1; }
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::string block;
+	block.reserve(64 * 1024);
+	for (const auto& p : passwords) {
+		block.append(p).push_back('\n');
+		if (block.size() + policy.length + 1 > block.capacity()) {
+			std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+			Crypto::secureZero(block.data(), block.size());
+			block.clear();
+		}
+	}
+	std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+	std::cout.flush();
+	if (!block.empty()) Crypto::secureZero(block.data(), block.size());
+
+	std::cerr << count << " password" << (count == 1 ? "" : "s") << " of " << policy.length << " characters from "
+		<< Generator::alphabet(policy).size() << " symbols, " << static_cast<int>(Generator::entropyBits(policy))
+		<< " bits each, generated in " << secs << " s" << std::endl;
+	return 0;
+}
+
+// report weak, reused and duplicate passwords of every entry
+static int cmd_audit(const std::string& path, const std::string& minLength, const std::string& minBits) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		userConfirm();
+		return 1;
+	}
+
+	Audit::Policy policy;
+	if (!minLength.empty()) policy.minLength = std::strtoull(minLength.c_str(), nullptr, 10);
+	if (!minBits.empty()) policy.minBits = std::strtod(minBits.c_str(), nullptr);
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+
+	const auto start = std::chrono::steady_clock::now();
+	Audit::Report report;
+	if (const VaultStatus st = Audit::run(v, policy, report); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; userConfirm(); return 1; }
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const auto& entries = v.list();
+	for (const auto& f : report.findings) {
+		const Entry& e = entries[f.entry];
+		std::cout << e.site << " | " << e.username << " | " << Audit::issueNames(f.issues)
+			<< " (" << static_cast<int>(f.bits) << " bits";
+		if (f.group != 0) std::cout << ", shared by " << f.groupSize << " entries, group " << f.group;
+		std::cout << ")" << std::endl;
+	}
+	std::cout << "Audited " << report.scanned << " entries in " << secs << " s: " << report.weak << " weak, "
+		<< report.reused << " in " << report.reuseGroups << " reused password group" << (report.reuseGroups == 1 ? "" : "s")
+		<< ", " << report.duplicates << " duplicate" << (report.duplicates == 1 ? "" : "s") << "." << std::endl;
+	userConfirm();
+	return 0;
+}
+
+// build a breach corpus from an HIBP "HASH:count" text dump
+static int cmd_breach_build(const std::string& dump, const std::string& corpus, const std::string& prefix, const std::string& minCount) {
+	if (dump.empty() || corpus.empty()) { std::cerr << "Usage: pm breach-build <dump.txt|-> <corpus> [prefix-bytes [min-count]]" << std::endl; return 1; }
+
+	Breach::BuildOptions options;
+	if (!prefix.empty()) options.prefixBytes = std::strtoull(prefix.c_str(), nullptr, 10);
+	if (!minCount.empty()) options.minCount = std::strtoull(minCount.c_str(), nullptr, 10);
+
+	std::ifstream file;
+	if (dump != "-") {
+		file.open(dump, std::ios::binary);
+		if (!file) { std::cerr << "Could not open " << dump << std::endl; return 1; }
+	}
+	std::istream& in = dump == "-" ? std::cin : file;
+
+	const auto start = std::chrono::steady_clock::now();
+	Breach::BuildStats stats;
+	std::string err;
+	if (!Breach::build(in, corpus, options, stats, err)) { std::cerr << err << std::endl; return 1; }
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Wrote " << stats.records << " " << (stats.kind == Breach::Kind::Sha1 ? "SHA-1" : "NTLM") << " prefixes of "
+		<< options.prefixBytes << " bytes to " << corpus << " from " << stats.lines << " lines";
+	if (stats.skipped > 0) std::cout << " (" << stats.skipped << " below the minimum count)";
+	if (stats.runs > 1) std::cout << ", merged from " << stats.runs << " sorted runs";
+	std::cout << " in " << secs << " s" << std::endl;
+	return 0;
+}
+
+// list entries whose password appears in a local breach corpus; the corpus
+// is memory-mapped and probed, never read whole. Exits 2 when any is found.
+static int cmd_audit_breach(const std::string& path, const std::string& corpusArg) {
+	std::string corpusPath = corpusArg;
+	if (corpusPath.empty()) {
+		if (const char* env = std::getenv("PM_BREACH_CORPUS")) corpusPath = env;
+	}
+	if (corpusPath.empty()) { std::cerr << "Usage: pm audit-breach <vault.json> <corpus> (or set PM_BREACH_CORPUS)" << std::endl; return 1; }
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	Breach::Corpus corpus;
+	std::string err;
+	if (!corpus.open(corpusPath, err)) { std::cerr << err << std::endl; return 1; }
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<size_t> hits;
+	if (const VaultStatus st = Breach::check(v, corpus, hits); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const auto& entries = v.list();
+	for (size_t i : hits) {
+		std::cout << entries[i].site << " | " << entries[i].username << " | found in breach corpus" << std::endl;
+	}
+	std::cout << "Checked " << entries.size() << " entries against " << corpus.size() << " breached "
+		<< (corpus.kind() == Breach::Kind::Sha1 ? "SHA-1" : "NTLM") << " hashes in " << secs << " s: "
+		<< hits.size() << " breached." << std::endl;
+	return hits.empty() ? 0 : 2;
+}
+
+// keep the vault unlocked and answer get / find / add / del over a socket
+// (protocol in src/Server.h) until stopped
+static int cmd_serve(const std::string& path, const std::string& socket, const std::string& workers, const std::string& batchMs) {
+	if (!std::filesystem::exists(path)) {
+		std::cerr << "No vault exists at " << path << ". Try initializing first." << std::endl;
+		return 1;
+	}
+
+	Vault v(path);
+	if (const VaultStatus st = unlockVault(v); st != VaultStatus::Ok) { std::cerr << describe(st) << std::endl; return 1; }
+
+	Server::Options options;
+	options.socketPath = socket;
+	if (!workers.empty()) options.workers = static_cast<unsigned>(std::strtoul(workers.c_str(), nullptr, 10));
+	if (!batchMs.empty()) options.batchMs = static_cast<unsigned>(std::strtoul(batchMs.c_str(), nullptr, 10));
+	return Server::run(v, options);
+}
+
 static int menu() {
 	for (;;) {
 		std::cout << "=== PASSWORD VAULT ===" << std::endl
@@ -254,6 +945,7 @@ static int menu() {
 			<< "3) List Entries" << std::endl
 			<< "4) Delete Entry" << std::endl
 			<< "5) Find        " << std::endl
+			<< "6) Audit Passwords" << std::endl
 			<< "Q) Quit Application" << std::endl
 			<< "Choice: ";
 
@@ -269,7 +961,7 @@ static int menu() {
 		std::string path = promptPathWithDefault("Vault path (default: vault.json): ", "vault.json");
 
 		if (choice == "1") {
-			cmd_init(path);
+			cmd_init(path, "", "");
 		}
 		else if (choice == "2") {
 			cmd_add(path);
@@ -283,6 +975,9 @@ static int menu() {
 		else if (choice == "5") {
 			cmd_find(path);
 		}
+		else if (choice == "6") {
+			cmd_audit(path, "", "");
+		}
 		else {
 			std::cerr << "Unknown Choice" << std::endl;
 		}
@@ -290,20 +985,110 @@ static int menu() {
 	}
 }
 
-int main(int argc, char** argv) {
+// where --stats sends its report
+struct StatsOptions {
+	bool on = false;
+	bool json = false;
+	std::string file; // json only; stderr when empty
+};
+
+// take --stats[=json[:file]] out of the arguments, wherever it is
+static bool takeStatsFlag(std::vector<char*>& args, StatsOptions& out) {
+	for (auto it = args.begin() + 1; it != args.end();) {
+		const std::string a = *it;
+		if (a.rfind("--stats", 0) != 0) { ++it; continue; }
+
+		out.on = true;
+		if (a == "--stats" || a == "--stats=text") out.json = false;
+		else if (a == "--stats=json") out.json = true;
+		else if (a.rfind("--stats=json:", 0) == 0 && a.size() > 13) { out.json = true; out.file = a.substr(13); }
+		else return false;
+		it = args.erase(it);
+	}
+	return true;
+}
+
+static void reportStats(const StatsOptions& opt, const std::string& command) {
+	if (!Stats::kCompiled) {
+		std::cerr << "--stats: built without instrumentation (PM_ENABLE_STATS=OFF)." << std::endl;
+		return;
+	}
+	if (!opt.json) { Stats::printReport(std::cerr, command); return; }
+
+	const std::string line = Stats::reportJson(command);
+	if (opt.file.empty()) { std::cerr << line << std::endl; return; }
+	std::ofstream out(opt.file, std::ios::app);
+	if (!(out << line << '\n')) std::cerr << "Could not write stats to " << opt.file << std::endl;
+}
+
+static int dispatch(int argc, char** argv) {
 	if (argc >= 2) {
 		std::string cmd = argv[1];
+
+		// agent commands take no vault path
+		if (cmd == "agent") {
+			if (argc >= 3 && std::string(argv[2]) == "stop") {
+				if (!Agent::stop()) { std::cerr << "No agent is running." << std::endl; return 1; }
+				std::cout << "Agent stopped, keys wiped." << std::endl;
+				return 0;
+			}
+			return Agent::run(argc >= 3 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 900);
+		}
+		if (cmd == "lock") {
+			if (!Agent::lock()) { std::cerr << "No agent is running." << std::endl; return 1; }
+			std::cout << "Agent keys wiped." << std::endl;
+			return 0;
+		}
+		if (cmd == "breach-build") return cmd_breach_build(argc >= 3 ? argv[2] : "", argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "", argc >= 6 ? argv[5] : "");
+		if (cmd == "generate") return cmd_generate(argc >= 3 ? argv[2] : "", argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
 		std::string path = (argc >= 3) ? argv[2] : "vault.json";
 
-		if (cmd == "init") return cmd_init(path);
+		if (cmd == "calibrate") return cmd_calibrate(argc >= 3 ? argv[2] : "", argc >= 4 ? argv[3] : "");
+		if (cmd == "init") return cmd_init(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
 		if (cmd == "add") return cmd_add(path);
 		if (cmd == "list") return cmd_list(path);
 		if (cmd == "del") return cmd_del(path);
 		if (cmd == "find") return cmd_find(path);
+		if (cmd == "get") return cmd_get(path, argc >= 4 ? argv[3] : "");
+		if (cmd == "audit-breach") return cmd_audit_breach(path, argc >= 4 ? argv[3] : "");
+		if (cmd == "audit") return cmd_audit(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
+		if (cmd == "shard") return cmd_shard(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
+		if (cmd == "upgrade") return cmd_upgrade(path);
+		if (cmd == "compress") return cmd_compress(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
+		if (cmd == "rekdf") return cmd_rekdf(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
+		if (cmd == "passwd") return cmd_passwd(path);
+		if (cmd == "recovery") return cmd_recovery(path);
+		if (cmd == "import") return cmd_import(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "");
+		if (cmd == "export") {
+			// --force (overwrite the output file) may come anywhere after the vault
+			std::vector<std::string> rest;
+			bool force = false;
+			for (int i = 3; i < argc; ++i) {
+				if (std::string(argv[i]) == "--force") force = true;
+				else rest.push_back(argv[i]);
+			}
+			return cmd_export(path, rest.size() >= 1 ? rest[0] : "", rest.size() >= 2 ? rest[1] : "", force);
+		}
+		if (cmd == "serve") return cmd_serve(path, argc >= 4 ? argv[3] : "", argc >= 5 ? argv[4] : "", argc >= 6 ? argv[5] : "");
 
 		printUsage(argv[0]);
 		return 1;
 	}
 	return menu();
 
+}
+
+int main(int argc, char** argv) {
+	std::vector<char*> args(argv, argv + argc);
+	StatsOptions stats;
+	if (!takeStatsFlag(args, stats)) { printUsage(argv[0]); return 1; }
+	Stats::enable(stats.on);
+
+	int rc = 0;
+	{
+		PM_TIME(Command);
+		rc = dispatch(static_cast<int>(args.size()), args.data());
+	}
+	if (stats.on) reportStats(stats, args.size() >= 2 ? args[1] : "menu");
+	return rc;
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "Agent.h"
+#include "LocalSocket.h"
+#include <sodium.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// Securely wipe a string's contents from memory.
+	void wipeString(std::string& s) {
+		if (!s.empty()) {
+			Crypto::secureZero(s.data(), s.size());
+			s.clear();
+		}
+	}
+
+#if !defined(_WIN32)
+	const size_t kMaxLine = 4096;
+
+	// one request / response round trip with the agent; the line may hold a
+	// key, so its newline-terminated copy is wiped too
+	bool request(const std::string& line, std::string& reply) {
+		const int fd = LocalSocket::connectTo(Agent::socketPath());
+		if (fd < 0) return false;
+
+		std::string out;
+		out.reserve(line.size() + 1);
+		out.append(line).push_back('\n');
+		bool ok = LocalSocket::writeAll(fd, out) && LocalSocket::readLine(fd, reply, kMaxLine);
+		wipeString(out);
+		::close(fd);
+		return ok;
+	}
+
+	// key held by the agent, in guarded / locked memory from sodium_malloc
+	struct Slot {
+		unsigned char* key = nullptr;
+		size_t len = 0;
+		std::chrono::steady_clock::time_point lastUsed;
+	};
+
+	void freeSlot(Slot& s) {
+		if (s.key) sodium_free(s.key); // sodium_free zeroes before releasing
+		s.key = nullptr;
+		s.len = 0;
+	}
+#endif
+
+}
+
+namespace Agent {
+
+	std::string socketPath() {
+		if (const char* p = std::getenv("PM_AGENT_SOCK")) return p;
+#if defined(_WIN32)
+		return {};
+#else
+		return LocalSocket::runtimePath("pm-agent.sock");
+#endif
+	}
+
+	std::string keyId(const Crypto::KdfParams& kdf) {
+		return Crypto::b64encode(kdf.salt) + ":" + std::to_string(kdf.opslimit) + ":" + std::to_string(kdf.memlimit);
+	}
+
+#if defined(_WIN32)
+	bool getKey(const std::string&, std::vector<unsigned char>&) { return false; }
+	bool putKey(const std::string&, const std::vector<unsigned char>&) { return false; }
+	bool lock() { return false; }
+	bool stop() { return false; }
+
+	int run(unsigned) {
+		std::cerr << "The unlock agent is not supported on this platform." << std::endl;
+		return 1;
+	}
+#else
+	bool getKey(const std::string& id, std::vector<unsigned char>& outKey) {
+		std::string reply;
+		if (!request("GET " + id, reply)) return false;
+
+		bool ok = reply.rfind("OK ", 0) == 0;
+		if (ok) {
+			std::string b64(reply, 3);
+			outKey = Crypto::b64decode(b64);
+			wipeString(b64);
+			ok = !outKey.empty();
+		}
+		wipeString(reply);
+		return ok;
+	}
+
+	bool putKey(const std::string& id, const std::vector<unsigned char>& key) {
+		std::string b64 = Crypto::b64encode(key);
+		std::string line;
+		line.reserve(5 + id.size() + b64.size());
+		line.append("PUT ").append(id).append(" ").append(b64);
+		wipeString(b64);
+		std::string reply;
+		bool ok = request(line, reply) && reply == "OK";
+		wipeString(line);
+		return ok;
+	}
+
+	bool lock() {
+		std::string reply;
+		return request("LOCK", reply) && reply == "OK";
+	}
+
+	bool stop() {
+		std::string reply;
+		return request("STOP", reply) && reply == "OK";
+	}
+
+	int run(unsigned idleSeconds) {
+		const std::string path = socketPath();
+		if (path.empty()) {
+			std::cerr << "No private directory for the agent socket (set XDG_RUNTIME_DIR or PM_AGENT_SOCK)." << std::endl;
+			return 1;
+		}
+		sockaddr_un addr;
+		if (!LocalSocket::makeAddr(path, addr)) {
+			std::cerr << "Agent socket path is too long: " << path << std::endl;
+			return 1;
+		}
+
+		// refuse to start twice, clear a stale socket otherwise
+		std::string probe;
+		if (request("PING", probe)) {
+			std::cerr << "An agent is already running at " << path << std::endl;
+			return 1;
+		}
+		::unlink(path.c_str());
+
+		const int lfd = LocalSocket::listenOn(path, 16);
+		if (lfd < 0) {
+			std::cerr << "Could not listen on " << path << std::endl;
+			return 1;
+		}
+
+		std::cout << "Agent listening on " << path << " (idle timeout " << idleSeconds << "s)" << std::endl;
+
+		std::map<std::string, Slot> slots;
+		const auto idle = std::chrono::seconds(idleSeconds);
+		bool running = true;
+
+		while (running) {
+			// expire idle keys
+			const auto now = std::chrono::steady_clock::now();
+			for (auto it = slots.begin(); it != slots.end();) {
+				if (now - it->second.lastUsed >= idle) { freeSlot(it->second); it = slots.erase(it); }
+				else ++it;
+			}
+
+			pollfd pfd{ lfd, POLLIN, 0 };
+			int r = ::poll(&pfd, 1, 1000);
+			if (r < 0 && errno != EINTR) break;
+			if (r <= 0) continue;
+
+			int cfd = ::accept(lfd, nullptr, nullptr);
+			if (cfd < 0) continue;
+			if (!LocalSocket::peerIsOwner(cfd)) { ::close(cfd); continue; }
+
+			// don't let a stuck client block the agent
+			timeval tv{ 2, 0 };
+			setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+			std::string line;
+			std::string reply = "ERR";
+			if (LocalSocket::readLine(cfd, line, kMaxLine)) {
+				if (line == "PING") reply = "OK";
+				else if (line == "LOCK" || line == "STOP") {
+					for (auto& kv : slots) freeSlot(kv.second);
+					slots.clear();
+					reply = "OK";
+					running = line != "STOP";
+				}
+				else if (line.rfind("GET ", 0) == 0) {
+					auto it = slots.find(line.substr(4));
+					if (it != slots.end()) {
+						it->second.lastUsed = std::chrono::steady_clock::now();
+						std::vector<unsigned char> key(it->second.key, it->second.key + it->second.len);
+						std::string b64 = Crypto::b64encode(key);
+						Crypto::secureZero(key.data(), key.size());
+						// room for the newline too, so reply never reallocates
+						reply.reserve(4 + b64.size());
+						reply.assign("OK ").append(b64);
+						wipeString(b64);
+					}
+				}
+				else if (line.rfind("PUT ", 0) == 0) {
+					const size_t sp = line.find(' ', 4);
+					if (sp != std::string::npos) {
+						std::string b64(line, sp + 1);
+						auto key = Crypto::b64decode(b64);
+						wipeString(b64);
+						Slot slot;
+						slot.key = key.empty() ? nullptr : static_cast<unsigned char*>(sodium_malloc(key.size()));
+						if (slot.key) {
+							std::memcpy(slot.key, key.data(), key.size());
+							slot.len = key.size();
+							slot.lastUsed = std::chrono::steady_clock::now();
+
+							Slot& cur = slots[line.substr(4, sp - 4)];
+							freeSlot(cur);
+							cur = slot;
+							reply = "OK";
+						}
+						if (!key.empty()) Crypto::secureZero(key.data(), key.size());
+					}
+				}
+			}
+			reply.push_back('\n');
+			LocalSocket::writeAll(cfd, reply);
+			wipeString(line);
+			wipeString(reply);
+			::close(cfd);
+		}
+
+		for (auto& kv : slots) freeSlot(kv.second);
+		::close(lfd);
+		::unlink(path.c_str());
+		return 0;
+	}
+#endif
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "../include/crypto.h"
+
+// Unlock agent: a small local process that keeps derived vault keys in locked
+// memory so CLI commands can skip Argon2id while a session is unlocked.
+// Talks over a Unix domain socket readable only by the owning user; the
+// client hangs up on a listener running as anyone else.
+namespace Agent {
+
+	// socket location: $PM_AGENT_SOCK, else $XDG_RUNTIME_DIR/pm-agent.sock,
+	// else /tmp/pm-<uid>/pm-agent.sock (private directory, see
+	// LocalSocket::runtimePath); empty if that directory isn't safe
+	std::string socketPath();
+
+	// cache identifier for a vault key (salt + argon2 limits)
+	std::string keyId(const Crypto::KdfParams& kdf);
+
+	// client side; all return false when no agent is reachable
+	bool getKey(const std::string& id, std::vector<unsigned char>& outKey);
+	bool putKey(const std::string& id, const std::vector<unsigned char>& key);
+	bool lock();
+	bool stop();
+
+	// run the agent in the foreground until stopped; keys unused for
+	// idleSeconds are wiped
+	int run(unsigned idleSeconds);
+
+}
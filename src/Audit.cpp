@@ -0,0 +1,176 @@
+#include "Audit.h"
+#include "ThreadPool.h"
+#include <sodium.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+	// below this many entries one thread scans them all
+	const size_t kParallelMin = 2048;
+	const size_t kSegmentMin = 512;
+
+	const size_t kHashBytes = 16;
+
+	// per-entry result of the parallel pass
+	struct Scan {
+		std::array<unsigned char, kHashBytes> hash;
+		unsigned issues;
+		double bits;
+	};
+
+	// character class bit of each byte (non-ASCII counts as a symbol)
+	struct ClassTable {
+		unsigned char bit[256];
+		ClassTable() {
+			for (int c = 0; c < 256; ++c) {
+				if (c >= 'a' && c <= 'z') bit[c] = 1;
+				else if (c >= 'A' && c <= 'Z') bit[c] = 2;
+				else if (c >= '0' && c <= '9') bit[c] = 4;
+				else bit[c] = 8;
+			}
+		}
+	};
+	const ClassTable kClasses;
+
+	unsigned popcount(unsigned v) {
+		unsigned n = 0;
+		for (; v; v &= v - 1) ++n;
+		return n;
+	}
+
+}
+
+namespace Audit {
+
+	unsigned classesOf(std::string_view password) {
+		unsigned seen = 0;
+		for (unsigned char c : password) seen |= kClasses.bit[c];
+		return seen;
+	}
+
+	double estimateBits(std::string_view password) {
+		if (password.empty()) return 0;
+		const unsigned seen = classesOf(password);
+		double pool = 0;
+		if (seen & 1) pool += 26;
+		if (seen & 2) pool += 26;
+		if (seen & 4) pool += 10;
+		if (seen & 8) pool += 33;
+		const double perChar = std::log2(pool);
+
+		double bits = perChar; // the first character
+		for (size_t i = 1; i < password.size(); ++i) {
+			const int step = static_cast<unsigned char>(password[i]) - static_cast<unsigned char>(password[i - 1]);
+			const bool run = step == 0 || step == 1 || step == -1;
+			bits += run ? 1.0 : perChar;
+		}
+		return bits;
+	}
+
+	VaultStatus run(const Vault& vault, const Policy& policy, Report& out) {
+		out = Report{};
+		const auto& entries = vault.list();
+		std::vector<Scan> scans(entries.size());
+
+		// random per run: the hashes only compare passwords within this scan
+		unsigned char key[crypto_generichash_KEYBYTES];
+		randombytes_buf(key, sizeof(key));
+
+		const size_t segCount = ThreadPool::shared().segmentsFor(entries.size(), kParallelMin, kSegmentMin);
+		std::vector<VaultStatus> failed(segCount, VaultStatus::Ok);
+		ThreadPool::shared().run(segCount, [&](size_t s) {
+			const size_t first = entries.size() * s / segCount;
+			const size_t last = entries.size() * (s + 1) / segCount;
+			Secret password; // one locked buffer per segment, refilled
+			for (size_t i = first; i < last; ++i) {
+				if (const VaultStatus st = vault.reveal(entries[i], password); st != VaultStatus::Ok) { failed[s] = st; return; }
+				const std::string_view pw = password.view();
+				Scan& r = scans[i];
+				crypto_generichash(r.hash.data(), r.hash.size(), reinterpret_cast<const unsigned char*>(pw.data()), pw.size(), key, sizeof(key));
+				r.bits = estimateBits(pw);
+				r.issues = 0;
+				if (pw.empty()) r.issues |= Empty;
+				else {
+					if (pw.size() < policy.minLength) r.issues |= Short;
+					if (popcount(classesOf(pw)) < policy.minClasses) r.issues |= FewClasses;
+					if (r.bits < policy.minBits) r.issues |= LowEntropy;
+				}
+			}
+		});
+		sodium_memzero(key, sizeof(key));
+		for (VaultStatus st : failed) {
+			if (st != VaultStatus::Ok) return st;
+		}
+
+		// equal hashes end up next to each other; each run of them is one
+		// password shared by several entries
+		std::vector<size_t> order(entries.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			const int c = std::memcmp(scans[a].hash.data(), scans[b].hash.data(), kHashBytes);
+			return c != 0 ? c < 0 : a < b;
+		});
+
+		std::vector<size_t> group(entries.size(), 0);
+		std::vector<size_t> groupSize(entries.size(), 0);
+		for (size_t lo = 0; lo < order.size();) {
+			size_t hi = lo + 1;
+			while (hi < order.size() && scans[order[hi]].hash == scans[order[lo]].hash) ++hi;
+			if (hi - lo > 1 && !(scans[order[lo]].issues & Empty)) {
+				// exact repeats of an earlier entry are duplicates; the
+				// password is reused if it also guards another site / user
+				std::vector<std::pair<std::pair<std::string, std::string_view>, size_t>> owners;
+				for (size_t k = lo; k < hi; ++k) {
+					const Entry& e = entries[order[k]];
+					owners.push_back({ { SiteIndex::fold(e.site), e.username }, order[k] });
+				}
+				std::sort(owners.begin(), owners.end());
+				size_t distinct = 1;
+				for (size_t k = 1; k < owners.size(); ++k) {
+					if (owners[k].first == owners[k - 1].first) {
+						scans[owners[k].second].issues |= Duplicate;
+						++out.duplicates;
+					}
+					else ++distinct;
+				}
+				if (distinct > 1) {
+					++out.reuseGroups;
+					for (size_t k = lo; k < hi; ++k) {
+						scans[order[k]].issues |= Reused;
+						group[order[k]] = out.reuseGroups;
+						groupSize[order[k]] = hi - lo;
+					}
+					out.reused += hi - lo;
+				}
+			}
+			lo = hi;
+		}
+
+		out.scanned = entries.size();
+		for (size_t i = 0; i < entries.size(); ++i) {
+			const unsigned issues = scans[i].issues;
+			if (issues == 0) continue;
+			if (issues & (Empty | Short | FewClasses | LowEntropy)) ++out.weak;
+			out.findings.push_back({ i, issues, scans[i].bits, group[i], groupSize[i] });
+		}
+		return VaultStatus::Ok;
+	}
+
+	std::string issueNames(unsigned issues) {
+		static const std::pair<Issue, const char*> kNames[] = {
+			{ Empty, "empty" }, { Short, "short" }, { FewClasses, "few classes" },
+			{ LowEntropy, "low entropy" }, { Reused, "reused" }, { Duplicate, "duplicate" },
+		};
+		std::string out;
+		for (const auto& [bit, name] : kNames) {
+			if (!(issues & bit)) continue;
+			if (!out.empty()) out += ", ";
+			out += name;
+		}
+		return out;
+	}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Vault.h"
+
+// Password health of a whole vault: weak passwords (too short, too few
+// character classes, low estimated entropy) and passwords used more than
+// once. Every password is revealed once, on the shared thread pool, and only
+// a keyed hash of it is kept for the reuse check; the hash key is random per
+// run, so the report holds nothing that can be matched against a password
+// list.
+namespace Audit {
+
+	struct Policy {
+		size_t minLength = 12;
+		unsigned minClasses = 3; // of lower, upper, digits, symbols
+		double minBits = 60; // estimateBits() below this is weak
+	};
+
+	// bits of Finding::issues
+	enum Issue : unsigned {
+		Empty = 1,      // no password stored
+		Short = 2,      // fewer than minLength characters
+		FewClasses = 4, // fewer than minClasses character classes
+		LowEntropy = 8, // estimated entropy under minBits
+		Reused = 16,    // same password as an entry for another site / user
+		Duplicate = 32, // same site, username and password as another entry
+	};
+
+	struct Finding {
+		size_t entry; // position in vault.list()
+		unsigned issues;
+		double bits; // estimateBits of the password
+		size_t group; // reuse group (0 = none), shared by every entry of it
+		size_t groupSize;
+	};
+
+	struct Report {
+		size_t scanned = 0;
+		size_t weak = 0; // entries with any of Empty .. LowEntropy
+		size_t reuseGroups = 0; // passwords used by more than one site / user
+		size_t reused = 0; // entries in those groups
+		size_t duplicates = 0; // entries repeating an earlier one exactly
+		std::vector<Finding> findings; // only entries with issues, in list() order
+	};
+
+	// Rough strength of one password: length times log2 of the character
+	// pool its classes span, where a character repeating the previous one or
+	// continuing a run (abc, 321) adds a single bit.
+	double estimateBits(std::string_view password);
+
+	// bit per class present: 1 lower, 2 upper, 4 digits, 8 symbols / other
+	unsigned classesOf(std::string_view password);
+
+	// scan every entry of an unlocked vault
+	VaultStatus run(const Vault& vault, const Policy& policy, Report& out);
+
+	// short name of each issue bit set, comma separated
+	std::string issueNames(unsigned issues);
+
+}
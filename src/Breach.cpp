@@ -0,0 +1,471 @@
+#include "Breach.h"
+#include "ThreadPool.h"
+#include <sodium.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <queue>
+
+namespace {
+
+	const char kMagic[8] = { 'P', 'M', 'B', 'R', 'E', 'A', 'C', 'H' };
+	const std::uint32_t kVersion = 1;
+	const size_t kHeaderBytes = 24;
+
+	// below this many entries one thread checks them all
+	const size_t kParallelMin = 2048;
+	const size_t kSegmentMin = 512;
+
+	// interpolation probes before falling back to bisection
+	const int kMaxProbes = 8;
+
+	size_t hashBytes(Breach::Kind kind) {
+		return kind == Breach::Kind::Sha1 ? 20 : 16;
+	}
+
+	std::uint32_t rol(std::uint32_t x, int n) {
+		return (x << n) | (x >> (32 - n));
+	}
+
+	// Both digests pad the message the same way; only the length's byte order
+	// differs (SHA-1 big-endian, MD4 little-endian).
+	template <typename Block>
+	void digest(const unsigned char* data, size_t len, bool bigEndian, Block&& block) {
+		unsigned char buf[64];
+		size_t i = 0;
+		for (; i + 64 <= len; i += 64) block(data + i);
+
+		const size_t rest = len - i;
+		std::memcpy(buf, data + i, rest);
+		buf[rest] = 0x80;
+		std::memset(buf + rest + 1, 0, 64 - rest - 1);
+		if (rest >= 56) {
+			block(buf);
+			std::memset(buf, 0, 64);
+		}
+		const std::uint64_t bits = static_cast<std::uint64_t>(len) * 8;
+		for (int b = 0; b < 8; ++b) {
+			buf[bigEndian ? 63 - b : 56 + b] = static_cast<unsigned char>(bits >> (8 * b));
+		}
+		block(buf);
+		sodium_memzero(buf, sizeof(buf));
+	}
+
+	void sha1(const unsigned char* data, size_t len, unsigned char out[20]) {
+		std::uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+		digest(data, len, true, [&](const unsigned char* p) {
+			std::uint32_t w[80];
+			for (int t = 0; t < 16; ++t) {
+				w[t] = (std::uint32_t(p[4 * t]) << 24) | (std::uint32_t(p[4 * t + 1]) << 16) | (std::uint32_t(p[4 * t + 2]) << 8) | p[4 * t + 3];
+			}
+			for (int t = 16; t < 80; ++t) w[t] = rol(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+
+			std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+			for (int t = 0; t < 80; ++t) {
+				std::uint32_t f, k;
+				if (t < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+				else if (t < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+				else if (t < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+				else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+				const std::uint32_t tmp = rol(a, 5) + f + e + k + w[t];
+				e = d; d = c; c = rol(b, 30); b = a; a = tmp;
+			}
+			h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+			sodium_memzero(w, sizeof(w));
+		});
+		for (int i = 0; i < 5; ++i) {
+			for (int b = 0; b < 4; ++b) out[4 * i + b] = static_cast<unsigned char>(h[i] >> (24 - 8 * b));
+		}
+	}
+
+	void md4(const unsigned char* data, size_t len, unsigned char out[16]) {
+		std::uint32_t h[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+		digest(data, len, false, [&](const unsigned char* p) {
+			std::uint32_t x[16];
+			for (int t = 0; t < 16; ++t) {
+				x[t] = p[4 * t] | (std::uint32_t(p[4 * t + 1]) << 8) | (std::uint32_t(p[4 * t + 2]) << 16) | (std::uint32_t(p[4 * t + 3]) << 24);
+			}
+			std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+			auto F = [](std::uint32_t x, std::uint32_t y, std::uint32_t z) { return (x & y) | (~x & z); };
+			auto G = [](std::uint32_t x, std::uint32_t y, std::uint32_t z) { return (x & y) | (x & z) | (y & z); };
+			auto H = [](std::uint32_t x, std::uint32_t y, std::uint32_t z) { return x ^ y ^ z; };
+
+			static const int r1[4] = { 3, 7, 11, 19 };
+			for (int i = 0; i < 16; ++i) {
+				const std::uint32_t t = rol(a + F(b, c, d) + x[i], r1[i % 4]);
+				a = d; d = c; c = b; b = t;
+			}
+			static const int r2[4] = { 3, 5, 9, 13 };
+			for (int i = 0; i < 16; ++i) {
+				const int k = (i % 4) * 4 + i / 4;
+				const std::uint32_t t = rol(a + G(b, c, d) + x[k] + 0x5A827999, r2[i % 4]);
+				a = d; d = c; c = b; b = t;
+			}
+			static const int r3[4] = { 3, 9, 11, 15 };
+			static const int order3[16] = { 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15 };
+			for (int i = 0; i < 16; ++i) {
+				const std::uint32_t t = rol(a + H(b, c, d) + x[order3[i]] + 0x6ED9EBA1, r3[i % 4]);
+				a = d; d = c; c = b; b = t;
+			}
+			h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+			sodium_memzero(x, sizeof(x));
+		});
+		for (int i = 0; i < 4; ++i) {
+			for (int b = 0; b < 4; ++b) out[4 * i + b] = static_cast<unsigned char>(h[i] >> (8 * b));
+		}
+	}
+
+	// UTF-8 to UTF-16LE as Windows hashes it; a byte that isn't valid UTF-8
+	// is taken as the code point of the same value
+	void utf16le(std::string_view s, std::vector<unsigned char>& out) {
+		out.clear();
+		auto unit = [&](std::uint32_t u) {
+			out.push_back(static_cast<unsigned char>(u & 0xFF));
+			out.push_back(static_cast<unsigned char>(u >> 8));
+		};
+		for (size_t i = 0; i < s.size();) {
+			const unsigned char c = static_cast<unsigned char>(s[i]);
+			size_t n = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+			std::uint32_t cp = n == 1 ? c : n == 2 ? (c & 0x1F) : n == 3 ? (c & 0x0F) : (c & 0x07);
+			for (size_t k = 1; k < n; ++k) {
+				const unsigned char cc = i + k < s.size() ? static_cast<unsigned char>(s[i + k]) : 0;
+				if ((cc & 0xC0) != 0x80) { n = 0; break; }
+				cp = (cp << 6) | (cc & 0x3F);
+			}
+			if (n == 0) { unit(c); ++i; continue; }
+			i += n;
+			if (cp >= 0x10000) {
+				cp -= 0x10000;
+				unit(0xD800 + (cp >> 10));
+				unit(0xDC00 + (cp & 0x3FF));
+			}
+			else unit(cp);
+		}
+	}
+
+	int hexValue(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		return -1;
+	}
+
+	// first 8 bytes of a record as a big-endian number (zero padded)
+	std::uint64_t keyOf(const unsigned char* p, size_t prefix) {
+		std::uint64_t v = 0;
+		const size_t n = std::min<size_t>(prefix, 8);
+		for (size_t i = 0; i < n; ++i) v = (v << 8) | p[i];
+		return v << (8 * (8 - n));
+	}
+
+	// Fixed-size records buffered for one sorted run. The dumps come sorted
+	// by hash, so sorting is skipped while the input stays in order.
+	class RunBuffer {
+
+	public:
+
+		RunBuffer(size_t prefix, size_t budget) : prefix_(prefix), capacity_(std::max<size_t>(budget / prefix, 1024)) {
+			data_.reserve(capacity_ * prefix);
+		}
+
+		bool full() const { return data_.size() / prefix_ >= capacity_; }
+		bool empty() const { return data_.empty(); }
+
+		void add(const unsigned char* rec) {
+			if (sorted_ && !data_.empty() && std::memcmp(data_.data() + data_.size() - prefix_, rec, prefix_) > 0) sorted_ = false;
+			data_.insert(data_.end(), rec, rec + prefix_);
+		}
+
+		// sorted, de-duplicated records to out; the buffer is emptied
+		template <typename Out>
+		void drain(Out&& out) {
+			const size_t n = data_.size() / prefix_;
+			std::vector<std::uint32_t> order;
+			if (!sorted_) {
+				order.resize(n);
+				for (size_t i = 0; i < n; ++i) order[i] = static_cast<std::uint32_t>(i);
+				std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+					return std::memcmp(data_.data() + size_t(a) * prefix_, data_.data() + size_t(b) * prefix_, prefix_) < 0;
+				});
+			}
+			const unsigned char* last = nullptr;
+			for (size_t i = 0; i < n; ++i) {
+				const unsigned char* rec = data_.data() + (sorted_ ? i : order[i]) * prefix_;
+				if (last && std::memcmp(last, rec, prefix_) == 0) continue;
+				out(rec);
+				last = rec;
+			}
+			data_.clear();
+			sorted_ = true;
+		}
+
+	private:
+
+		size_t prefix_;
+		size_t capacity_; // records
+		std::vector<unsigned char> data_;
+		bool sorted_ = true;
+	};
+
+	// buffered sequential reader over one run file
+	class RunReader {
+
+	public:
+
+		RunReader(const std::string& path, size_t prefix) : in_(path, std::ios::binary), prefix_(prefix) {
+			buf_.resize(prefix * 65536);
+		}
+
+		// next record, or nullptr at the end
+		const unsigned char* next() {
+			if (pos_ == len_) {
+				in_.read(reinterpret_cast<char*>(buf_.data()), static_cast<std::streamsize>(buf_.size()));
+				len_ = static_cast<size_t>(in_.gcount()) / prefix_ * prefix_;
+				pos_ = 0;
+				if (len_ == 0) return nullptr;
+			}
+			const unsigned char* rec = buf_.data() + pos_;
+			pos_ += prefix_;
+			return rec;
+		}
+
+		bool failed() const { return in_.bad(); }
+
+	private:
+
+		std::ifstream in_;
+		size_t prefix_;
+		std::vector<unsigned char> buf_;
+		size_t len_ = 0;
+		size_t pos_ = 0;
+	};
+
+}
+
+namespace Breach {
+
+	void hashPassword(Kind kind, std::string_view password, std::vector<unsigned char>& out) {
+		out.resize(hashBytes(kind));
+		if (kind == Kind::Sha1) {
+			sha1(reinterpret_cast<const unsigned char*>(password.data()), password.size(), out.data());
+			return;
+		}
+		std::vector<unsigned char> wide;
+		utf16le(password, wide);
+		md4(wide.data(), wide.size(), out.data());
+		if (!wide.empty()) sodium_memzero(wide.data(), wide.size());
+	}
+
+	bool build(std::istream& in, const std::string& outPath, const BuildOptions& options, BuildStats& stats, std::string& err) {
+		namespace fs = std::filesystem;
+		stats = BuildStats{};
+		const size_t prefix = options.prefixBytes;
+		if (prefix < kMinPrefix || prefix > 20) { err = "Prefix must be between 4 and 20 bytes."; return false; }
+
+		RunBuffer buffer(prefix, options.memBudget);
+		std::vector<std::string> runs;
+		auto cleanup = [&]() {
+			std::error_code ec;
+			for (const auto& r : runs) fs::remove(r, ec);
+		};
+		auto spill = [&]() {
+			runs.push_back(outPath + ".run" + std::to_string(runs.size()));
+			std::ofstream run(runs.back(), std::ios::binary | std::ios::trunc);
+			buffer.drain([&](const unsigned char* rec) { run.write(reinterpret_cast<const char*>(rec), static_cast<std::streamsize>(prefix)); });
+			return static_cast<bool>(run.flush());
+		};
+
+		// parse "HEX[:count]" lines
+		size_t hexLen = 0;
+		std::string line;
+		unsigned char hash[20];
+		while (std::getline(in, line)) {
+			++stats.lines;
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.empty()) continue;
+			const size_t colon = line.find(':');
+			const size_t len = colon == std::string::npos ? line.size() : colon;
+
+			if (hexLen == 0) {
+				if (len != 40 && len != 32) { err = "Line 1: expected a 40 (SHA-1) or 32 (NTLM) digit hash."; cleanup(); return false; }
+				hexLen = len;
+				stats.kind = len == 40 ? Kind::Sha1 : Kind::Ntlm;
+				if (prefix > hashBytes(stats.kind)) { err = "Prefix is longer than the hash."; return false; }
+			}
+			bool ok = len == hexLen;
+			for (size_t i = 0; ok && i < hexLen / 2; ++i) {
+				const int hi = hexValue(line[2 * i]);
+				const int lo = hexValue(line[2 * i + 1]);
+				ok = hi >= 0 && lo >= 0;
+				hash[i] = static_cast<unsigned char>(hi << 4 | lo);
+			}
+			if (!ok) { err = "Line " + std::to_string(stats.lines) + ": malformed hash."; cleanup(); return false; }
+
+			if (options.minCount > 0) {
+				const std::uint64_t count = colon == std::string::npos ? 0 : std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+				if (count < options.minCount) { ++stats.skipped; continue; }
+			}
+			buffer.add(hash);
+			if (buffer.full() && !spill()) { err = "Could not write a sort run next to " + outPath; cleanup(); return false; }
+		}
+		if (in.bad()) { err = "Read error."; cleanup(); return false; }
+		if (hexLen == 0) { err = "The dump is empty."; return false; }
+
+		const std::string tmp = outPath + ".tmp";
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		if (!out) { err = "Could not create " + tmp; cleanup(); return false; }
+		out.write(kMagic, sizeof(kMagic));
+		std::string fields;
+		VaultFile::putU32(fields, kVersion);
+		fields.push_back(static_cast<char>(stats.kind));
+		fields.push_back(static_cast<char>(prefix));
+		fields.append(2, '\0');
+		VaultFile::putU64(fields, 0); // count, patched below
+		out.write(fields.data(), static_cast<std::streamsize>(fields.size()));
+
+		auto emit = [&](const unsigned char* rec) {
+			out.write(reinterpret_cast<const char*>(rec), static_cast<std::streamsize>(prefix));
+			++stats.records;
+		};
+		if (runs.empty()) {
+			stats.runs = 1;
+			buffer.drain(emit);
+		}
+		else {
+			// k-way merge of the sorted runs, dropping repeats across runs
+			if (!buffer.empty() && !spill()) { err = "Could not write a sort run next to " + outPath; cleanup(); return false; }
+			stats.runs = runs.size();
+			std::vector<std::unique_ptr<RunReader>> readers;
+			for (const auto& r : runs) readers.push_back(std::make_unique<RunReader>(r, prefix));
+
+			using Head = std::pair<const unsigned char*, size_t>;
+			auto later = [&](const Head& a, const Head& b) { return std::memcmp(a.first, b.first, prefix) > 0; };
+			std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+			for (size_t i = 0; i < readers.size(); ++i) {
+				if (const unsigned char* rec = readers[i]->next()) heads.push({ rec, i });
+			}
+			std::vector<unsigned char> last;
+			while (!heads.empty()) {
+				const Head h = heads.top();
+				heads.pop();
+				if (last.empty() || std::memcmp(last.data(), h.first, prefix) != 0) {
+					last.assign(h.first, h.first + prefix);
+					emit(h.first);
+				}
+				if (const unsigned char* rec = readers[h.second]->next()) heads.push({ rec, h.second });
+			}
+			for (const auto& r : readers) {
+				if (r->failed()) { err = "Could not read back a sort run."; cleanup(); return false; }
+			}
+			cleanup();
+		}
+
+		std::string count;
+		VaultFile::putU64(count, stats.records);
+		out.seekp(sizeof(kMagic) + 8);
+		out.write(count.data(), static_cast<std::streamsize>(count.size()));
+		out.close();
+		std::error_code ec;
+		if (!out || (fs::rename(tmp, outPath, ec), ec)) {
+			fs::remove(tmp, ec);
+			err = "Could not write " + outPath;
+			return false;
+		}
+		return true;
+	}
+
+	bool Corpus::open(const std::string& path, std::string& err) {
+		if (!file_.open(path, VaultFile::MappedFile::Access::Random)) { err = "Could not open " + path; return false; }
+		const unsigned char* p = file_.data();
+		if (file_.size() < kHeaderBytes || std::memcmp(p, kMagic, sizeof(kMagic)) != 0) { err = path + " is not a breach corpus."; return false; }
+		if (VaultFile::getU32(p + 8) != kVersion) { err = path + ": unsupported corpus version."; return false; }
+
+		kind_ = static_cast<Kind>(p[12]);
+		prefix_ = p[13];
+		count_ = VaultFile::getU64(p + 16);
+		if ((kind_ != Kind::Sha1 && kind_ != Kind::Ntlm) || prefix_ < kMinPrefix || prefix_ > hashBytes(kind_)) {
+			err = path + ": bad corpus header.";
+			return false;
+		}
+		if (count_ > (file_.size() - kHeaderBytes) / prefix_ || kHeaderBytes + count_ * prefix_ != file_.size()) {
+			err = path + " is truncated.";
+			return false;
+		}
+		records_ = p + kHeaderBytes;
+		return true;
+	}
+
+	bool Corpus::containsHash(const unsigned char* hash) const {
+		if (count_ == 0) return false;
+		const size_t P = prefix_;
+		auto at = [&](std::uint64_t i) { return records_ + i * P; };
+		const std::uint64_t target = keyOf(hash, P);
+
+		// Uniform keys: guess the position from the key's value. Each probe
+		// shrinks [lo, hi) around target; a few suffice for any corpus size.
+		std::uint64_t lo = 0;
+		std::uint64_t hi = count_;
+		for (int probe = 0; probe < kMaxProbes && hi - lo > 32; ++probe) {
+			const std::uint64_t kl = keyOf(at(lo), P);
+			const std::uint64_t kh = keyOf(at(hi - 1), P);
+			if (target < kl || target > kh) return false;
+			if (kh == kl) break;
+			const long double frac = static_cast<long double>(target - kl) / static_cast<long double>(kh - kl);
+			const std::uint64_t pos = lo + static_cast<std::uint64_t>(frac * static_cast<long double>(hi - 1 - lo));
+			const std::uint64_t k = keyOf(at(pos), P);
+			if (k < target) lo = pos + 1;
+			else if (k > target) hi = pos;
+			else if (P <= 8) return true;
+			else break;
+		}
+
+		// bisect what is left on the full prefix
+		while (lo < hi) {
+			const std::uint64_t mid = lo + (hi - lo) / 2;
+			const int c = std::memcmp(at(mid), hash, P);
+			if (c == 0) return true;
+			if (c < 0) lo = mid + 1;
+			else hi = mid;
+		}
+		return false;
+	}
+
+	bool Corpus::contains(std::string_view password) const {
+		std::vector<unsigned char> hash;
+		hashPassword(kind_, password, hash);
+		const bool found = containsHash(hash.data());
+		sodium_memzero(hash.data(), hash.size());
+		return found;
+	}
+
+	VaultStatus check(const Vault& vault, const Corpus& corpus, std::vector<size_t>& hits) {
+		hits.clear();
+		const auto& entries = vault.list();
+		const size_t segCount = ThreadPool::shared().segmentsFor(entries.size(), kParallelMin, kSegmentMin);
+		std::vector<std::vector<size_t>> found(segCount);
+		std::vector<VaultStatus> failed(segCount, VaultStatus::Ok);
+
+		ThreadPool::shared().run(segCount, [&](size_t s) {
+			const size_t first = entries.size() * s / segCount;
+			const size_t last = entries.size() * (s + 1) / segCount;
+			Secret password;
+			std::vector<unsigned char> hash;
+			for (size_t i = first; i < last; ++i) {
+				if (const VaultStatus st = vault.reveal(entries[i], password); st != VaultStatus::Ok) { failed[s] = st; break; }
+				if (password.empty()) continue;
+				hashPassword(corpus.kind(), password.view(), hash);
+				if (corpus.containsHash(hash.data())) found[s].push_back(i);
+			}
+			if (!hash.empty()) sodium_memzero(hash.data(), hash.size());
+		});
+
+		for (VaultStatus st : failed) {
+			if (st != VaultStatus::Ok) return st;
+		}
+		for (const auto& f : found) hits.insert(hits.end(), f.begin(), f.end());
+		return VaultStatus::Ok;
+	}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Vault.h"
+#include "VaultFile.h"
+
+// Offline check of passwords against a breach corpus (the Have I Been Pwned
+// downloadable lists) on hosts without network access.
+//
+// build() turns the raw text dump ("HASH:count" lines, SHA-1 or NTLM, hex)
+// into a compact corpus file:
+//   "PMBREACH" | version u32 | kind u8 | prefix bytes u8 | 2 reserved |
+//   count u64 | count sorted, unique hash prefixes of prefix bytes each
+// Hashes are uniformly distributed, so Corpus looks a prefix up by
+// interpolation search in a few probes of the memory-mapped file; nothing is
+// loaded into RAM and only the touched pages are read. An 8 byte prefix (the
+// default) halves a SHA-1 corpus and leaves a false match chance of about
+// count / 2^64 per password.
+namespace Breach {
+
+	enum class Kind : std::uint8_t { Sha1 = 1, Ntlm = 2 };
+
+	const size_t kMinPrefix = 4;
+	const size_t kDefaultPrefix = 8;
+
+	// full hash of a password in kind's form: SHA-1 of the UTF-8 bytes, or
+	// NTLM (MD4 of UTF-16LE). out is resized to 20 / 16 bytes.
+	void hashPassword(Kind kind, std::string_view password, std::vector<unsigned char>& out);
+
+	struct BuildOptions {
+		size_t prefixBytes = kDefaultPrefix; // kMinPrefix .. full hash size
+		std::uint64_t minCount = 0; // skip hashes seen fewer times than this
+		size_t memBudget = size_t(256) << 20; // sort buffer; larger inputs are merged from runs
+	};
+
+	struct BuildStats {
+		Kind kind = Kind::Sha1;
+		std::uint64_t lines = 0;
+		std::uint64_t records = 0; // written, after de-duplication
+		std::uint64_t skipped = 0; // below minCount
+		size_t runs = 0; // sorted runs merged (1 = the input fit the budget)
+	};
+
+	// Read a dump from in and write the corpus to outPath (temp file, then
+	// rename). The kind is taken from the hash length of the first line; the
+	// input needn't be sorted. False with a message on malformed input or an
+	// I/O error.
+	bool build(std::istream& in, const std::string& outPath, const BuildOptions& options, BuildStats& stats, std::string& err);
+
+	class Corpus {
+
+	public:
+
+		bool open(const std::string& path, std::string& err);
+
+		Kind kind() const { return kind_; }
+		size_t prefixBytes() const { return prefix_; }
+		std::uint64_t size() const { return count_; }
+
+		// is the corpus holding the first prefixBytes() of hash?
+		bool containsHash(const unsigned char* hash) const;
+		bool contains(std::string_view password) const;
+
+	private:
+
+		VaultFile::MappedFile file_;
+		const unsigned char* records_ = nullptr;
+		Kind kind_ = Kind::Sha1;
+		size_t prefix_ = 0;
+		std::uint64_t count_ = 0;
+	};
+
+	// positions in vault.list() of entries whose password is in the corpus;
+	// passwords are revealed and hashed on the shared thread pool
+	VaultStatus check(const Vault& vault, const Corpus& corpus, std::vector<size_t>& hits);
+
+}
@@ -0,0 +1,150 @@
+#include "Compressor.h"
+#define ZSTD_STATIC_LINKING_ONLY // custom allocators, by-reference dictionaries
+#include <zstd.h>
+#include <zdict.h>
+#include <sodium.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+	// largest plaintext a record decompresses to; anything claiming more is damaged
+	const unsigned long long kMaxRecord = 16 << 20;
+
+	// dictionary size: about a tenth of the samples, within zstd's usual range
+	const size_t kMinDictBytes = 4096;
+	const size_t kMaxDictBytes = 112640;
+
+	// records are short: size the tables for them, not for a default window
+	const size_t kRecordHint = 256;
+
+	// zstd allocations carry their size in front so they can be wiped on free
+	const size_t kAllocHeader = 16;
+
+	void* wipingAlloc(void*, size_t n) {
+		unsigned char* p = static_cast<unsigned char*>(std::malloc(n + kAllocHeader));
+		if (!p) return nullptr;
+		std::memcpy(p, &n, sizeof(n));
+		return p + kAllocHeader;
+	}
+
+	void wipingFree(void*, void* addr) {
+		if (!addr) return;
+		unsigned char* p = static_cast<unsigned char*>(addr) - kAllocHeader;
+		size_t n = 0;
+		std::memcpy(&n, p, sizeof(n));
+		sodium_memzero(addr, n);
+		std::free(p);
+	}
+
+	const ZSTD_customMem kWipingMem = { wipingAlloc, wipingFree, nullptr };
+
+	// the dictionary is implied by the file, the frame type by the record
+	const ZSTD_format_e kFormat = ZSTD_f_zstd1_magicless;
+
+}
+
+struct Compressor::State {
+	std::vector<unsigned char> dict;
+	ZSTD_CDict* cdict = nullptr;
+	ZSTD_DDict* ddict = nullptr;
+
+	~State() {
+		ZSTD_freeCDict(cdict);
+		ZSTD_freeDDict(ddict);
+		if (!dict.empty()) sodium_memzero(dict.data(), dict.size());
+	}
+};
+
+struct Compressor::Workspace::Contexts {
+	ZSTD_CCtx* c = ZSTD_createCCtx_advanced(kWipingMem);
+	ZSTD_DCtx* d = ZSTD_createDCtx_advanced(kWipingMem);
+
+	Contexts() {
+		if (c) {
+			ZSTD_CCtx_setParameter(c, ZSTD_c_format, kFormat);
+			ZSTD_CCtx_setParameter(c, ZSTD_c_dictIDFlag, 0);
+			ZSTD_CCtx_setParameter(c, ZSTD_c_checksumFlag, 0); // the record's MAC covers it
+		}
+		if (d) ZSTD_DCtx_setParameter(d, ZSTD_d_format, kFormat);
+	}
+
+	~Contexts() {
+		ZSTD_freeCCtx(c);
+		ZSTD_freeDCtx(d);
+	}
+};
+
+Compressor::Workspace::Workspace() : ctx_(std::make_unique<Contexts>()) {}
+Compressor::Workspace::~Workspace() = default;
+
+int Compressor::minLevel() { return 1; }
+int Compressor::maxLevel() { return ZSTD_maxCLevel(); }
+
+bool Compressor::train(const std::string& samples, const std::vector<size_t>& sizes, int level) {
+	clear();
+	if (sizes.size() < kMinSamples) return false;
+
+	std::vector<unsigned char> dict(std::clamp(samples.size() / 10, kMinDictBytes, kMaxDictBytes));
+	const size_t n = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sizes.data(), static_cast<unsigned>(sizes.size()));
+	const bool ok = !ZDICT_isError(n) && load(std::string_view(reinterpret_cast<const char*>(dict.data()), n), level);
+	sodium_memzero(dict.data(), dict.size());
+	return ok;
+}
+
+bool Compressor::load(std::string_view dictionary, int level) {
+	clear();
+	if (level < minLevel() || level > maxLevel() || dictionary.empty()) return false;
+
+	auto s = std::make_shared<State>();
+	s->dict.assign(dictionary.begin(), dictionary.end());
+	if (ZSTD_getDictID_fromDict(s->dict.data(), s->dict.size()) == 0) return false; // not a trained dictionary
+
+	// by reference: the tables point into s->dict, which is wiped with them
+	s->cdict = ZSTD_createCDict_advanced(s->dict.data(), s->dict.size(), ZSTD_dlm_byRef, ZSTD_dct_fullDict,
+		ZSTD_getCParams(level, kRecordHint, s->dict.size()), kWipingMem);
+	s->ddict = ZSTD_createDDict_advanced(s->dict.data(), s->dict.size(), ZSTD_dlm_byRef, ZSTD_dct_fullDict, kWipingMem);
+	if (!s->cdict || !s->ddict) return false;
+
+	state_ = std::move(s);
+	return true;
+}
+
+std::string_view Compressor::dictionary() const {
+	if (!state_) return {};
+	return std::string_view(reinterpret_cast<const char*>(state_->dict.data()), state_->dict.size());
+}
+
+bool Compressor::compress(Workspace& ws, std::string_view plain, std::string& out) const {
+	ZSTD_CCtx* c = ws.ctx_->c;
+	if (!state_ || !c) return false;
+	out.resize(ZSTD_compressBound(plain.size()));
+	size_t n = ZSTD_CCtx_refCDict(c, state_->cdict);
+	if (!ZSTD_isError(n)) n = ZSTD_compress2(c, out.data(), out.size(), plain.data(), plain.size());
+	if (ZSTD_isError(n) || n >= plain.size()) {
+		sodium_memzero(out.data(), out.size());
+		out.clear();
+		return false;
+	}
+	out.resize(n);
+	return true;
+}
+
+bool Compressor::decompress(Workspace& ws, std::string_view data, std::string& out) const {
+	ZSTD_DCtx* d = ws.ctx_->d;
+	if (!state_ || !d) return false;
+	ZSTD_frameHeader header;
+	if (ZSTD_getFrameHeader_advanced(&header, data.data(), data.size(), kFormat) != 0) return false;
+	if (header.frameType != ZSTD_frame || header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN || header.frameContentSize > kMaxRecord) return false;
+
+	out.resize(static_cast<size_t>(header.frameContentSize));
+	size_t n = ZSTD_DCtx_refDDict(d, state_->ddict);
+	if (!ZSTD_isError(n)) n = ZSTD_decompressDCtx(d, out.data(), out.size(), data.data(), data.size());
+	if (ZSTD_isError(n) || n != header.frameContentSize) {
+		sodium_memzero(out.data(), out.size());
+		out.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// zstd compression of record plaintext ahead of sealing. A record is a few
+// dozen bytes of JSON, too short to compress on its own, but the records of
+// one vault repeat each other: the field names, the same usernames and
+// domains. A rewrite trains a dictionary on a sample of the vault's records
+// and seals it in the file next to them; every put record written with it
+// until the next rewrite is compressed against it. Frames are written
+// without the magic number and dictionary ID, 8 of the ~25 bytes a record
+// compresses to; their first byte (the frame header descriptor) has the
+// reserved bit clear, so it is never the '{' a JSON record starts with.
+// Passwords are never compressed: their sealed length stays their length.
+class Compressor {
+
+public:
+
+	static const int kDefaultLevel = 3;
+	// fewer records than this are written uncompressed (no dictionary)
+	static const size_t kMinSamples = 256;
+	// a rewrite trains on at most this many records, spread over the vault
+	static const size_t kMaxSamples = 16384;
+
+	static int minLevel();
+	static int maxLevel();
+
+	// zstd contexts of one thread; every buffer they allocate is wiped on
+	// release, as they hold pieces of the records they worked on
+	class Workspace {
+
+	public:
+
+		Workspace();
+		~Workspace();
+		Workspace(const Workspace&) = delete;
+		Workspace& operator=(const Workspace&) = delete;
+
+	private:
+
+		friend class Compressor;
+		struct Contexts;
+		std::unique_ptr<Contexts> ctx_;
+	};
+
+	// a dictionary is loaded: compress() and decompress() work
+	bool ready() const { return state_ != nullptr; }
+	void clear() { state_.reset(); }
+
+	// Train on samples (record plaintexts back to back, sizes in order).
+	// False, and not ready, when they are too few or training fails.
+	bool train(const std::string& samples, const std::vector<size_t>& sizes, int level);
+
+	// use a dictionary read back from a vault file
+	bool load(std::string_view dictionary, int level);
+
+	// the dictionary bytes, to seal into the file
+	std::string_view dictionary() const;
+
+	// compressed plain in out; false if it wouldn't come out shorter (write
+	// plain as is) or nothing is loaded
+	bool compress(Workspace& ws, std::string_view plain, std::string& out) const;
+
+	// false if data is not a frame or is damaged (a frame of another
+	// dictionary decompresses to garbage; the caller's parse rejects it)
+	bool decompress(Workspace& ws, std::string_view data, std::string& out) const;
+
+private:
+
+	struct State;
+	std::shared_ptr<const State> state_; // shared by copies, read-only once built
+};
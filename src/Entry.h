@@ -0,0 +1,24 @@
+#pragma once
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+// represents saved credential entry. Fields are views: entries held by a
+// Vault point into its SecureArena, entries built by callers may point at
+// their own strings (Vault::addEntry copies them into the arena).
+// A Vault keeps each password sealed on its own (sealedPassword, password
+// empty) so listing never decrypts it; read it through Vault::reveal.
+// Records written before that load with the plain password.
+struct Entry {
+	std::string_view site{};
+	std::string_view username{};
+	std::string_view password{};
+	std::string_view sealedPassword{};
+};
+
+inline void to_json(nlohmann::json& j, const Entry& e) {
+	j = {
+		{"site", e.site},
+		{"username", e.username},
+		{"password", e.password}
+	};
+}
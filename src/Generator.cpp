@@ -0,0 +1,207 @@
+#include "Generator.h"
+#include "ThreadPool.h"
+#include <sodium.h>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+	const char kLower[] = "abcdefghijklmnopqrstuvwxyz";
+	const char kUpper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	const char kDigits[] = "0123456789";
+	const char kSymbols[] = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+	const char kAmbiguous[] = "0Oo1lI|`'\"";
+
+	// random bytes drawn per refill
+	const size_t kBlock = 4096;
+
+	// below this many passwords one thread does the whole batch
+	const size_t kParallelMin = 4096;
+	const size_t kSegmentMin = 1024;
+
+	// the classes of a policy, ambiguous characters already left out
+	std::vector<std::string> classesOf(const Generator::Policy& p) {
+		std::vector<std::string> out;
+		auto add = [&](bool on, const char* chars) {
+			if (!on) return;
+			std::string s;
+			for (const char* c = chars; *c; ++c) {
+				if (!p.avoidAmbiguous || !std::strchr(kAmbiguous, *c)) s.push_back(*c);
+			}
+			out.push_back(std::move(s));
+		};
+		add(p.lower, kLower);
+		add(p.upper, kUpper);
+		add(p.digits, kDigits);
+		add(p.symbols, kSymbols);
+		return out;
+	}
+
+	// byte -> character tables for one policy
+	struct Sampler {
+		char map[256] = {}; // accepted random byte -> character, 0 = rejected
+		unsigned char classBit[256] = {}; // character -> bit of its class
+		unsigned required = 0;
+	};
+
+	Sampler samplerFor(const Generator::Policy& p) {
+		Sampler s;
+		const auto classes = classesOf(p);
+		std::string alphabet;
+		for (size_t k = 0; k < classes.size(); ++k) {
+			alphabet += classes[k];
+			for (char c : classes[k]) s.classBit[static_cast<unsigned char>(c)] = static_cast<unsigned char>(1u << k);
+			if (p.requireEach) s.required |= 1u << k;
+		}
+		// bytes below the largest multiple of the alphabet size map evenly
+		const size_t n = alphabet.size();
+		const size_t accept = 256 - 256 % n;
+		for (size_t b = 0; b < accept; ++b) s.map[b] = alphabet[b % n];
+		return s;
+	}
+
+	// Random characters handed out in order. A refill maps a whole block of
+	// random bytes through the table and compacts the accepted ones without
+	// a branch per byte.
+	class CharStream {
+
+	public:
+
+		explicit CharStream(const Sampler& s) : s_(s) {}
+		~CharStream() {
+			sodium_memzero(raw_, sizeof(raw_));
+			sodium_memzero(chars_, sizeof(chars_));
+		}
+
+		char next() {
+			while (pos_ == avail_) refill();
+			return chars_[pos_++];
+		}
+
+	private:
+
+		void refill() {
+			randombytes_buf(raw_, kBlock);
+			size_t n = 0;
+			for (size_t i = 0; i < kBlock; ++i) {
+				const char c = s_.map[raw_[i]];
+				chars_[n] = c;
+				n += c != 0;
+			}
+			avail_ = n;
+			pos_ = 0;
+		}
+
+		const Sampler& s_;
+		unsigned char raw_[kBlock];
+		char chars_[kBlock];
+		size_t avail_ = 0;
+		size_t pos_ = 0;
+	};
+
+	// count passwords into arena / out, one CharStream
+	void fill(const Generator::Policy& p, const Sampler& s, size_t count, SecureArena& arena, std::string_view* out) {
+		CharStream stream(s);
+		char buf[Generator::kMaxLength];
+		arena.reserve(count * p.length);
+		for (size_t i = 0; i < count; ++i) {
+			unsigned seen = 0;
+			do {
+				seen = 0;
+				for (size_t j = 0; j < p.length; ++j) {
+					buf[j] = stream.next();
+					seen |= s.classBit[static_cast<unsigned char>(buf[j])];
+				}
+			} while ((seen & s.required) != s.required);
+			out[i] = arena.store(std::string_view(buf, p.length));
+		}
+		sodium_memzero(buf, sizeof(buf));
+	}
+
+}
+
+namespace Generator {
+
+	bool parseClasses(std::string_view letters, Policy& policy) {
+		Policy p;
+		p.length = policy.length;
+		p.lower = p.upper = p.digits = p.symbols = false;
+		for (char c : letters) {
+			switch (c) {
+			case 'l': p.lower = true; break;
+			case 'u': p.upper = true; break;
+			case 'd': p.digits = true; break;
+			case 's': p.symbols = true; break;
+			case 'a': p.avoidAmbiguous = true; break;
+			default: return false;
+			}
+		}
+		policy = p;
+		return true;
+	}
+
+	bool valid(const Policy& policy, std::string& err) {
+		if (policy.length < kMinLength || policy.length > kMaxLength) {
+			err = "Length must be between " + std::to_string(kMinLength) + " and " + std::to_string(kMaxLength) + ".";
+			return false;
+		}
+		const size_t classes = classesOf(policy).size();
+		if (classes == 0) { err = "No character classes selected."; return false; }
+		if (policy.requireEach && policy.length < classes) { err = "Too short to hold every selected class."; return false; }
+		return true;
+	}
+
+	std::string alphabet(const Policy& policy) {
+		std::string out;
+		for (const auto& c : classesOf(policy)) out += c;
+		return out;
+	}
+
+	double entropyBits(const Policy& policy) {
+		const auto classes = classesOf(policy);
+		double n = 0;
+		for (const auto& c : classes) n += static_cast<double>(c.size());
+		if (n == 0) return 0;
+		const double L = static_cast<double>(policy.length);
+		if (!policy.requireEach) return L * std::log2(n);
+
+		// share of all n^L strings that use every class: inclusion-exclusion
+		// over the sets of classes left out
+		double share = 0;
+		for (unsigned mask = 0; mask < (1u << classes.size()); ++mask) {
+			double missing = 0;
+			int bits = 0;
+			for (size_t k = 0; k < classes.size(); ++k) {
+				if (mask & (1u << k)) { missing += static_cast<double>(classes[k].size()); ++bits; }
+			}
+			const double term = std::pow((n - missing) / n, L);
+			share += (bits % 2 ? -term : term);
+		}
+		return L * std::log2(n) + std::log2(share);
+	}
+
+	bool generate(const Policy& policy, size_t count, SecureArena& arena, std::vector<std::string_view>& out) {
+		std::string err;
+		if (!valid(policy, err)) return false;
+		const Sampler s = samplerFor(policy);
+
+		const size_t first = out.size();
+		out.resize(first + count);
+		const size_t segCount = ThreadPool::shared().segmentsFor(count, kParallelMin, kSegmentMin);
+		if (segCount <= 1) {
+			fill(policy, s, count, arena, out.data() + first);
+			return true;
+		}
+
+		// private arenas per segment, merged in order afterwards
+		std::vector<SecureArena> arenas(segCount);
+		ThreadPool::shared().run(segCount, [&](size_t seg) {
+			const size_t lo = count * seg / segCount;
+			const size_t hi = count * (seg + 1) / segCount;
+			fill(policy, s, hi - lo, arenas[seg], out.data() + first + lo);
+		});
+		for (auto& a : arenas) arena.adopt(std::move(a));
+		return true;
+	}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "SecureArena.h"
+
+// Random passwords drawn from libsodium's CSPRNG. Each character is picked
+// uniformly from the policy's alphabet (random bytes past the largest
+// multiple of the alphabet size are rejected, never folded with %), and a
+// password missing a required class is redrawn whole, so every password the
+// policy allows is equally likely.
+namespace Generator {
+
+	struct Policy {
+		size_t length = 20;
+		bool lower = true;
+		bool upper = true;
+		bool digits = true;
+		bool symbols = true;
+		bool avoidAmbiguous = false; // leave out 0 O o 1 l I | ` ' "
+		bool requireEach = true; // at least one character of every class used
+	};
+
+	const size_t kMinLength = 4;
+	const size_t kMaxLength = 128;
+
+	// parse "luds" style class letters (l lower, u upper, d digits, s symbols,
+	// a avoid ambiguous) into policy, keeping its length
+	bool parseClasses(std::string_view letters, Policy& policy);
+
+	// false (with a reason) for a policy that can't produce passwords
+	bool valid(const Policy& policy, std::string& err);
+
+	// the characters policy draws from, in a fixed order
+	std::string alphabet(const Policy& policy);
+
+	// log2 of how many passwords policy allows (exact, the required classes
+	// counted by inclusion-exclusion)
+	double entropyBits(const Policy& policy);
+
+	// count passwords stored in arena, in parallel for large batches. False if
+	// the policy isn't valid.
+	bool generate(const Policy& policy, size_t count, SecureArena& arena, std::vector<std::string_view>& out);
+
+}
@@ -0,0 +1,78 @@
+// Global operator new / delete replacements counting heap allocations for
+// --stats (the counters ignore them until enabled). Linked into the
+// PasswordManager executable only, never into pmcore: a library must not
+// replace the allocator of the program it is linked into. Kept out of
+// main.cpp so no caller inlines a delete and sees free() meet new.
+#include "Stats.h"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(PM_STATS)
+
+namespace {
+
+	void* allocate(std::size_t n, std::size_t align, bool nothrow) {
+		PM_COUNT(HeapAllocs, 1);
+		PM_COUNT(HeapBytes, n);
+		if (n == 0) n = 1;
+		for (;;) {
+			void* p = nullptr;
+			if (align <= alignof(std::max_align_t)) p = std::malloc(n);
+#if defined(_WIN32)
+			else p = _aligned_malloc(n, align);
+#else
+			else p = std::aligned_alloc(align, (n + align - 1) / align * align);
+#endif
+			if (p) return p;
+
+			// as the default operator new: let the handler free memory, or give up
+			std::new_handler handler = std::get_new_handler();
+			if (!handler) {
+				if (nothrow) return nullptr;
+				throw std::bad_alloc();
+			}
+			if (!nothrow) handler();
+			else {
+				try { handler(); }
+				catch (...) { return nullptr; }
+			}
+		}
+	}
+
+	void release(void* p, std::size_t align) noexcept {
+#if defined(_WIN32)
+		if (align > alignof(std::max_align_t)) { _aligned_free(p); return; }
+#else
+		(void)align;
+#endif
+		std::free(p);
+	}
+
+	const std::size_t kPlain = alignof(std::max_align_t);
+
+}
+
+void* operator new(std::size_t n) { return allocate(n, kPlain, false); }
+void* operator new[](std::size_t n) { return allocate(n, kPlain, false); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return allocate(n, kPlain, true); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return allocate(n, kPlain, true); }
+void* operator new(std::size_t n, std::align_val_t a) { return allocate(n, static_cast<std::size_t>(a), false); }
+void* operator new[](std::size_t n, std::align_val_t a) { return allocate(n, static_cast<std::size_t>(a), false); }
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(n, static_cast<std::size_t>(a), true); }
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(n, static_cast<std::size_t>(a), true); }
+
+void operator delete(void* p) noexcept { release(p, kPlain); }
+void operator delete[](void* p) noexcept { release(p, kPlain); }
+void operator delete(void* p, std::size_t) noexcept { release(p, kPlain); }
+void operator delete[](void* p, std::size_t) noexcept { release(p, kPlain); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p, kPlain); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p, kPlain); }
+void operator delete(void* p, std::align_val_t a) noexcept { release(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { release(p, static_cast<std::size_t>(a)); }
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept { release(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept { release(p, static_cast<std::size_t>(a)); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { release(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { release(p, static_cast<std::size_t>(a)); }
+
+#endif
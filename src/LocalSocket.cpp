@@ -0,0 +1,115 @@
+#include "LocalSocket.h"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+
+	// a peer that hung up must not kill us with SIGPIPE
+#if defined(MSG_NOSIGNAL)
+	const int kSendFlags = MSG_NOSIGNAL;
+#else
+	const int kSendFlags = 0;
+#endif
+
+}
+
+namespace LocalSocket {
+
+	bool makeAddr(const std::string& path, sockaddr_un& addr) {
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+		std::memcpy(addr.sun_path, path.data(), path.size());
+		return true;
+	}
+
+	int listenOn(const std::string& path, int backlog) {
+		sockaddr_un addr;
+		if (!makeAddr(path, addr)) return -1;
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+
+		mode_t old = ::umask(077);
+		const bool bound = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+		::umask(old);
+		if (!bound || ::listen(fd, backlog) != 0) {
+			::close(fd);
+			return -1;
+		}
+		::chmod(path.c_str(), 0600);
+		return fd;
+	}
+
+	int connectTo(const std::string& path) {
+		sockaddr_un addr;
+		if (!makeAddr(path, addr)) return -1;
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+		if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || !peerIsOwner(fd)) {
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	std::string runtimePath(const std::string& name) {
+		if (const char* dir = std::getenv("XDG_RUNTIME_DIR"); dir && *dir) return std::string(dir) + "/" + name;
+
+		const std::string dir = "/tmp/pm-" + std::to_string(geteuid());
+		if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) return {};
+		// someone else may have made it first: lstat, so a symlink is refused too
+		struct stat st;
+		if (::lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0) return {};
+		return dir + "/" + name;
+	}
+
+	bool peerIsOwner(int fd) {
+#if defined(__linux__)
+		ucred cred{};
+		socklen_t len = sizeof(cred);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+		return cred.uid == geteuid();
+#else
+		uid_t uid = 0;
+		gid_t gid = 0;
+		if (getpeereid(fd, &uid, &gid) != 0) return false;
+		return uid == geteuid();
+#endif
+	}
+
+	bool readLine(int fd, std::string& out, size_t maxLen) {
+		out.clear();
+		out.reserve(maxLen); // no reallocation leaves a copy of a secret line behind
+		char c = 0;
+		while (out.size() < maxLen) {
+			ssize_t n = ::read(fd, &c, 1);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			if (c == '\n') return true;
+			out.push_back(c);
+		}
+		return false;
+	}
+
+	bool writeAll(int fd, const std::string& data) {
+		size_t off = 0;
+		while (off < data.size()) {
+			ssize_t n = ::send(fd, data.data() + off, data.size() - off, kSendFlags);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			off += static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+}
+#endif
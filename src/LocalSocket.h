@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+
+#if !defined(_WIN32)
+#include <sys/un.h>
+
+// Unix domain socket helpers shared by the unlock agent and the vault
+// server: owner-only sockets in a private directory, peer checks on both
+// ends and line-based I/O.
+namespace LocalSocket {
+
+	// fill a unix socket address, false if the path doesn't fit
+	bool makeAddr(const std::string& path, sockaddr_un& addr);
+
+	// bind and listen on path, readable and writable by our user only;
+	// -1 on failure
+	int listenOn(const std::string& path, int backlog);
+
+	// connected socket, -1 when nothing listens at path or the listener
+	// runs as another user (a squatter must not see what we send)
+	int connectTo(const std::string& path);
+
+	// name inside our private socket directory: $XDG_RUNTIME_DIR, else
+	// /tmp/pm-<uid>, created mode 0700 and refused unless it is a directory
+	// of ours nobody else can enter. Empty if there is no such directory.
+	std::string runtimePath(const std::string& name);
+
+	// only the user we run as may talk to us
+	bool peerIsOwner(int fd);
+
+	// blocking: a single '\n' terminated line (without the newline), at
+	// most maxLen bytes
+	bool readLine(int fd, std::string& out, size_t maxLen);
+	bool writeAll(int fd, const std::string& data);
+
+}
+#endif
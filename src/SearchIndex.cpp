@@ -0,0 +1,302 @@
+#include "SearchIndex.h"
+#include "SiteIndex.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PM_SEARCH_SSE2 1
+#endif
+
+namespace {
+
+	// longest query the bit-parallel matcher handles (one machine word)
+	const size_t kMaxFuzzyQuery = 64;
+
+	// verifying a candidate costs about this many posting list steps
+	const size_t kVerifyCost = 16;
+
+	// rank layout: edits | match kind | site length
+	enum MatchKind : std::uint32_t { SiteExact = 0, SitePrefix = 1, SiteContains = 2, UserMatch = 3 };
+
+	std::uint32_t makeRank(int edits, MatchKind kind, size_t siteLen) {
+		return (static_cast<std::uint32_t>(edits) << 24) | (static_cast<std::uint32_t>(kind) << 16) |
+			static_cast<std::uint32_t>(std::min<size_t>(siteLen, 0xFFFF));
+	}
+
+	std::uint32_t trigram(const char* p) {
+		return (static_cast<std::uint32_t>(static_cast<unsigned char>(p[0])) << 16) |
+			(static_cast<std::uint32_t>(static_cast<unsigned char>(p[1])) << 8) |
+			static_cast<std::uint32_t>(static_cast<unsigned char>(p[2]));
+	}
+
+	// typos allowed for a folded query of this length; every edit can break
+	// at most three of the query's trigrams, so longer queries keep enough
+	// intact trigrams to find their candidates through the index
+	int editsFor(size_t len) {
+		if (len >= 9) return 2;
+		if (len >= 6) return 1;
+		return 0;
+	}
+
+	// Calls onMatch(offset) for every occurrence of q (non-empty) in text, in
+	// order. Compares q's first and last byte against a whole block of
+	// positions at once (16 with SSE2, else 8 packed in a 64-bit word) and
+	// only memcmps the middle of positions where both agree.
+	template <class OnMatch>
+	void findAll(std::string_view text, std::string_view q, OnMatch&& onMatch) {
+		const size_t m = q.size();
+		const char* p = text.data();
+		const size_t n = text.size();
+		auto middleMatches = [&](size_t at) { return m <= 2 || std::memcmp(p + at + 1, q.data() + 1, m - 2) == 0; };
+
+		size_t i = 0;
+#if defined(PM_SEARCH_SSE2)
+		const __m128i first = _mm_set1_epi8(q[0]);
+		const __m128i last = _mm_set1_epi8(q[m - 1]);
+		for (; i + m - 1 + 16 <= n; i += 16) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + m - 1));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+			for (; mask != 0; mask &= mask - 1) {
+				const size_t at = i + static_cast<size_t>(std::countr_zero(mask));
+				if (middleMatches(at)) onMatch(at);
+			}
+		}
+#else
+		if constexpr (std::endian::native == std::endian::little) {
+			// 0x80 in every byte of v that is zero (exact: no borrow between bytes)
+			auto zeroBytes = [](std::uint64_t v) {
+				const std::uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+				return ~(((v & low7) + low7) | v | low7);
+			};
+			auto load = [](const char* at) { std::uint64_t v; std::memcpy(&v, at, sizeof(v)); return v; };
+			const std::uint64_t ones = 0x0101010101010101ull;
+			const std::uint64_t first = ones * static_cast<unsigned char>(q[0]);
+			const std::uint64_t last = ones * static_cast<unsigned char>(q[m - 1]);
+			for (; i + m - 1 + 8 <= n; i += 8) {
+				std::uint64_t mask = zeroBytes(load(p + i) ^ first) & zeroBytes(load(p + i + m - 1) ^ last);
+				for (; mask != 0; mask &= mask - 1) {
+					const size_t at = i + static_cast<size_t>(std::countr_zero(mask)) / 8;
+					if (middleMatches(at)) onMatch(at);
+				}
+			}
+		}
+#endif
+		for (; i + m <= n; ++i) {
+			if (p[i] == q[0] && p[i + m - 1] == q[m - 1] && middleMatches(i)) onMatch(i);
+		}
+	}
+
+	// Myers' bit-parallel matcher: fewest edits turning the pattern into any
+	// substring of text, one word operation per text byte. peq[c] has bit i
+	// set where pattern[i] == c; m = pattern length (1..64).
+	int bestDistance(const std::array<std::uint64_t, 256>& peq, size_t m, std::string_view text) {
+		const std::uint64_t high = std::uint64_t(1) << (m - 1);
+		std::uint64_t pv = ~std::uint64_t(0);
+		std::uint64_t mv = 0;
+		int score = static_cast<int>(m);
+		int best = score;
+		for (unsigned char c : text) {
+			const std::uint64_t eq = peq[c];
+			const std::uint64_t xv = eq | mv;
+			const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			std::uint64_t ph = mv | ~(xh | pv);
+			std::uint64_t mh = pv & xh;
+			if (ph & high) ++score;
+			else if (mh & high) --score;
+			// a match may start anywhere in text: no carry into the first row
+			ph <<= 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+			best = std::min(best, score);
+		}
+		return best;
+	}
+
+}
+
+void SearchIndex::clear() {
+	text_.clear();
+	docs_.clear();
+	postings_.clear();
+}
+
+void SearchIndex::build(const std::vector<Entry>& entries) {
+	clear();
+
+	size_t bytes = 0;
+	for (const auto& e : entries) bytes += e.site.size() + e.username.size();
+	text_.reserve(bytes);
+	docs_.reserve(entries.size());
+
+	for (const auto& e : entries) {
+		Doc d;
+		d.site = static_cast<std::uint32_t>(text_.size());
+		d.siteLen = static_cast<std::uint32_t>(e.site.size());
+		text_ += SiteIndex::fold(e.site);
+		d.user = static_cast<std::uint32_t>(text_.size());
+		d.userLen = static_cast<std::uint32_t>(e.username.size());
+		text_ += SiteIndex::fold(e.username);
+		docs_.push_back(d);
+	}
+
+	// ids arrive in ascending order, so each list stays sorted; skipping the
+	// id already at the back drops repeats within one entry
+	for (std::uint32_t id = 0; id < docs_.size(); ++id) {
+		for (std::string_view field : { siteOf(docs_[id]), userOf(docs_[id]) }) {
+			for (size_t i = 0; i + 3 <= field.size(); ++i) {
+				auto& list = postings_[trigram(field.data() + i)];
+				if (list.empty() || list.back() != id) list.push_back(id);
+			}
+		}
+	}
+}
+
+// Entries that still share enough trigrams with the query after `broken`
+// of them were destroyed by edits: at least n - broken of the n lists. The
+// union of the broken + 1 shortest lists must hold every such entry; when
+// that union is large compared to all lists together, counting hits per
+// entry over every list gives a much tighter set, and the counts bound each
+// entry's edits (every missing trigram costs a third of an edit). Results
+// are ordered by that bound, lowest first.
+std::vector<SearchIndex::Candidate> SearchIndex::fuzzyCandidates(const std::vector<const std::vector<std::uint32_t>*>& lists, size_t broken) const {
+	const size_t need = lists.size() > broken ? lists.size() - broken : 1;
+	const size_t take = lists.size() - need + 1;
+
+	size_t unionSize = 0;
+	size_t total = 0;
+	for (size_t i = 0; i < lists.size(); ++i) {
+		if (i < take) unionSize += lists[i]->size();
+		total += lists[i]->size();
+	}
+
+	std::vector<Candidate> out;
+	if (need == 1 || unionSize * kVerifyCost <= total) {
+		std::vector<std::uint32_t> ids;
+		for (size_t i = 0; i < take; ++i) ids.insert(ids.end(), lists[i]->begin(), lists[i]->end());
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		for (std::uint32_t id : ids) out.push_back({ id, 0 });
+		return out;
+	}
+
+	std::vector<std::uint8_t> seen(docs_.size(), 0);
+	std::vector<std::uint32_t> ids;
+	for (const auto* list : lists) {
+		for (std::uint32_t id : *list) {
+			if (++seen[id] == need) ids.push_back(id);
+		}
+	}
+	for (std::uint32_t id : ids) out.push_back({ id, static_cast<int>((lists.size() - seen[id] + 2) / 3) });
+	std::stable_sort(out.begin(), out.end(), [](const Candidate& a, const Candidate& b) { return a.minEdits < b.minEdits; });
+	return out;
+}
+
+// One pass of findAll over the whole folded text, walking the entry list
+// alongside the match offsets.
+void SearchIndex::scanExact(std::string_view q, std::vector<Hit>& hits) const {
+	size_t doc = 0;
+	size_t skipTo = 0; // rest of the current entry once it has its best hit
+	findAll(text_, q, [&](size_t at) {
+		if (at < skipTo) return;
+		while (docs_[doc].user + docs_[doc].userLen <= at) ++doc;
+		const Doc& d = docs_[doc];
+		const size_t end = at + q.size();
+		if (end > d.user + d.userLen) return; // runs into the next entry
+		if (at < d.user && end > d.user) return; // spans site and username
+
+		std::uint32_t rank = 0;
+		if (at < d.user) {
+			rank = makeRank(0, at != d.site ? SiteContains : d.siteLen == q.size() ? SiteExact : SitePrefix, d.siteLen);
+		}
+		else rank = makeRank(0, UserMatch, d.siteLen);
+		hits.push_back({ doc, rank });
+
+		// a site match beats any username match, and the first site match
+		// is the entry's best
+		skipTo = d.user + d.userLen;
+	});
+}
+
+bool SearchIndex::rankExact(const Doc& d, std::string_view q, std::uint32_t& rank) const {
+	const std::string_view site = siteOf(d);
+	const size_t at = site.find(q);
+	if (at != std::string_view::npos) {
+		rank = makeRank(0, at != 0 ? SiteContains : site.size() == q.size() ? SiteExact : SitePrefix, site.size());
+		return true;
+	}
+	if (userOf(d).find(q) == std::string_view::npos) return false;
+	rank = makeRank(0, UserMatch, site.size());
+	return true;
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(std::string_view query, size_t limit) const {
+	std::vector<Hit> hits;
+	const std::string q = SiteIndex::fold(query);
+	if (q.empty() || limit == 0) return hits;
+
+	std::uint32_t rank = 0;
+	if (q.size() < 3) scanExact(q, hits);
+	else {
+		std::vector<std::uint32_t> grams;
+		for (size_t i = 0; i + 3 <= q.size(); ++i) grams.push_back(trigram(q.data() + i));
+		std::sort(grams.begin(), grams.end());
+		grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+		static const std::vector<std::uint32_t> none;
+		std::vector<const std::vector<std::uint32_t>*> lists;
+		for (std::uint32_t g : grams) {
+			auto it = postings_.find(g);
+			lists.push_back(it == postings_.end() ? &none : &it->second);
+		}
+		std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+
+		// exact matches contain every trigram: all of them are in the shortest list
+		for (std::uint32_t id : *lists[0]) {
+			if (rankExact(docs_[id], q, rank)) hits.push_back({ id, rank });
+		}
+
+		// fuzzy matches rank below exact ones, so only look when there's room
+		const int edits = q.size() <= kMaxFuzzyQuery ? editsFor(q.size()) : 0;
+		if (edits > 0 && hits.size() < limit) {
+			std::array<std::uint64_t, 256> peq{};
+			for (size_t i = 0; i < q.size(); ++i) peq[static_cast<unsigned char>(q[i])] |= std::uint64_t(1) << i;
+
+			// hits per edit count, to stop once the top `limit` can't improve
+			std::array<size_t, 3> withEdits{ hits.size(), 0, 0 };
+			auto worstKept = [&]() {
+				size_t kept = 0;
+				for (int e = 0; e <= edits; ++e) {
+					kept += withEdits[e];
+					if (kept >= limit) return e;
+				}
+				return edits;
+			};
+
+			for (const Candidate& c : fuzzyCandidates(lists, static_cast<size_t>(3 * edits))) {
+				if (c.minEdits > worstKept()) break;
+				const Doc& d = docs_[c.id];
+				if (rankExact(d, q, rank)) continue; // found above
+
+				// neither field holds q exactly, so one edit in the site can't be beaten
+				const int inSite = bestDistance(peq, q.size(), siteOf(d));
+				const int best = inSite <= 1 ? inSite : std::min(inSite, bestDistance(peq, q.size(), userOf(d)));
+				if (best > edits) continue;
+				hits.push_back({ c.id, makeRank(best, inSite == best ? SiteContains : UserMatch, d.siteLen) });
+				++withEdits[best];
+			}
+		}
+	}
+
+	auto better = [](const Hit& a, const Hit& b) { return a.rank != b.rank ? a.rank < b.rank : a.pos < b.pos; };
+	if (hits.size() > limit) {
+		std::partial_sort(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(limit), hits.end(), better);
+		hits.resize(limit);
+	}
+	else std::sort(hits.begin(), hits.end(), better);
+	return hits;
+}
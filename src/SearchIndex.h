@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Entry.h"
+
+// Substring and typo-tolerant search over site and username. Built from the
+// vault's entries in one pass: case-folded copies of both fields plus a
+// trigram index (trigram -> entries containing it) that narrows a query to a
+// few candidates, which are then verified against the text. Results are
+// ranked: fewer typos first, then exact site, site prefix, site substring,
+// username match, then shorter sites.
+class SearchIndex {
+
+public:
+
+	struct Hit {
+		size_t pos; // position in the entry vector the index was built from
+		std::uint32_t rank; // lower is better
+	};
+
+	void build(const std::vector<Entry>& entries);
+	void clear();
+	bool empty() const { return docs_.empty(); }
+
+	// Best `limit` matches for query, best first. Queries of 6+ characters
+	// tolerate one edit (insert / delete / substitute), 9+ two. Queries under
+	// three characters scan every entry instead of using the trigram index.
+	std::vector<Hit> search(std::string_view query, size_t limit) const;
+
+private:
+
+	// folded fields of one entry, offsets into text_
+	struct Doc {
+		std::uint32_t site;
+		std::uint32_t siteLen;
+		std::uint32_t user;
+		std::uint32_t userLen;
+	};
+
+	std::string_view siteOf(const Doc& d) const { return std::string_view(text_).substr(d.site, d.siteLen); }
+	std::string_view userOf(const Doc& d) const { return std::string_view(text_).substr(d.user, d.userLen); }
+
+	// entry that may match within some edits, and the fewest it can need
+	struct Candidate {
+		std::uint32_t id;
+		int minEdits;
+	};
+	// entries that may match a query whose trigram lists (shortest first)
+	// lost up to `broken` trigrams to edits
+	std::vector<Candidate> fuzzyCandidates(const std::vector<const std::vector<std::uint32_t>*>& lists, size_t broken) const;
+
+	// exact matches of a short query by scanning all the text
+	void scanExact(std::string_view q, std::vector<Hit>& hits) const;
+
+	// rank of doc for an exact query, or false if it doesn't contain it
+	bool rankExact(const Doc& d, std::string_view q, std::uint32_t& rank) const;
+
+	std::string text_;
+	std::vector<Doc> docs_;
+	std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings_; // ascending doc ids
+};
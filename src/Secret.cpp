@@ -0,0 +1,59 @@
+#include "Secret.h"
+#include "../include/crypto.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+	// each sodium_malloc costs guard pages: start big enough for most passwords
+	const size_t kMinCapacity = 128;
+}
+
+Secret::~Secret() {
+	release();
+}
+
+Secret::Secret(Secret&& other) noexcept : data_(other.data_), cap_(other.cap_), len_(other.len_) {
+	other.data_ = nullptr;
+	other.cap_ = 0;
+	other.len_ = 0;
+}
+
+Secret& Secret::operator=(Secret&& other) noexcept {
+	if (this != &other) {
+		release();
+		data_ = other.data_;
+		cap_ = other.cap_;
+		len_ = other.len_;
+		other.data_ = nullptr;
+		other.cap_ = 0;
+		other.len_ = 0;
+	}
+	return *this;
+}
+
+void Secret::assign(std::string_view plain) {
+	clear();
+	if (plain.size() > cap_) {
+		release();
+		const size_t cap = std::max(kMinCapacity, plain.size());
+		auto* p = static_cast<char*>(Crypto::secureAlloc(cap));
+		if (!p) throw std::bad_alloc();
+		data_ = p;
+		cap_ = cap;
+	}
+	if (!plain.empty()) std::memcpy(data_, plain.data(), plain.size());
+	len_ = plain.size();
+}
+
+void Secret::clear() {
+	if (len_ > 0) Crypto::secureZero(data_, len_);
+	len_ = 0;
+}
+
+void Secret::release() {
+	if (data_) Crypto::secureFree(data_); // zeroes before release
+	data_ = nullptr;
+	cap_ = 0;
+	len_ = 0;
+}
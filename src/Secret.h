@@ -0,0 +1,36 @@
+#pragma once
+#include <string_view>
+#include <cstddef>
+
+// One decrypted secret (a password from Vault::reveal) in locked memory
+// (sodium_malloc), wiped when it is refilled, cleared or destroyed. Keep it
+// scoped to the code that needs the plaintext; reuse one object in a loop so
+// the guarded buffer is allocated once.
+class Secret {
+
+public:
+
+	Secret() = default;
+	~Secret();
+	Secret(const Secret&) = delete;
+	Secret& operator=(const Secret&) = delete;
+	Secret(Secret&& other) noexcept;
+	Secret& operator=(Secret&& other) noexcept;
+
+	// wipe the current contents and copy plain in
+	void assign(std::string_view plain);
+	// wipe the contents, keep the buffer
+	void clear();
+
+	// valid until the next assign / clear / destruction
+	std::string_view view() const { return std::string_view(data_, len_); }
+	bool empty() const { return len_ == 0; }
+
+private:
+
+	void release();
+
+	char* data_ = nullptr;
+	size_t cap_ = 0;
+	size_t len_ = 0;
+};
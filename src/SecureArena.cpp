@@ -0,0 +1,87 @@
+#include "SecureArena.h"
+#include "../include/crypto.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+	// sodium_malloc costs a few pages of guards per call, so allocate big
+	const size_t kChunkSize = 64 * 1024;
+}
+
+SecureArena::~SecureArena() {
+	clear();
+}
+
+SecureArena::SecureArena(SecureArena&& other) noexcept : chunks_(std::move(other.chunks_)), used_(other.used_) {
+	other.chunks_.clear();
+	other.used_ = 0;
+}
+
+SecureArena& SecureArena::operator=(SecureArena&& other) noexcept {
+	if (this != &other) {
+		clear();
+		chunks_ = std::move(other.chunks_);
+		used_ = other.used_;
+		other.chunks_.clear();
+		other.used_ = 0;
+	}
+	return *this;
+}
+
+bool SecureArena::addChunk(size_t minBytes) {
+	const size_t cap = std::max(kChunkSize, minBytes);
+	auto* base = static_cast<unsigned char*>(Crypto::secureAlloc(cap));
+	if (!base) return false;
+	chunks_.push_back({ base, cap, 0 });
+	return true;
+}
+
+void SecureArena::reserve(size_t bytes) {
+	if (bytes == 0) return;
+	if (!chunks_.empty() && chunks_.back().cap - chunks_.back().used >= bytes) return;
+	if (!addChunk(bytes)) throw std::bad_alloc();
+}
+
+std::string_view SecureArena::store(std::string_view s) {
+	if (s.empty()) return {};
+	reserve(s.size());
+
+	Chunk& c = chunks_.back();
+	unsigned char* dst = c.base + c.used;
+	std::memcpy(dst, s.data(), s.size());
+	c.used += s.size();
+	used_ += s.size();
+	return std::string_view(reinterpret_cast<const char*>(dst), s.size());
+}
+
+void SecureArena::wipe(std::string_view v) {
+	// views handed out by store() point at writable arena memory
+	if (!v.empty()) Crypto::secureZero(const_cast<char*>(v.data()), v.size());
+}
+
+void SecureArena::adopt(SecureArena&& other) {
+	if (this == &other) return;
+	// keep our current chunk last so its free space is still used by store()
+	const auto at = chunks_.empty() ? chunks_.end() : chunks_.end() - 1;
+	chunks_.insert(at, other.chunks_.begin(), other.chunks_.end());
+	used_ += other.used_;
+	other.chunks_.clear();
+	other.used_ = 0;
+}
+
+void SecureArena::clear() {
+	for (auto& c : chunks_) Crypto::secureFree(c.base); // zeroes before release
+	chunks_.clear();
+	used_ = 0;
+}
+
+size_t SecureArena::bytesUsed() const {
+	return used_;
+}
+
+size_t SecureArena::bytesReserved() const {
+	size_t n = 0;
+	for (const auto& c : chunks_) n += c.cap;
+	return n;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Bump allocator for decrypted entry bytes. Memory comes from sodium_malloc
+// in large chunks (guard pages, mlocked, zeroed on free), so every secret
+// lives in a handful of locked regions and one clear() wipes them all.
+// Stored bytes never move; views stay valid until clear() or destruction.
+class SecureArena {
+
+public:
+
+	SecureArena() = default;
+	~SecureArena();
+	SecureArena(const SecureArena&) = delete;
+	SecureArena& operator=(const SecureArena&) = delete;
+	SecureArena(SecureArena&& other) noexcept;
+	SecureArena& operator=(SecureArena&& other) noexcept;
+
+	// make sure the next `bytes` of stores fit in the current chunk
+	void reserve(size_t bytes);
+
+	// copy s into the arena; empty input gives an empty view
+	std::string_view store(std::string_view s);
+
+	// zero bytes previously returned by store() (space isn't reclaimed)
+	static void wipe(std::string_view v);
+
+	// take over every chunk of other (views into it stay valid), leaving it
+	// empty. Lets worker threads fill private arenas that are merged after.
+	void adopt(SecureArena&& other);
+
+	// wipe and release every chunk
+	void clear();
+
+	size_t bytesUsed() const;
+	size_t bytesReserved() const;
+
+private:
+
+	struct Chunk {
+		unsigned char* base;
+		size_t cap;
+		size_t used;
+	};
+
+	bool addChunk(size_t minBytes);
+
+	std::vector<Chunk> chunks_;
+	size_t used_ = 0; // sum of chunk used, kept so bytesUsed() is O(1)
+};
@@ -0,0 +1,603 @@
+#include "Server.h"
+#include "LocalSocket.h"
+#include "Secret.h"
+#include "../include/crypto.h"
+#include <cstdlib>
+#include <iostream>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif
+
+namespace {
+
+	void wipeString(std::string& s) {
+		if (!s.empty()) {
+			Crypto::secureZero(s.data(), s.size());
+			s.clear();
+		}
+	}
+
+#if defined(__linux__)
+	const size_t kMaxRequest = 64 * 1024; // longer lines close the connection
+	const size_t kMaxUnsent = 1 << 20; // stop taking requests from a client that doesn't read
+	const size_t kFindResults = 20; // as many as `find` shows
+	const size_t kReadChunk = 16 * 1024;
+	const auto kSaveRetry = std::chrono::seconds(1); // after a failed save
+
+	// epoll ids below kFirstConn are the server's own descriptors
+	const std::uint64_t kListenId = 0;
+	const std::uint64_t kWakeId = 1;
+	const std::uint64_t kSignalId = 2;
+	const std::uint64_t kFirstConn = 16;
+
+	using Clock = std::chrono::steady_clock;
+
+	// request split on single spaces (empty fields stay, as empty words)
+	std::vector<std::string_view> words(std::string_view line) {
+		std::vector<std::string_view> out;
+		size_t start = 0;
+		for (;;) {
+			const size_t sp = line.find(' ', start);
+			out.push_back(line.substr(start, sp == std::string_view::npos ? std::string_view::npos : sp - start));
+			if (sp == std::string_view::npos) return out;
+			start = sp + 1;
+		}
+	}
+
+	// Threads running posted jobs in order of posting. Unlike ThreadPool,
+	// jobs are independent and keep arriving while others run.
+	class WorkQueue {
+
+	public:
+
+		explicit WorkQueue(size_t threads) {
+			for (size_t i = 0; i < threads; ++i) threads_.emplace_back([this]() { work(); });
+		}
+
+		// runs the jobs already posted, then joins
+		~WorkQueue() {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				stopping_ = true;
+			}
+			cv_.notify_all();
+			for (auto& t : threads_) t.join();
+		}
+
+		void post(std::function<void()> job) {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				jobs_.push_back(std::move(job));
+			}
+			cv_.notify_one();
+		}
+
+	private:
+
+		void work() {
+			for (;;) {
+				std::function<void()> job;
+				{
+					std::unique_lock<std::mutex> lk(mutex_);
+					cv_.wait(lk, [this]() { return stopping_ || !jobs_.empty(); });
+					if (jobs_.empty()) return;
+					job = std::move(jobs_.front());
+					jobs_.pop_front();
+				}
+				job();
+			}
+		}
+
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		std::deque<std::function<void()>> jobs_;
+		bool stopping_ = false;
+		std::vector<std::thread> threads_;
+	};
+
+	// a client connection, owned by the event loop
+	struct Conn {
+		int fd = -1;
+		std::string in; // received, not yet taken as requests
+		std::string out; // replies not yet written
+		size_t sent = 0; // of out
+		bool busy = false; // a request is with the workers
+		bool watchingOut = false; // EPOLLOUT registered
+	};
+
+	// State the workers share with the event loop. Requests that only read
+	// share the vault lock; mutations, saves, refreshes and FIND (whose
+	// search index is built lazily) hold it alone.
+	struct Shared {
+		Vault& vault;
+		int wakeFd;
+		std::shared_mutex vaultLock;
+
+		// mutations applied since the last save, with the reply each
+		// connection gets once they are durable (under vaultLock)
+		std::vector<std::pair<std::uint64_t, std::string>> unsaved;
+		std::atomic<size_t> unsavedCount{ 0 };
+		std::atomic<Clock::rep> firstUnsaved{ 0 };
+		std::atomic<Clock::rep> retryAt{ 0 }; // no save before this after one failed
+		std::atomic<bool> saving{ false };
+		std::atomic<bool> stopRequested{ false };
+
+		// replies ready for the loop to send
+		std::mutex doneMutex;
+		std::vector<std::pair<std::uint64_t, std::string>> done;
+
+		Shared(Vault& v, int fd) : vault(v), wakeFd(fd) {}
+
+		void wake() {
+			const std::uint64_t one = 1;
+			ssize_t n;
+			do { n = ::write(wakeFd, &one, sizeof(one)); } while (n < 0 && errno == EINTR);
+		}
+
+		void complete(std::vector<std::pair<std::uint64_t, std::string>>& replies) {
+			{
+				std::lock_guard<std::mutex> lk(doneMutex);
+				for (auto& r : replies) done.push_back(std::move(r));
+			}
+			replies.clear();
+			wake();
+		}
+
+		void complete(std::uint64_t conn, std::string reply) {
+			std::vector<std::pair<std::uint64_t, std::string>> one;
+			one.emplace_back(conn, std::move(reply));
+			complete(one);
+		}
+
+		std::vector<std::pair<std::uint64_t, std::string>> takeDone() {
+			std::lock_guard<std::mutex> lk(doneMutex);
+			std::vector<std::pair<std::uint64_t, std::string>> out;
+			out.swap(done);
+			return out;
+		}
+
+		// queue a durable reply (caller holds vaultLock exclusively)
+		void deferReply(std::uint64_t conn, std::string reply) {
+			if (unsaved.empty()) firstUnsaved = Clock::now().time_since_epoch().count();
+			unsaved.emplace_back(conn, std::move(reply));
+			unsavedCount = unsaved.size();
+		}
+
+		std::string entries(const std::vector<Entry>& found, bool withPassword) {
+			std::string reply = "OK";
+			Secret password; // wiped on return
+			for (const auto& e : found) {
+				reply += ' ';
+				reply += Server::field(e.site);
+				reply += ',';
+				reply += Server::field(e.username);
+				if (!withPassword) continue;
+				if (const VaultStatus st = vault.reveal(e, password); st != VaultStatus::Ok) {
+					wipeString(reply);
+					return std::string("ERR ") + describe(st);
+				}
+				reply += ',';
+				reply += Server::field(password.view());
+			}
+			return reply;
+		}
+
+		// one request; an empty reply is sent by the save that follows
+		std::string handle(std::uint64_t conn, const std::string& line) {
+			const std::vector<std::string_view> w = words(line);
+			const std::string_view cmd = w[0];
+
+			if (cmd == "PING" && w.size() == 1) return "OK";
+			if (cmd == "STOP" && w.size() == 1) {
+				stopRequested = true;
+				return "OK";
+			}
+
+			if ((cmd == "GET" || cmd == "FIND" || cmd == "DEL") && w.size() == 2) {
+				std::string arg;
+				if (!Server::unfield(w[1], arg)) return "ERR bad field";
+
+				if (cmd == "GET") {
+					std::shared_lock<std::shared_mutex> lk(vaultLock);
+					const auto view = vault.findSite(arg);
+					return entries(std::vector<Entry>(view.begin(), view.end()), true);
+				}
+				std::unique_lock<std::shared_mutex> lk(vaultLock);
+				if (cmd == "FIND") return entries(vault.search(arg, kFindResults), false);
+
+				const size_t removed = vault.removeBySite(arg);
+				if (removed == 0) return "OK 0"; // nothing to save
+				deferReply(conn, "OK " + std::to_string(removed));
+				return {};
+			}
+
+			if (cmd == "ADD" && w.size() == 4) {
+				std::string site, username, password;
+				bool ok = Server::unfield(w[1], site) && Server::unfield(w[2], username) && Server::unfield(w[3], password);
+				if (ok && !site.empty()) {
+					std::unique_lock<std::shared_mutex> lk(vaultLock);
+					vault.addEntry(Entry{ site, username, password });
+					deferReply(conn, "OK");
+				}
+				wipeString(password);
+				if (!ok || site.empty()) return "ERR bad field";
+				return {};
+			}
+
+			return "ERR unknown request";
+		}
+
+		void run(std::uint64_t conn, std::string line) {
+			std::string reply;
+			try { reply = handle(conn, line); }
+			catch (...) { reply = "ERR internal error"; }
+			wipeString(line);
+			if (!reply.empty()) complete(conn, std::move(reply));
+			else wake(); // the loop schedules the save
+		}
+
+		// when the loop should start the next save
+		Clock::time_point saveDue(Clock::duration batch) const {
+			return std::max(Clock::time_point(Clock::duration(firstUnsaved.load())) + batch, Clock::time_point(Clock::duration(retryAt.load())));
+		}
+
+		// One save for every mutation applied so far. The vault keeps what a
+		// failed save didn't write and the next one writes it, so those
+		// mutations stay applied and unanswered until a retry succeeds;
+		// only the last save before exiting answers them ERR.
+		void save(bool last = false) {
+			std::vector<std::pair<std::uint64_t, std::string>> batch;
+			VaultStatus st = VaultStatus::Ok;
+			{
+				std::unique_lock<std::shared_mutex> lk(vaultLock);
+				try { st = vault.save(); }
+				catch (...) { st = VaultStatus::WriteFailed; }
+				if (st == VaultStatus::Ok || last) {
+					batch.swap(unsaved);
+					unsavedCount = 0;
+				}
+				else retryAt = (Clock::now() + kSaveRetry).time_since_epoch().count();
+			}
+			if (st != VaultStatus::Ok) {
+				std::cerr << "Save failed: " << describe(st) << (last ? "" : " Retrying.") << std::endl;
+				for (auto& r : batch) r.second = std::string("ERR ") + describe(st);
+			}
+			saving = false;
+			complete(batch); // wakes the loop to schedule a retry too
+		}
+
+		void refresh() {
+			std::unique_lock<std::shared_mutex> lk(vaultLock);
+			if (const VaultStatus st = vault.refresh(); st != VaultStatus::Ok) std::cerr << "Refresh failed: " << describe(st) << std::endl;
+		}
+	};
+
+	bool setNonBlocking(int fd) {
+		const int flags = ::fcntl(fd, F_GETFL, 0);
+		return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+	}
+
+	void watch(int ep, int fd, std::uint64_t id, std::uint32_t events, int op) {
+		epoll_event ev{};
+		ev.events = events;
+		ev.data.u64 = id;
+		::epoll_ctl(ep, op, fd, &ev);
+	}
+#endif
+
+}
+
+namespace Server {
+
+	std::string socketPath() {
+		if (const char* p = std::getenv("PM_SERVE_SOCK")) return p;
+#if defined(_WIN32)
+		return {};
+#else
+		return LocalSocket::runtimePath("pm-serve.sock");
+#endif
+	}
+
+	std::string field(std::string_view raw) {
+		std::vector<unsigned char> bytes(raw.begin(), raw.end());
+		std::string out = Crypto::b64encode(bytes);
+		if (!bytes.empty()) Crypto::secureZero(bytes.data(), bytes.size());
+		return out;
+	}
+
+	bool unfield(std::string_view encoded, std::string& out) {
+		std::vector<unsigned char> bytes = Crypto::b64decode(std::string(encoded));
+		if (bytes.empty() && !encoded.empty()) return false;
+		out.assign(bytes.begin(), bytes.end());
+		if (!bytes.empty()) Crypto::secureZero(bytes.data(), bytes.size());
+		return true;
+	}
+
+#if defined(_WIN32)
+	Client::~Client() {}
+	bool Client::connect(const std::string&) { return false; }
+	void Client::close() {}
+	bool Client::call(const std::string&, std::string&) { return false; }
+#else
+	Client::~Client() {
+		close();
+	}
+
+	bool Client::connect(const std::string& path) {
+		close();
+		fd_ = LocalSocket::connectTo(path);
+		return fd_ >= 0;
+	}
+
+	void Client::close() {
+		if (fd_ >= 0) ::close(fd_);
+		fd_ = -1;
+		wipeString(buf_);
+	}
+
+	bool Client::call(const std::string& request, std::string& reply) {
+		if (fd_ < 0 || !LocalSocket::writeAll(fd_, request + "\n")) return false;
+
+		char chunk[16 * 1024];
+		size_t nl;
+		while ((nl = buf_.find('\n')) == std::string::npos) {
+			const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			buf_.append(chunk, static_cast<size_t>(n));
+		}
+		reply.assign(buf_, 0, nl);
+		buf_.erase(0, nl + 1);
+		return true;
+	}
+#endif
+
+#if !defined(__linux__)
+	int run(Vault&, const Options&) {
+		std::cerr << "The vault server is not supported on this platform." << std::endl;
+		return 1;
+	}
+#else
+	int run(Vault& vault, const Options& options) {
+		const std::string path = options.socketPath.empty() ? socketPath() : options.socketPath;
+		if (path.empty()) {
+			std::cerr << "No private directory for the server socket (set XDG_RUNTIME_DIR or PM_SERVE_SOCK)." << std::endl;
+			return 1;
+		}
+		sockaddr_un addr;
+		if (!LocalSocket::makeAddr(path, addr)) {
+			std::cerr << "Server socket path is too long: " << path << std::endl;
+			return 1;
+		}
+
+		// refuse to start twice, clear a stale socket otherwise (a listener
+		// of another user is no server of ours: connectTo hangs up on it)
+		if (const int probe = LocalSocket::connectTo(path); probe >= 0) {
+			::close(probe);
+			std::cerr << "A server is already running at " << path << std::endl;
+			return 1;
+		}
+		::unlink(path.c_str());
+
+		const int lfd = LocalSocket::listenOn(path, 128);
+		if (lfd < 0 || !setNonBlocking(lfd)) {
+			std::cerr << "Could not listen on " << path << std::endl;
+			if (lfd >= 0) ::close(lfd);
+			return 1;
+		}
+
+		// signals arrive through the loop; blocked before any worker starts
+		// so no thread takes them instead (the shared ThreadPool, started by
+		// the vault's load, blocks them in its workers itself)
+		sigset_t sigs;
+		sigemptyset(&sigs);
+		sigaddset(&sigs, SIGINT);
+		sigaddset(&sigs, SIGTERM);
+		sigset_t oldSigs;
+		pthread_sigmask(SIG_BLOCK, &sigs, &oldSigs);
+
+		const int sfd = ::signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+		const int wfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		const int ep = ::epoll_create1(EPOLL_CLOEXEC);
+		if (sfd < 0 || wfd < 0 || ep < 0) {
+			std::cerr << "Could not set up the event loop." << std::endl;
+			for (int fd : { sfd, wfd, ep, lfd }) if (fd >= 0) ::close(fd);
+			::unlink(path.c_str());
+			pthread_sigmask(SIG_SETMASK, &oldSigs, nullptr);
+			return 1;
+		}
+		watch(ep, lfd, kListenId, EPOLLIN, EPOLL_CTL_ADD);
+		watch(ep, wfd, kWakeId, EPOLLIN, EPOLL_CTL_ADD);
+		watch(ep, sfd, kSignalId, EPOLLIN, EPOLL_CTL_ADD);
+
+		Shared shared(vault, wfd);
+		const size_t threads = options.workers ? options.workers : std::max(2u, std::thread::hardware_concurrency());
+		auto workers = std::make_unique<WorkQueue>(threads);
+
+		std::cout << "Serving " << vault.list().size() << " entries on " << path << " (" << threads << " workers)" << std::endl;
+
+		std::unordered_map<std::uint64_t, Conn> conns;
+		std::uint64_t nextId = kFirstConn;
+
+		auto closeConn = [&](std::unordered_map<std::uint64_t, Conn>::iterator it) {
+			::epoll_ctl(ep, EPOLL_CTL_DEL, it->second.fd, nullptr);
+			::close(it->second.fd);
+			wipeString(it->second.in);
+			wipeString(it->second.out);
+			conns.erase(it);
+		};
+
+		// write what the socket takes; false when the peer is gone
+		auto flush = [&](std::uint64_t id, Conn& c) {
+			while (c.sent < c.out.size()) {
+				const ssize_t n = ::send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+				if (n < 0 && errno == EINTR) continue;
+				if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+				if (n <= 0) return false;
+				c.sent += static_cast<size_t>(n);
+			}
+			if (c.sent == c.out.size()) {
+				wipeString(c.out);
+				c.sent = 0;
+			}
+			const bool wantOut = !c.out.empty();
+			if (wantOut != c.watchingOut) {
+				watch(ep, c.fd, id, EPOLLIN | EPOLLRDHUP | (wantOut ? static_cast<std::uint32_t>(EPOLLOUT) : 0u), EPOLL_CTL_MOD);
+				c.watchingOut = wantOut;
+			}
+			return true;
+		};
+
+		// hand the connection's next request to the workers
+		auto dispatch = [&](std::uint64_t id, Conn& c) {
+			if (c.busy || c.out.size() - c.sent > kMaxUnsent) return true;
+			const size_t nl = c.in.find('\n');
+			if (nl == std::string::npos) return c.in.size() <= kMaxRequest;
+
+			std::string line = c.in.substr(0, nl);
+			Crypto::secureZero(c.in.data(), nl + 1);
+			c.in.erase(0, nl + 1);
+			c.busy = true;
+			workers->post([&shared, id, l = std::move(line)]() mutable { shared.run(id, std::move(l)); });
+			return true;
+		};
+
+		const auto batch = std::chrono::milliseconds(options.batchMs);
+		const auto refreshEvery = std::chrono::milliseconds(std::max(1u, options.refreshMs));
+		auto lastRefresh = Clock::now();
+		bool stopping = false;
+		epoll_event events[64];
+
+		while (!stopping) {
+			// sleep until the next save or refresh is due
+			const auto now = Clock::now();
+			auto due = lastRefresh + refreshEvery;
+			if (shared.unsavedCount > 0 && !shared.saving) due = std::min(due, shared.saveDue(batch));
+			const int timeout = due <= now ? 0 : static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()) + 1;
+
+			const int n = ::epoll_wait(ep, events, 64, timeout);
+			if (n < 0 && errno != EINTR) break;
+
+			for (int i = 0; i < n; ++i) {
+				const std::uint64_t id = events[i].data.u64;
+
+				if (id == kListenId) {
+					for (;;) {
+						const int cfd = ::accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+						if (cfd < 0) break;
+						if (!LocalSocket::peerIsOwner(cfd)) { ::close(cfd); continue; }
+						const std::uint64_t cid = nextId++;
+						conns[cid].fd = cfd;
+						watch(ep, cfd, cid, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+					}
+				}
+				else if (id == kWakeId) {
+					std::uint64_t count;
+					while (::read(wfd, &count, sizeof(count)) > 0) {}
+
+					for (auto& [cid, reply] : shared.takeDone()) {
+						auto it = conns.find(cid);
+						if (it == conns.end()) { wipeString(reply); continue; } // closed meanwhile
+						Conn& c = it->second;
+						c.busy = false;
+						c.out += reply;
+						c.out += '\n';
+						wipeString(reply);
+						if (!flush(cid, c) || !dispatch(cid, c)) closeConn(it);
+					}
+				}
+				else if (id == kSignalId) {
+					signalfd_siginfo si;
+					while (::read(sfd, &si, sizeof(si)) > 0) {}
+					stopping = true;
+				}
+				else {
+					auto it = conns.find(id);
+					if (it == conns.end()) continue;
+					Conn& c = it->second;
+					bool alive = true;
+
+					// draining the backlog may release requests dispatch held back
+					if (events[i].events & EPOLLOUT) alive = flush(id, c) && dispatch(id, c);
+					if (alive && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+						char chunk[kReadChunk];
+						for (;;) {
+							const ssize_t got = ::recv(c.fd, chunk, sizeof(chunk), 0);
+							if (got > 0) { c.in.append(chunk, static_cast<size_t>(got)); continue; }
+							if (got < 0 && errno == EINTR) continue;
+							if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+							alive = false; // hung up
+							break;
+						}
+						Crypto::secureZero(chunk, sizeof(chunk));
+						alive = alive && dispatch(id, c);
+					}
+					if (!alive) closeConn(it);
+				}
+			}
+			if (shared.stopRequested) stopping = true;
+
+			// one save for every write queued up to now
+			const auto t = Clock::now();
+			if (shared.unsavedCount > 0 && !shared.saving && t >= shared.saveDue(batch)) {
+				shared.saving = true;
+				workers->post([&shared]() { shared.save(); });
+			}
+			if (t - lastRefresh >= refreshEvery) {
+				lastRefresh = t;
+				workers->post([&shared]() { shared.refresh(); });
+			}
+		}
+
+		// no new clients; finish what the workers have, then save the rest
+		::close(lfd);
+		::unlink(path.c_str());
+		workers.reset();
+		if (shared.unsavedCount > 0) shared.save(true);
+		for (auto& [cid, reply] : shared.takeDone()) {
+			auto it = conns.find(cid);
+			if (it != conns.end()) {
+				it->second.out += reply;
+				it->second.out += '\n';
+				flush(cid, it->second);
+			}
+			wipeString(reply);
+		}
+		while (!conns.empty()) closeConn(conns.begin());
+
+		::close(ep);
+		::close(wfd);
+		::close(sfd);
+		pthread_sigmask(SIG_SETMASK, &oldSigs, nullptr);
+		std::cout << "Server stopped." << std::endl;
+		return 0;
+	}
+#endif
+
+}
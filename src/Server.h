@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "Vault.h"
+
+// Vault server: keeps one unlocked vault open and answers queries over a
+// Unix domain socket, so callers that look up many credentials skip the
+// key derivation and the load on every request. Only the user running the
+// server may connect, and clients only talk to a server run by their user.
+//
+// Protocol: one request per line, one reply line per request, in order on
+// each connection. Fields are base64 (Server::field); entries in replies
+// are "site,username[,password]", separated by spaces.
+//   PING                        -> OK
+//   GET <site>                  -> OK <entry with password>...
+//   FIND <query>                -> OK <entry>...   (ranked, like `find`)
+//   ADD <site> <user> <pass>    -> OK
+//   DEL <site>                  -> OK <removed count>
+//   STOP                        -> OK, then the server saves and exits
+// Failures reply "ERR <message>". ADD / DEL are applied at once (later
+// requests see them) but only answered once a save has made them durable;
+// saves are batched across every connection's writes. A failed save is
+// retried, and its writes stay unanswered until one succeeds; they are
+// answered ERR only if the server stops before they could be saved.
+namespace Server {
+
+	struct Options {
+		std::string socketPath; // empty: socketPath()
+		unsigned workers = 0; // request threads, 0 = one per hardware thread
+		unsigned batchMs = 5; // writes wait this long for others to share their save
+		unsigned refreshMs = 1000; // how often saves by other processes are picked up
+	};
+
+	// $PM_SERVE_SOCK, else $XDG_RUNTIME_DIR/pm-serve.sock, else
+	// /tmp/pm-<uid>/pm-serve.sock (private directory, see
+	// LocalSocket::runtimePath); empty if that directory isn't safe
+	std::string socketPath();
+
+	// serve vault (already loaded) in the foreground until STOP or
+	// SIGINT / SIGTERM; pending writes are saved before returning
+	int run(Vault& vault, const Options& options);
+
+	// protocol field encoding
+	std::string field(std::string_view raw);
+	bool unfield(std::string_view encoded, std::string& out);
+
+	// client side: one connection, requests answered in order; connect()
+	// fails unless the server runs as our user
+	class Client {
+
+	public:
+
+		Client() = default;
+		~Client();
+		Client(const Client&) = delete;
+		Client& operator=(const Client&) = delete;
+
+		bool connect(const std::string& path);
+		void close();
+
+		// send one request line (no newline) and wait for its reply
+		bool call(const std::string& request, std::string& reply);
+
+	private:
+
+		int fd_ = -1;
+		std::string buf_; // bytes received past the last reply
+	};
+
+}
@@ -0,0 +1,65 @@
+#include "SiteIndex.h"
+#include <cctype>
+
+std::string SiteIndex::fold(std::string_view site) {
+	std::string s(site);
+	for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	return s;
+}
+
+void SiteIndex::insert(std::string_view site, size_t pos) {
+	map_.emplace(fold(site), pos);
+}
+
+void SiteIndex::erase(std::string_view site, size_t pos) {
+	auto [first, last] = map_.equal_range(fold(site));
+	for (auto it = first; it != last; ++it) {
+		if (it->second == pos) { map_.erase(it); return; }
+	}
+}
+
+void SiteIndex::relocate(std::string_view site, size_t from, size_t to) {
+	auto [first, last] = map_.equal_range(fold(site));
+	for (auto it = first; it != last; ++it) {
+		if (it->second == from) { it->second = to; return; }
+	}
+}
+
+void SiteIndex::rebuild(const std::vector<Entry>& entries) {
+	map_.clear();
+	for (size_t i = 0; i < entries.size(); ++i) insert(entries[i].site, i);
+}
+
+std::pair<SiteIndex::Map::const_iterator, SiteIndex::Map::const_iterator> SiteIndex::equalRange(std::string_view site) const {
+	return map_.equal_range(fold(site));
+}
+
+SiteIndex::View SiteIndex::all(const std::vector<Entry>& entries) const {
+	return View(map_.begin(), map_.end(), &entries);
+}
+
+SiteIndex::View SiteIndex::exact(const std::vector<Entry>& entries, const std::string& site) const {
+	auto [first, last] = map_.equal_range(fold(site));
+	return View(first, last, &entries);
+}
+
+SiteIndex::View SiteIndex::prefix(const std::vector<Entry>& entries, const std::string& prefix) const {
+	std::string lo = fold(prefix);
+	auto first = map_.lower_bound(lo);
+
+	// smallest string greater than every key starting with lo: drop trailing
+	// 0xFF bytes and bump the last one (keys compare as unsigned bytes)
+	std::string hi = lo;
+	while (!hi.empty() && static_cast<unsigned char>(hi.back()) == 0xFF) hi.pop_back();
+	if (hi.empty()) return View(first, map_.end(), &entries);
+	hi.back() = static_cast<char>(static_cast<unsigned char>(hi.back()) + 1);
+
+	return View(first, map_.lower_bound(hi), &entries);
+}
+
+SiteIndex::View SiteIndex::range(const std::vector<Entry>& entries, const std::string& lo, const std::string& hi) const {
+	auto first = map_.lower_bound(fold(lo));
+	auto last = hi.empty() ? map_.end() : map_.lower_bound(fold(hi));
+	if (!hi.empty() && fold(hi) < fold(lo)) last = first;
+	return View(first, last, &entries);
+}
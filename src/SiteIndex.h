@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <iterator>
+#include "Entry.h"
+
+// Sorted, case-folded index over Entry::site. Maps the folded site to the
+// entry's position in the vault's entry vector so lookups are O(log N) and
+// results are returned as views over the index (no Entry copies).
+class SiteIndex {
+
+public:
+
+	using Map = std::multimap<std::string, size_t>;
+
+	// iterable range of entries in case-folded site order
+	class View {
+
+	public:
+
+		class iterator {
+
+		public:
+
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = Entry;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const Entry*;
+			using reference = const Entry&;
+
+			iterator() = default;
+			iterator(Map::const_iterator it, const std::vector<Entry>* entries) : it_(it), entries_(entries) {}
+
+			reference operator*() const { return (*entries_)[it_->second]; }
+			pointer operator->() const { return &(*entries_)[it_->second]; }
+			iterator& operator++() { ++it_; return *this; }
+			iterator operator++(int) { iterator t = *this; ++it_; return t; }
+			bool operator==(const iterator& o) const { return it_ == o.it_; }
+			bool operator!=(const iterator& o) const { return it_ != o.it_; }
+
+		private:
+
+			Map::const_iterator it_;
+			const std::vector<Entry>* entries_ = nullptr;
+		};
+
+		View(Map::const_iterator first, Map::const_iterator last, const std::vector<Entry>* entries)
+			: first_(first), last_(last), entries_(entries) {}
+
+		iterator begin() const { return iterator(first_, entries_); }
+		iterator end() const { return iterator(last_, entries_); }
+		bool empty() const { return first_ == last_; }
+		size_t size() const { return static_cast<size_t>(std::distance(first_, last_)); }
+
+	private:
+
+		Map::const_iterator first_;
+		Map::const_iterator last_;
+		const std::vector<Entry>* entries_;
+	};
+
+	// lower-case a site name (ASCII) the same way for inserts and queries
+	static std::string fold(std::string_view site);
+
+	void insert(std::string_view site, size_t pos);
+	void erase(std::string_view site, size_t pos);
+	// an entry moved inside the entry vector (swap-remove)
+	void relocate(std::string_view site, size_t from, size_t to);
+	void rebuild(const std::vector<Entry>& entries);
+	void clear() { map_.clear(); }
+
+	// positions of entries whose folded site equals fold(site)
+	std::pair<Map::const_iterator, Map::const_iterator> equalRange(std::string_view site) const;
+
+	View all(const std::vector<Entry>& entries) const;
+	View exact(const std::vector<Entry>& entries, const std::string& site) const;
+	View prefix(const std::vector<Entry>& entries, const std::string& prefix) const;
+	// sites in [lo, hi), compared case-folded; empty hi means unbounded
+	View range(const std::vector<Entry>& entries, const std::string& lo, const std::string& hi) const;
+
+private:
+
+	Map map_;
+};
@@ -0,0 +1,97 @@
+#include "Stats.h"
+#include <nlohmann/json.hpp>
+#include <cstdio>
+
+namespace {
+
+	const size_t kStages = static_cast<size_t>(Stats::Stage::Count);
+	const size_t kCounters = static_cast<size_t>(Stats::Counter::Count);
+
+	// relaxed atomics: totals are read once the command is done
+	std::atomic<std::uint64_t> calls[kStages];
+	std::atomic<std::uint64_t> nanos[kStages];
+	std::atomic<std::uint64_t> counters[kCounters];
+
+	const char* const kStageNames[kStages] = {
+		"command", "prompt", "load", "save", "kdf", "lock_wait", "file_read", "file_write",
+		"decrypt", "encrypt", "parse", "serialize", "index", "base64"
+	};
+
+	const char* const kCounterNames[kCounters] = {
+		"bytes_read", "bytes_written", "fsyncs", "records_opened", "records_sealed",
+		"heap_allocs", "heap_bytes", "secure_allocs", "pages_verified"
+	};
+
+}
+
+namespace Stats {
+
+	namespace detail {
+		std::atomic<bool> enabled{ false };
+	}
+
+	void enable(bool on) {
+		detail::enabled.store(on, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (size_t i = 0; i < kStages; ++i) {
+			calls[i].store(0, std::memory_order_relaxed);
+			nanos[i].store(0, std::memory_order_relaxed);
+		}
+		for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+	}
+
+	void add(Counter c, std::uint64_t n) {
+		if (!enabled()) return;
+		counters[static_cast<size_t>(c)].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void record(Stage s, std::uint64_t ns) {
+		const size_t i = static_cast<size_t>(s);
+		calls[i].fetch_add(1, std::memory_order_relaxed);
+		nanos[i].fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	const char* name(Stage s) {
+		return kStageNames[static_cast<size_t>(s)];
+	}
+
+	const char* name(Counter c) {
+		return kCounterNames[static_cast<size_t>(c)];
+	}
+
+	void printReport(std::ostream& out, const std::string& command) {
+		char line[96];
+		out << "--- stats: " << command << " ---" << std::endl;
+		std::snprintf(line, sizeof(line), "%-16s %10s %14s", "stage", "calls", "ms");
+		out << line << std::endl;
+		for (size_t i = 0; i < kStages; ++i) {
+			const std::uint64_t n = calls[i].load(std::memory_order_relaxed);
+			if (n == 0) continue;
+			std::snprintf(line, sizeof(line), "%-16s %10llu %14.3f", kStageNames[i], static_cast<unsigned long long>(n),
+				nanos[i].load(std::memory_order_relaxed) / 1e6);
+			out << line << std::endl;
+		}
+		for (size_t i = 0; i < kCounters; ++i) {
+			const std::uint64_t v = counters[i].load(std::memory_order_relaxed);
+			if (v == 0) continue;
+			std::snprintf(line, sizeof(line), "%-16s %25llu", kCounterNames[i], static_cast<unsigned long long>(v));
+			out << line << std::endl;
+		}
+	}
+
+	std::string reportJson(const std::string& command) {
+		nlohmann::json stages = nlohmann::json::object();
+		for (size_t i = 0; i < kStages; ++i) {
+			const std::uint64_t n = calls[i].load(std::memory_order_relaxed);
+			if (n == 0) continue;
+			stages[kStageNames[i]] = { {"calls", n}, {"ns", nanos[i].load(std::memory_order_relaxed)} };
+		}
+		nlohmann::json counts = nlohmann::json::object();
+		for (size_t i = 0; i < kCounters; ++i) counts[kCounterNames[i]] = counters[i].load(std::memory_order_relaxed);
+
+		return nlohmann::json{ {"command", command}, {"stages", stages}, {"counters", counts} }.dump();
+	}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Process-wide instrumentation: scoped timers per stage plus byte, record
+// and allocation counters. The hot paths use PM_TIME / PM_COUNT, which
+// compile to nothing without PM_STATS (CMake option PM_ENABLE_STATS) and
+// cost one relaxed load while built in but not enabled at runtime.
+// Times are inclusive (a save's stage contains its encrypt and write) and
+// stages timed on pool threads add up across threads, so they can exceed
+// the wall time of the command around them.
+namespace Stats {
+
+	enum class Stage : unsigned {
+		Command, // a whole CLI command, prompts included
+		Prompt, // waiting for terminal input
+		Load,
+		Save,
+		Kdf, // Argon2id
+		LockWait, // acquiring the vault's write lock
+		FileRead,
+		FileWrite, // writes and their fsync
+		Decrypt,
+		Encrypt,
+		Parse, // JSON records and headers
+		Serialize,
+		Index, // applying loaded records, site / search index builds
+		Base64,
+		Count
+	};
+
+	enum class Counter : unsigned {
+		BytesRead,
+		BytesWritten,
+		Fsyncs,
+		RecordsOpened,
+		RecordsSealed,
+		HeapAllocs, // counted by the executable's operator new, if it hooks it
+		HeapBytes,
+		SecureAllocs, // sodium_malloc'd buffers (arena chunks, secrets)
+		PagesVerified, // paged region pages checked against the page tree
+		Count
+	};
+
+#if defined(PM_STATS)
+	constexpr bool kCompiled = true;
+#else
+	constexpr bool kCompiled = false;
+#endif
+
+	namespace detail {
+		extern std::atomic<bool> enabled;
+	}
+
+	inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+	void enable(bool on);
+	void reset();
+
+	void add(Counter c, std::uint64_t n);
+	void record(Stage s, std::uint64_t ns);
+
+	const char* name(Stage s);
+	const char* name(Counter c);
+
+	// stages with at least one call and non-zero counters, for one command
+	void printReport(std::ostream& out, const std::string& command);
+	// the same as one line of JSON:
+	// {"command":..,"stages":{"kdf":{"calls":1,"ns":..},..},"counters":{..}}
+	std::string reportJson(const std::string& command);
+
+	class Timer {
+
+	public:
+
+		explicit Timer(Stage stage) : stage_(stage), on_(enabled()) {
+			if (on_) start_ = std::chrono::steady_clock::now();
+		}
+		~Timer() {
+			if (on_) record(stage_, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()));
+		}
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+	private:
+
+		Stage stage_;
+		bool on_;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+}
+
+#if defined(PM_STATS)
+#define PM_STATS_JOIN2(a, b) a##b
+#define PM_STATS_JOIN(a, b) PM_STATS_JOIN2(a, b)
+#define PM_TIME(stage) ::Stats::Timer PM_STATS_JOIN(pmStatsTimer, __LINE__)(::Stats::Stage::stage)
+#define PM_COUNT(counter, n) ::Stats::add(::Stats::Counter::counter, static_cast<std::uint64_t>(n))
+#else
+#define PM_TIME(stage) ((void)0)
+#define PM_COUNT(counter, n) ((void)0)
+#endif
@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#if !defined(_WIN32)
+#include <csignal>
+#include <pthread.h>
+#endif
+
+ThreadPool::ThreadPool(size_t threads) {
+#if !defined(_WIN32)
+	// workers inherit the creating thread's signal mask: start them with every
+	// signal blocked, so a SIGINT / SIGTERM goes to a thread that handles it
+	// (e.g. serve's signalfd) instead of killing the process from a worker
+	sigset_t all;
+	sigset_t old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+#endif
+	for (size_t i = 1; i < threads; ++i) workers_.emplace_back([this]() { workerLoop(); });
+#if !defined(_WIN32)
+	pthread_sigmask(SIG_SETMASK, &old, nullptr);
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	for (auto& t : workers_) t.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool([]() -> size_t {
+		if (const char* env = std::getenv("PM_THREADS")) {
+			const long n = std::strtol(env, nullptr, 10);
+			if (n > 0) return static_cast<size_t>(n);
+		}
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}());
+	return pool;
+}
+
+size_t ThreadPool::segmentsFor(size_t count, size_t minParallel, size_t minPerSegment) const {
+	if (size() == 1 || count < minParallel) return count == 0 ? 0 : 1;
+	return std::min(size() * 4, count / minPerSegment);
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex>& lock) {
+	while (task_ && next_ < count_) {
+		const size_t i = next_++;
+		const auto* task = task_;
+		++active_;
+		lock.unlock();
+
+		std::exception_ptr err;
+		try { (*task)(i); }
+		catch (...) { err = std::current_exception(); }
+
+		lock.lock();
+		if (err && !error_) error_ = err;
+		if (--active_ == 0 && next_ >= count_) done_.notify_all();
+	}
+}
+
+void ThreadPool::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	size_t seen = generation_;
+	for (;;) {
+		wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+		if (stop_) return;
+		seen = generation_;
+		drain(lock);
+	}
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+	if (count == 0) return;
+
+	// nothing to share: skip the hand-off
+	if (workers_.empty() || count == 1) {
+		for (size_t i = 0; i < count; ++i) task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> serial(runMutex_);
+	std::unique_lock<std::mutex> lock(mutex_);
+	task_ = &task;
+	count_ = count;
+	next_ = 0;
+	error_ = nullptr;
+	++generation_;
+	wake_.notify_all();
+
+	drain(lock);
+	done_.wait(lock, [&]() { return next_ >= count_ && active_ == 0; });
+
+	task_ = nullptr;
+	std::exception_ptr err = error_;
+	error_ = nullptr;
+	lock.unlock();
+	if (err) std::rethrow_exception(err);
+}
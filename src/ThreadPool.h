@@ -0,0 +1,58 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops (vault save / load).
+// run() hands out task indices to the workers and the calling thread and
+// returns once every task has finished; one run() executes at a time.
+class ThreadPool {
+
+public:
+
+	// threads = total parallelism including the caller (1 = run inline)
+	explicit ThreadPool(size_t threads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// number of tasks that can run at once, caller included
+	size_t size() const { return workers_.size() + 1; }
+
+	// how many contiguous segments to split count items into for run(): one
+	// below minParallel items (none for zero), else a few per thread, each
+	// of at least minPerSegment items, which evens out uneven item costs
+	size_t segmentsFor(size_t count, size_t minParallel, size_t minPerSegment) const;
+
+	// call task(i) for every i in [0, count). The first exception thrown by a
+	// task is rethrown here after the remaining tasks are done.
+	void run(size_t count, const std::function<void(size_t)>& task);
+
+	// process-wide pool sized to the hardware, or $PM_THREADS when set
+	static ThreadPool& shared();
+
+private:
+
+	void workerLoop();
+	// take and run tasks of the current job until none are left
+	void drain(std::unique_lock<std::mutex>& lock);
+
+	std::vector<std::thread> workers_;
+	std::mutex runMutex_; // serializes run() callers
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	// current job, guarded by mutex_
+	const std::function<void(size_t)>* task_ = nullptr;
+	size_t count_ = 0;
+	size_t next_ = 0;
+	size_t active_ = 0;
+	size_t generation_ = 0;
+	std::exception_ptr error_;
+	bool stop_ = false;
+};
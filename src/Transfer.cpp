@@ -0,0 +1,169 @@
+#include "Transfer.h"
+#include "VaultFile.h"
+#include "../include/crypto.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+namespace {
+
+	std::string lower(std::string s) {
+		for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		return s;
+	}
+
+	void wipeFields(std::vector<std::string>& fields) {
+		for (auto& f : fields) {
+			if (!f.empty()) Crypto::secureZero(f.data(), f.size());
+			f.clear();
+		}
+	}
+
+	// Read one RFC 4180 record (quoted fields may hold commas, quotes and
+	// newlines). Returns false at end of input; malformed is set on a
+	// quote that never closes.
+	bool readRecord(std::streambuf* sb, std::vector<std::string>& fields, bool& malformed) {
+		wipeFields(fields);
+		fields.resize(1);
+
+		int c = sb->sbumpc();
+		if (c == std::char_traits<char>::eof()) return false;
+
+		bool quoted = false;
+		for (; c != std::char_traits<char>::eof(); c = sb->sbumpc()) {
+			const char ch = static_cast<char>(c);
+			std::string& f = fields.back();
+
+			if (quoted) {
+				if (ch != '"') { f.push_back(ch); continue; }
+				if (sb->sgetc() == '"') { sb->sbumpc(); f.push_back('"'); continue; }
+				quoted = false;
+				continue;
+			}
+
+			if (ch == '"' && f.empty()) quoted = true;
+			else if (ch == ',') fields.emplace_back();
+			else if (ch == '\r') { if (sb->sgetc() == '\n') sb->sbumpc(); return true; }
+			else if (ch == '\n') return true;
+			else f.push_back(ch);
+		}
+		malformed = quoted;
+		return true;
+	}
+
+	bool needsQuotes(std::string_view v) {
+		return v.find_first_of(",\"\r\n") != std::string_view::npos;
+	}
+
+	void writeCsvField(std::ostream& out, std::string_view v) {
+		if (!needsQuotes(v)) { out << v; return; }
+		out << '"';
+		for (char c : v) {
+			if (c == '"') out << '"';
+			out << c;
+		}
+		out << '"';
+	}
+
+}
+
+namespace Transfer {
+
+	bool formatFor(const std::string& name, const std::string& path, Format& out) {
+		std::string n = lower(name);
+		if (n.empty()) {
+			const size_t dot = path.find_last_of('.');
+			if (dot != std::string::npos) n = lower(path.substr(dot + 1));
+		}
+		if (n == "csv") { out = Format::Csv; return true; }
+		if (n == "json") { out = Format::Json; return true; }
+		return false;
+	}
+
+	bool readCsv(std::istream& in, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, std::string& err) {
+		std::streambuf* sb = in.rdbuf();
+		std::vector<std::string> fields;
+		bool malformed = false;
+
+		if (!readRecord(sb, fields, malformed)) return true; // empty input
+
+		// header row: map known column names, else positional
+		int siteCol = -1, nameCol = -1, urlCol = -1, userCol = -1, passCol = -1;
+		for (size_t i = 0; i < fields.size(); ++i) {
+			const std::string h = lower(fields[i]);
+			const int col = static_cast<int>(i);
+			if (h == "site") siteCol = col;
+			else if (h == "name") nameCol = col;
+			else if (h == "url" || h == "login_uri") urlCol = col;
+			else if (h == "username" || h == "login_username") userCol = col;
+			else if (h == "password" || h == "login_password") passCol = col;
+		}
+		if (siteCol < 0) siteCol = nameCol >= 0 ? nameCol : urlCol;
+
+		const bool hasHeader = siteCol >= 0 && passCol >= 0;
+		if (!hasHeader) { siteCol = 0; userCol = 1; passCol = 2; }
+
+		size_t line = 1;
+		auto emit = [&]() -> bool {
+			if (malformed) { err = "Unterminated quoted field in record " + std::to_string(line); return false; }
+
+			auto col = [&](int i) -> std::string_view {
+				return i >= 0 && static_cast<size_t>(i) < fields.size() ? std::string_view(fields[i]) : std::string_view();
+			};
+			// rows without a site (notes, folders, blank lines) are skipped
+			if (!col(siteCol).empty()) {
+				arena.reserve(col(siteCol).size() + col(userCol).size() + col(passCol).size());
+				onEntry(Entry{ arena.store(col(siteCol)), arena.store(col(userCol)), arena.store(col(passCol)) });
+			}
+			return true;
+		};
+
+		if (!hasHeader && !emit()) { wipeFields(fields); return false; }
+
+		while (readRecord(sb, fields, malformed)) {
+			++line;
+			if (!emit()) { wipeFields(fields); return false; }
+		}
+		wipeFields(fields);
+		return true;
+	}
+
+	bool readJson(std::istream& in, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, std::string& err) {
+		if (!VaultFile::parseEntries(in, arena, onEntry)) {
+			err = "Input is not a JSON array of {site, username, password} objects.";
+			return false;
+		}
+		return true;
+	}
+
+	bool writeCsv(std::ostream& out, const Vault& vault, const SiteIndex::View& entries) {
+		out << "site,username,password\n";
+		Secret password;
+		for (const auto& e : entries) {
+			if (vault.reveal(e, password) != VaultStatus::Ok) return false;
+			writeCsvField(out, e.site);
+			out << ',';
+			writeCsvField(out, e.username);
+			out << ',';
+			writeCsvField(out, password.view());
+			out << '\n';
+		}
+		return !!out;
+	}
+
+	bool writeJson(std::ostream& out, const Vault& vault, const SiteIndex::View& entries) {
+		out << "[";
+		bool first = true;
+		Secret password;
+		for (const auto& e : entries) {
+			if (vault.reveal(e, password) != VaultStatus::Ok) return false;
+			std::string rec = VaultFile::encodeEntry(Entry{ e.site, e.username, password.view() });
+			out << (first ? "\n  " : ",\n  ") << rec;
+			Crypto::secureZero(rec.data(), rec.size());
+			first = false;
+		}
+		out << "\n]\n";
+		return !!out;
+	}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <istream>
+#include <ostream>
+#include <functional>
+#include "Entry.h"
+#include "SecureArena.h"
+#include "SiteIndex.h"
+#include "Vault.h"
+
+// Bulk import / export of entries in CSV or JSON. Readers stream the input
+// and hand out entries one at a time (fields stored in the caller's arena),
+// writers stream entries straight to the output.
+namespace Transfer {
+
+	enum class Format { Csv, Json };
+
+	// pick a format from an explicit name ("csv" / "json") or the file extension
+	bool formatFor(const std::string& name, const std::string& path, Format& out);
+
+	// CSV with a header row. Column names understood: site / name / url /
+	// login_uri, username / login_username, password / login_password
+	// (Chrome, Firefox and Bitwarden exports). Without a recognised header the
+	// columns are taken as site,username,password.
+	bool readCsv(std::istream& in, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, std::string& err);
+
+	// JSON array of {"site","username","password"} objects (our own export)
+	bool readJson(std::istream& in, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, std::string& err);
+
+	// entries of vault; passwords are revealed one at a time and wiped
+	// once written. False on a write or decrypt failure.
+	bool writeCsv(std::ostream& out, const Vault& vault, const SiteIndex::View& entries);
+	bool writeJson(std::ostream& out, const Vault& vault, const SiteIndex::View& entries);
+
+}
@@ -1,28 +1,270 @@
 #include "Vault.h"
 #include "../include/crypto.h"
+#include "VaultFile.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 #include <nlohmann/json.hpp>
-#include <fstream>
-#include <iterator>
 #include <sodium.h>
 #include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 
+using namespace VaultFile;
 
-// Read entire file contents into secure string
-static bool readAllText(const std::string& path, std::string& out) {
-	std::ifstream ifs(path, std::ios::binary); // open file in binary mode
-	if (!ifs) return false;
+// compact once dead records pass this count and outnumber live ones
+static const size_t kCompactMinWaste = 64;
 
-	out.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()); // read in all bytes
-	return true;
+// or once records appended since the last rewrite (which lookups scan
+// instead of finding them through the tag index) pass this count and an
+// eighth of the rewrite's
+static const size_t kCompactMinTail = 4096;
+static const size_t kCompactTailShare = 8;
+
+// move live entries to a fresh arena once the arena passes this size and
+// its dead bytes (removed entries, passwords sealed since) outweigh them
+static const size_t kArenaMinReclaim = 1024 * 1024;
+
+// below this many records a single thread is faster than the hand-off
+static const size_t kParallelMinRecords = 2048;
+static const size_t kSegmentMinRecords = 512;
+
+// load reads at most this much before opening a batch in parallel
+static const size_t kLoadBatchFrames = 64 * 1024;
+static const size_t kLoadBatchBytes = 64 * 1024 * 1024;
+
+// how many segments to split a run of records into for the thread pool
+static size_t segmentsFor(size_t records) {
+	return ThreadPool::shared().segmentsFor(records, kParallelMinRecords, kSegmentMinRecords);
+}
+
+// check record body: {"records": N} for the puts written by a rewrite and
+// the layout of its paged region, {"pages": {"size", "index", "end", "root_b64"}}.
+// Older files have an empty check record (count unknown) or no pages.
+static std::string encodeCheck(size_t records, const PageLayout& pages) {
+	nlohmann::json j;
+	j["records"] = records;
+	if (pages.pageBytes != 0) {
+		j["pages"] = { { "size", pages.pageBytes }, { "index", pages.index }, { "end", pages.end }, { "root_b64", Crypto::b64encode(pages.root) } };
+	}
+	return j.dump();
+}
+
+static bool decodeCheck(const std::string& plain, size_t& records, PageLayout* pages = nullptr) {
+	records = 0;
+	if (pages) *pages = PageLayout{};
+	if (plain.empty()) return true;
+	try {
+		const nlohmann::json j = nlohmann::json::parse(plain);
+		records = j.value("records", size_t(0));
+		if (pages && j.contains("pages")) {
+			const nlohmann::json& p = j.at("pages");
+			pages->pageBytes = p.at("size").get<size_t>();
+			pages->index = p.at("index").get<std::uint64_t>();
+			pages->end = p.at("end").get<std::uint64_t>();
+			pages->root = Crypto::b64decode(p.at("root_b64").get<std::string>());
+		}
+		return true;
+	}
+	catch (...) {
+		return false;
+	}
+}
+
+static nlohmann::json kdfToJson(const Crypto::KdfParams& kdf) {
+	nlohmann::json k;
+	k["opslimit"] = kdf.opslimit;
+	k["memlimit"] = kdf.memlimit;
+	k["salt_b64"] = Crypto::b64encode(kdf.salt);
+	return k;
+}
+
+// throws on missing fields (callers parse inside try)
+static bool kdfFromJson(const nlohmann::json& k, Crypto::KdfParams& out) {
+	out.opslimit = k.at("opslimit").get<unsigned long long>();
+	out.memlimit = k.at("memlimit").get<std::size_t>();
+	if (!Crypto::kdfInBounds(out)) return false;
+
+	out.salt = Crypto::b64decode(k.at("salt_b64").get<std::string>());
+	return out.salt.size() == crypto_pwhash_SALTBYTES;
+}
+
+// bytes of a password sealed on its own: nonce || ciphertext || tag
+static size_t sealedLength(size_t plainLen) {
+	return crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + plainLen + crypto_aead_xchacha20poly1305_ietf_ABYTES;
 }
 
-// Write entire string to file, overwriting existing content.
-static bool writeAllText(const std::string& path, const std::string& data) {
-	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
-	if (!ofs) return false;
+// label of the slot kept in the header's top-level kdf / wrapped key
+static const char* const kPasswordSlot = "password";
+
+// one parallel load segment: entries and tombstones in file order, their
+// bytes in a private arena adopted by the vault afterwards
+struct LoadSegment {
+	struct Op {
+		std::uint8_t kind;
+		Entry entry; // puts
+		std::string_view site; // tombstones
+		size_t count; // check records
+	};
+	SecureArena arena;
+	std::vector<Op> ops;
+	size_t records = 0; // put + tombstone frames
+	size_t puts = 0;
+	bool sawBlob = false;
+	bool unindexed = false; // put / del records without blind index tags
+	bool eager = false; // puts holding a plain password (not sealed on its own)
+	VaultStatus status = VaultStatus::Ok;
+};
 
-	ofs.write(data.data(), static_cast<std::streamsize>(data.size())); // write all bytes
-	return !!ofs;
+// Open one record frame. kind comes back as the plain kind (indexed and
+// split puts / dels as FramePut / FrameDel); a split put's sealed password
+// is handed back as it is in password.
+static VaultStatus openRecord(const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce, std::uint8_t& kind,
+	const unsigned char* data, size_t len, std::string& plaintext, std::string_view& password) {
+	PM_TIME(Decrypt);
+	PM_COUNT(RecordsOpened, 1);
+	// indexed puts / dels open like plain ones, tags as extra AD
+	bool opened = false;
+	password = {};
+	if (kind == FrameBlob) opened = Crypto::decrypt(key, nonce, data, len, plaintext);
+	else if (kind == FramePut || kind == FrameDel || kind == FrameCheck || kind == FrameDict) opened = Crypto::open(key, data, len, frameAd(kind), plaintext);
+	else if (kind == FramePutIndexed || kind == FrameDelIndexed) {
+		IndexedFrame ix;
+		if (!splitIndexed(data, len, ix)) return VaultStatus::Corrupt;
+		opened = Crypto::open(key, ix.sealed, ix.sealedLen, ix.ad(kind), plaintext);
+		kind = kind == FramePutIndexed ? FramePut : FrameDel;
+	}
+	else if (kind == FramePutSplit) {
+		IndexedFrame ix;
+		const unsigned char* record = nullptr;
+		const unsigned char* sealed = nullptr;
+		size_t recordLen = 0;
+		size_t sealedLen = 0;
+		if (!splitIndexed(data, len, ix) || !splitSecret(ix, record, recordLen, sealed, sealedLen) || sealedLen == 0) return VaultStatus::Corrupt;
+		opened = Crypto::open(key, record, recordLen, ix.ad(kind), plaintext);
+		password = std::string_view(reinterpret_cast<const char*>(sealed), sealedLen);
+		kind = FramePut;
+	}
+	else return VaultStatus::Corrupt; // unknown frame type
+
+	return opened ? VaultStatus::Ok : VaultStatus::AuthFailed;
+}
+
+// Frames a filtered load reads from a rewrite's paged region: the check
+// record, the dictionary if there is one and the records indexed under the
+// query's tag, then the frames appended after the region. Not paged (read
+// front to back) for files written before the tag index or opened as a
+// stream.
+struct PagedHits {
+	bool paged = false;
+	std::vector<size_t> seeks; // file offsets in read order, the tail last
+	size_t records = 0; // puts of the rewrite, matching or not
+	size_t matches = 0;
+};
+
+// Find match's records through the tag index, every byte on the way
+// verified against the page tree root sealed in the check record. A page
+// failing verification is a tampered file.
+static VaultStatus findPaged(FrameReader& reader, const std::vector<unsigned char>& key, const std::vector<unsigned char>& nonce,
+	const std::vector<unsigned char>& pageKey, const std::string& match, PagedHits& out) {
+	out = PagedHits{};
+	const size_t checkAt = reader.offset();
+	std::uint8_t kind = 0;
+	const unsigned char* data = nullptr;
+	size_t len = 0;
+	if (reader.next(kind, data, len) != FrameReader::Status::Ok || kind != FrameCheck) { reader.seek(checkAt); return VaultStatus::Ok; }
+
+	std::string plaintext;
+	std::string_view password;
+	if (const VaultStatus st = openRecord(key, nonce, kind, data, len, plaintext, password); st != VaultStatus::Ok) return st;
+	PageLayout layout;
+	size_t records = 0;
+	if (!decodeCheck(plaintext, records, &layout)) return VaultStatus::Corrupt;
+	if (layout.pageBytes == 0) { reader.seek(checkAt); return VaultStatus::Ok; }
+
+	// the sealed layout promises the region and the tree behind it
+	const size_t start = reader.offset();
+	if (layout.end > reader.mappingSize() - start || !reader.seek(start + static_cast<size_t>(layout.end))) return VaultStatus::Truncated;
+	const FrameReader::Status ts = reader.next(kind, data, len);
+	if (ts != FrameReader::Status::Ok) return VaultStatus::Truncated;
+	if (kind != FramePageTree) return VaultStatus::Corrupt;
+
+	PagedRegion region;
+	if (!region.open(pageKey, layout, reader.mapping() + start, static_cast<size_t>(layout.end), data, len)) return VaultStatus::Corrupt;
+	std::vector<std::uint64_t> offsets;
+	if (!region.lookup(match, offsets) || offsets.size() > records) return VaultStatus::AuthFailed;
+
+	out.seeks.push_back(checkAt);
+	// the records need the dictionary at the front of the region
+	if (region.verify(0, 1) && region.data()[0] == FrameDict) out.seeks.push_back(start);
+	for (std::uint64_t off : offsets) {
+		if (!region.verify(off, 5) || !region.verify(off, 5 + std::uint64_t(getU32(region.data() + off + 1)))) return VaultStatus::AuthFailed;
+		out.seeks.push_back(start + static_cast<size_t>(off));
+	}
+	out.seeks.push_back(reader.offset());
+	out.records = records;
+	out.matches = offsets.size();
+	out.paged = true;
+	return VaultStatus::Ok;
+}
+
+// A put record's plaintext as it was serialized: decompressed into
+// unpacked if it was compressed, else plaintext itself. Serialized records
+// are JSON objects; a compressed frame never starts with '{' (see
+// Compressor). Null if it doesn't decompress with the loaded dictionary.
+static const std::string* unpackRecord(const Compressor& codec, Compressor::Workspace& ws, const std::string& plaintext, std::string& unpacked) {
+	if (plaintext.empty() || plaintext.front() == '{') return &plaintext;
+	return codec.decompress(ws, plaintext, unpacked) ? &unpacked : nullptr;
+}
+
+// Sites touched by one writer's puts and tombstones, by exact-site blind
+// tag. Two writers' records give the same entries in either order unless
+// one deletes a site the other puts.
+struct SiteTouches {
+	std::unordered_set<std::string> puts;
+	std::unordered_set<std::string> dels;
+	bool unknown = false; // a record without tags: assume the worst
+
+	void add(bool del, std::string_view tags) {
+		if (tags.size() < kBlindTagBytes) { unknown = true; return; }
+		(del ? dels : puts).emplace(tags.substr(0, kBlindTagBytes));
+	}
+
+	bool commutesWith(const SiteTouches& other) const {
+		if (unknown || other.unknown) return false;
+		for (const auto& t : dels) if (other.puts.count(t)) return false;
+		for (const auto& t : other.dels) if (puts.count(t)) return false;
+		return true;
+	}
+};
+
+// One save() waiting for its records to be written by a group commit.
+struct Vault::CommitRequest {
+	Vault* vault;
+	VaultStatus status = VaultStatus::Ok;
+	bool done = false;
+};
+
+// save() calls on one path in this process queue here; the first to find
+// no leader writes everything queued so far (and its own) as one batch
+struct Vault::CommitQueue {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<CommitRequest*> waiting;
+	bool leading = false;
+};
+
+Vault::CommitQueue& Vault::commitQueueFor(const std::string& path) {
+	static std::mutex mutex;
+	static std::map<std::string, std::unique_ptr<CommitQueue>> queues;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& q = queues[path];
+	if (!q) q = std::make_unique<CommitQueue>();
+	return *q;
 }
 
 // Securely wipe a string's contents from memory.
@@ -34,154 +276,1222 @@ static void wipeString(std::string& s) {
 	}
 }
 
+// dictionary for a rewrite of entries, trained on the site / username
+// records of an even spread of them; codec stays empty for small vaults
+static void trainOn(const std::vector<Entry>& entries, int level, Compressor& codec) {
+	codec.clear();
+	if (entries.size() < Compressor::kMinSamples) return;
+	const size_t count = std::min(entries.size(), Compressor::kMaxSamples);
+
+	std::string samples;
+	std::vector<size_t> sizes;
+	samples.reserve(count * 96);
+	sizes.reserve(count);
+	for (size_t k = 0; k < count; ++k) {
+		std::string meta = encodeMeta(entries[k * entries.size() / count]);
+		samples += meta;
+		sizes.push_back(meta.size());
+		wipeString(meta);
+	}
+	codec.train(samples, sizes, level);
+	wipeString(samples);
+}
+
+const char* describe(VaultStatus status) {
+	switch (status) {
+	case VaultStatus::Ok: return "OK.";
+	case VaultStatus::OpenFailed: return "Could not open vault file.";
+	case VaultStatus::WriteFailed: return "Failed to write vault file.";
+	case VaultStatus::Truncated: return "Vault file is truncated.";
+	case VaultStatus::BadHeader: return "Vault header is invalid (salt/nonce/version).";
+	case VaultStatus::KeyUnavailable: return "Key derivation failed.";
+	case VaultStatus::AuthFailed: return "Decryption failed. Wrong password or corrupted file.";
+	case VaultStatus::Corrupt: return "Decrypted data isn't a valid vault record.";
+	case VaultStatus::Locked: return "Key is not derived; call initNew() or load() first.";
+	case VaultStatus::CryptoFailed: return "Encryption failed.";
+	case VaultStatus::LockFailed: return "Could not lock the vault for writing.";
+	case VaultStatus::BadKdf: return "KDF parameters are out of range.";
+	case VaultStatus::BadSlot: return "No such key slot (or the label is reserved).";
+	case VaultStatus::BadManifest: return "Collection manifest is invalid.";
+	case VaultStatus::Exists: return "File already exists; not overwriting it.";
+	}
+	return "Unknown error.";
+}
+
 Vault::Vault(std::string path) : filePath(std::move(path)) {}
 
 // securely wipe sensitive & personal data from memory
 Vault::~Vault() {
 	// wipe key / nonce
 	if (!key.empty()) Crypto::secureZero(key.data(), key.size());
+	if (!indexKey_.empty()) Crypto::secureZero(indexKey_.data(), indexKey_.size());
+	if (!secretKey_.empty()) Crypto::secureZero(secretKey_.data(), secretKey_.size());
+	if (!pageKey_.empty()) Crypto::secureZero(pageKey_.data(), pageKey_.size());
 	if (!nonce.empty()) Crypto::secureZero(nonce.data(), nonce.size());
 
-	for (auto& e : entries) {
-		if (!e.password.empty()) {
-			Crypto::secureZero(e.password.data(), e.password.size()); // wipe password
-			e.password.clear();
-			e.password.shrink_to_fit();
-		}
-	}
+	// every decrypted field lives in the arena: one bulk wipe
+	entries.clear();
+	arena_.clear();
+	clearPending();
 }
 
 
-// Initialize new vault with fresh salt / nonce, derives a key and saves
-bool Vault::initNew(const std::string& masterPassword) {
+// Initialize new vault with fresh salt / nonce and data key, wraps it and saves
+VaultStatus Vault::initNew(const std::string& masterPassword, const Crypto::KdfParams& params) {
+	if (!Crypto::kdfInBounds(params)) return VaultStatus::BadKdf;
+	kdf_ = params;
 	kdf_.salt = Crypto::randomBytes(crypto_pwhash_SALTBYTES);
-	if (!deriveKey(masterPassword)) return false;
+
+	std::vector<unsigned char> kek;
+	if (!Crypto::deriveKey(masterPassword, kdf_, kek)) return VaultStatus::KeyUnavailable;
+
+	if (!key.empty()) Crypto::secureZero(key.data(), key.size());
+	key = Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_KEYBYTES);
+	const bool wrapped = Crypto::wrapKey(kek, key, wrappedKey_);
+	Crypto::secureZero(kek.data(), kek.size());
+	hasKey_ = wrapped && deriveSubkeys();
+	if (!hasKey_) return VaultStatus::CryptoFailed;
+
 	nonce = Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
 
 	entries.clear(); // start empty
+	index_.clear();
+	searchStale_ = true;
+	clearPending();
+	partial_ = false;
+	needsRewrite_ = true;
+	stamp_ = FileStamp{}; // replaces whatever is at the path
+	fileEnd_ = 0;
 	return save(); // return written header
 }
 
-// derive encryption key from master password
-bool Vault::deriveKey(const std::string& masterPassword) {
-	key.clear(); 
-		if (!Crypto::deriveKey(masterPassword, kdf_, key)) {
-			hasKey_ = false;
-			return false;
+// ask the provider for the key matching the parsed header
+VaultStatus Vault::obtainKey(const KeyProvider& keyFor, bool dataKey) {
+	if (!key.empty()) Crypto::secureZero(key.data(), key.size());
+	key.clear();
+	hasKey_ = false;
+
+	// older files seal records with the password key itself
+	if (dataKey || wrappedKey_.empty()) {
+		std::vector<unsigned char> k;
+		if (!keyFor(kdf_, k) || k.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) {
+			if (!k.empty()) Crypto::secureZero(k.data(), k.size());
+			return VaultStatus::KeyUnavailable;
 		}
-		hasKey_ = true;
-		return true;
+		key = std::move(k);
+		hasKey_ = deriveSubkeys();
+		return hasKey_ ? VaultStatus::Ok : VaultStatus::CryptoFailed;
+	}
+
+	// the password slot first, then the extra slots in header order
+	bool gotKek = false;
+	for (size_t i = 0; i <= slots_.size() && !hasKey_; ++i) {
+		const Crypto::KdfParams& kdf = i == 0 ? kdf_ : slots_[i - 1].kdf;
+		const std::vector<unsigned char>& wrapped = i == 0 ? wrappedKey_ : slots_[i - 1].wrapped;
+
+		std::vector<unsigned char> kek;
+		if (keyFor(kdf, kek) && kek.size() == crypto_aead_xchacha20poly1305_ietf_KEYBYTES) {
+			gotKek = true;
+			hasKey_ = Crypto::unwrapKey(kek, wrapped, key);
+		}
+		if (!kek.empty()) Crypto::secureZero(kek.data(), kek.size());
+	}
+	if (hasKey_) {
+		hasKey_ = deriveSubkeys();
+		return hasKey_ ? VaultStatus::Ok : VaultStatus::CryptoFailed;
+	}
+	return gotKek ? VaultStatus::AuthFailed : VaultStatus::KeyUnavailable;
+}
+
+bool Vault::deriveSubkeys() {
+	return blindIndexKey(key, indexKey_) && secretKey(key, secretKey_) && pageKey(key, pageKey_);
+}
+
+// Does secret (password or recovery key) open one of the slots? Guards every
+// header change: a mistyped password there would lock the vault for good.
+bool Vault::opensWith(const std::string& secret) const {
+	if (!hasKey_) return false;
+
+	auto sameKey = [&](const std::vector<unsigned char>& k) {
+		return k.size() == key.size() && sodium_memcmp(k.data(), key.data(), key.size()) == 0;
+	};
+
+	std::vector<unsigned char> kek;
+	if (wrappedKey_.empty()) {
+		const bool ok = Crypto::deriveKey(secret, kdf_, kek) && sameKey(kek);
+		if (!kek.empty()) Crypto::secureZero(kek.data(), kek.size());
+		return ok;
+	}
+
+	bool ok = false;
+	for (size_t i = 0; i <= slots_.size() && !ok; ++i) {
+		const Crypto::KdfParams& kdf = i == 0 ? kdf_ : slots_[i - 1].kdf;
+		const std::vector<unsigned char>& wrapped = i == 0 ? wrappedKey_ : slots_[i - 1].wrapped;
+
+		std::vector<unsigned char> dk;
+		ok = Crypto::deriveKey(secret, kdf, kek) && Crypto::unwrapKey(kek, wrapped, dk) && sameKey(dk);
+		if (!dk.empty()) Crypto::secureZero(dk.data(), dk.size());
+		if (!kek.empty()) Crypto::secureZero(kek.data(), kek.size());
+	}
+	return ok;
+}
+
+// wrap the data key under secret with fresh salt
+VaultStatus Vault::wrapFor(const std::string& secret, const Crypto::KdfParams& params, Crypto::KdfParams& outKdf, std::vector<unsigned char>& outWrapped) const {
+	if (!Crypto::kdfInBounds(params)) return VaultStatus::BadKdf;
+
+	outKdf = params;
+	outKdf.salt = Crypto::randomBytes(crypto_pwhash_SALTBYTES);
+
+	std::vector<unsigned char> kek;
+	if (!Crypto::deriveKey(secret, outKdf, kek)) return VaultStatus::KeyUnavailable;
+	const bool ok = Crypto::wrapKey(kek, key, outWrapped);
+	Crypto::secureZero(kek.data(), kek.size());
+	return ok ? VaultStatus::Ok : VaultStatus::CryptoFailed;
+}
+
+// Swap the password wrapping for one under new KDF parameters.
+VaultStatus Vault::rekdf(const std::string& masterPassword, const Crypto::KdfParams& params) {
+	if (!hasKey_) return VaultStatus::Locked;
+	if (!Crypto::kdfInBounds(params)) return VaultStatus::BadKdf;
+	if (!opensWith(masterPassword)) return VaultStatus::AuthFailed;
+
+	Crypto::KdfParams kdf;
+	std::vector<unsigned char> wrapped;
+	if (const VaultStatus st = wrapFor(masterPassword, params, kdf, wrapped); st != VaultStatus::Ok) return st;
+
+	kdf_ = std::move(kdf);
+	wrappedKey_ = std::move(wrapped);
+	headerDirty_ = true;
+	return VaultStatus::Ok;
+}
+
+// New master password, same KDF cost. current may be any slot's secret, so a
+// recovery key can set a forgotten password.
+VaultStatus Vault::changePassword(const std::string& current, const std::string& next) {
+	if (!hasKey_) return VaultStatus::Locked;
+	if (!opensWith(current)) return VaultStatus::AuthFailed;
+
+	Crypto::KdfParams kdf;
+	std::vector<unsigned char> wrapped;
+	if (const VaultStatus st = wrapFor(next, kdf_, kdf, wrapped); st != VaultStatus::Ok) return st;
+
+	kdf_ = std::move(kdf);
+	wrappedKey_ = std::move(wrapped);
+	headerDirty_ = true;
+	return VaultStatus::Ok;
+}
+
+VaultStatus Vault::addSlot(const std::string& current, const std::string& label, const std::string& secret, const Crypto::KdfParams& params) {
+	if (!hasKey_) return VaultStatus::Locked;
+	if (label.empty() || label == kPasswordSlot) return VaultStatus::BadSlot;
+	if (!opensWith(current)) return VaultStatus::AuthFailed;
+
+	// slots only exist alongside a wrapped password slot
+	if (wrappedKey_.empty()) {
+		Crypto::KdfParams kdf;
+		std::vector<unsigned char> wrapped;
+		if (const VaultStatus st = wrapFor(current, kdf_, kdf, wrapped); st != VaultStatus::Ok) return st;
+		kdf_ = std::move(kdf);
+		wrappedKey_ = std::move(wrapped);
+	}
+
+	KeySlot slot{ label, {}, {} };
+	if (const VaultStatus st = wrapFor(secret, params, slot.kdf, slot.wrapped); st != VaultStatus::Ok) return st;
+
+	auto it = std::find_if(slots_.begin(), slots_.end(), [&](const KeySlot& k) { return k.label == label; });
+	if (it != slots_.end()) *it = std::move(slot);
+	else slots_.push_back(std::move(slot));
+	headerDirty_ = true;
+	return VaultStatus::Ok;
+}
+
+VaultStatus Vault::removeSlot(const std::string& label) {
+	auto it = std::find_if(slots_.begin(), slots_.end(), [&](const KeySlot& k) { return k.label == label; });
+	if (it == slots_.end()) return VaultStatus::BadSlot;
+	slots_.erase(it);
+	headerDirty_ = true;
+	return VaultStatus::Ok;
+}
+
+// header change plus a rewrite of every record (with or without a dictionary)
+bool Vault::setCompression(bool on, int level) {
+	if (level < Compressor::minLevel() || level > Compressor::maxLevel()) return false;
+	if (on == compress_ && (!on || level == compressLevel_)) return true;
+	compress_ = on;
+	compressLevel_ = level;
+	headerDirty_ = true;
+	needsRewrite_ = true;
+	return true;
+}
+
+std::vector<std::string> Vault::slotLabels() const {
+	std::vector<std::string> out{ kPasswordSlot };
+	for (const auto& slot : slots_) out.push_back(slot.label);
+	return out;
 }
 
 // Add entry to vault
 void Vault::addEntry(const Entry& entry) {
-	entries.push_back(entry);
+	storeEntry(entry);
+	reclaimArena();
+}
+
+// copy entry into the arena and the indexes, queueing its put record
+void Vault::storeEntry(const Entry& entry) {
+	// the password is kept only as its own sealed copy (unless there's no
+	// key to seal it with yet); entries replayed from records arrive sealed
+	std::string sealed(entry.sealedPassword);
+	const bool split = !sealed.empty() || (hasKey_ && sealSecret(secretKey_, entry, entry.password, sealed));
+
+	// copy the caller's bytes into locked memory, keep only views
+	arena_.reserve(entry.site.size() + entry.username.size() + (split ? sealed.size() : entry.password.size()));
+	Entry stored{ arena_.store(entry.site), arena_.store(entry.username) };
+	if (split) stored.sealedPassword = arena_.store(sealed);
+	else stored.password = arena_.store(entry.password);
+
+	entries.push_back(stored);
+	index_.insert(stored.site, entries.size() - 1);
+	searchStale_ = true;
+	if (split) pending_.push_back({ FramePut, encodeMeta(stored), blindTags(indexKey_, stored.site), std::move(sealed) });
+	else pending_.push_back({ FramePut, encodeEntry(stored), blindTags(indexKey_, stored.site), {} });
+}
+
+// Add many entries, deduplicating against the site index
+size_t Vault::addEntries(std::span<const Entry> batch) {
+	size_t bytes = 0;
+	for (const auto& e : batch) bytes += e.site.size() + e.username.size() + std::max(e.sealedPassword.size(), sealedLength(e.password.size()));
+	arena_.reserve(bytes); // one chunk for the whole batch
+	entries.reserve(entries.size() + batch.size());
+	pending_.reserve(pending_.size() + batch.size());
+
+	size_t added = 0;
+	for (const auto& e : batch) {
+		bool dup = false;
+		for (const auto& have : findSite(std::string(e.site))) {
+			if (have.site == e.site && have.username == e.username) { dup = true; break; }
+		}
+		if (dup) continue;
+
+		storeEntry(e); // batch entries may be views into arena_
+		++added;
+	}
+	reclaimArena();
+	return added;
+}
+
+// removed entries and replaced passwords leave wiped bytes behind that the
+// bump allocator never hands out again; copy the live ones into a fresh
+// arena once those outweigh them, so a long-lived vault stays bounded
+void Vault::reclaimArena() {
+	if (arena_.bytesUsed() < arenaCheckAt_) return;
+
+	size_t live = 0;
+	for (const auto& e : entries) live += e.site.size() + e.username.size() + e.password.size() + e.sealedPassword.size();
+	if (arena_.bytesUsed() - live > live) {
+		SecureArena fresh;
+		fresh.reserve(live);
+		for (auto& e : entries) {
+			e.site = fresh.store(e.site);
+			e.username = fresh.store(e.username);
+			e.password = fresh.store(e.password);
+			e.sealedPassword = fresh.store(e.sealedPassword);
+		}
+		arena_ = std::move(fresh); // wipes and frees the old chunks
+	}
+	arenaCheckAt_ = std::max(2 * live, kArenaMinReclaim);
+}
+
+// wipe queued record plaintexts
+void Vault::clearPending() {
+	for (auto& op : pending_) wipeString(op.plain);
+	pending_.clear();
 }
 
 // Save vault to disk, encrypting its entries.
-bool Vault::save() const {
+VaultStatus Vault::save() {
+
+	if (!hasKey_) return VaultStatus::Locked;
+	PM_TIME(Save);
 
-	if (!hasKey_) {
-		lastError_ = "Key is not derived; call initNew() or load() first."; return false;
+	// join the queue for this file: a save already writing takes us along
+	// with its next batch, otherwise we lead one
+	CommitQueue& q = commitQueueFor(filePath);
+	CommitRequest self{ this };
+	std::unique_lock<std::mutex> lk(q.mutex);
+	q.waiting.push_back(&self);
+	q.cv.wait(lk, [&]() { return self.done || !q.leading; });
+	if (self.done) return self.status;
+
+	q.leading = true;
+	std::vector<CommitRequest*> batch;
+	batch.swap(q.waiting);
+	lk.unlock();
+
+	// whatever happens the followers must be released
+	auto release = [&]() {
+		lk.lock();
+		q.leading = false;
+		for (auto* r : batch) r->done = true;
+		q.cv.notify_all();
+		lk.unlock();
+	};
+	try { commitBatch(filePath, batch); }
+	catch (...) {
+		for (auto* r : batch) r->status = VaultStatus::WriteFailed;
+		release();
+		throw;
 	}
+	release();
+	return self.status;
+}
 
-	// serialize via plaintext to json
-	nlohmann::json arr = nlohmann::json::array();
-	for (const auto& e : entries) arr.push_back(e);
-	std::string plaintext = arr.dump();
+VaultStatus Vault::refresh() {
+	if (!hasKey_) return VaultStatus::Locked;
 
-	const_cast<std::vector<unsigned char>&>(nonce) =
-	Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES); // new nonce generated
+	// the lock keeps us from reading another writer's append half done
+	WriteLock lock(filePath);
+	if (!lock.locked()) return VaultStatus::LockFailed;
+	return refreshIfChanged();
+}
 
+// Group commit, run by the leader. Vaults that only append have their
+// records sealed into one buffer, written with a single append and fsync.
+// A vault that needs a rewrite or a header change flushes the buffer first
+// and then saves on its own.
+void Vault::commitBatch(const std::string& path, const std::vector<CommitRequest*>& batch) {
+	// writers take turns; readers never lock and only ever see whole files
+	WriteLock lock(path);
+	if (!lock.locked()) {
+		for (auto* r : batch) r->status = VaultStatus::LockFailed;
+		return;
+	}
 
-	// Encrypt, attach to header
-	std::string ctB64;
-	if (!Crypto::encrypt(key, nonce, plaintext, ctB64)) {
-		lastError_ = "Encryption failed.";
+	std::string out;
+	std::vector<Vault*> appended;
+	std::vector<CommitRequest*> requests;
+	auto flush = [&]() {
+		if (appended.empty()) return;
+		if (out.empty() || appendFile(path, out)) catchUp(appended);
+		else for (auto* r : requests) r->status = VaultStatus::WriteFailed;
+		out.clear();
+		appended.clear();
+		requests.clear();
+	};
 
-		if (!plaintext.empty()) Crypto::secureZero(plaintext.data(), plaintext.size());
-		return false;
+	for (auto* r : batch) {
+		Vault& v = *r->vault;
+		VaultStatus st = v.refreshIfChanged();
+		if (st == VaultStatus::Ok && !v.needsRewrite_ && !v.headerDirty_ && !v.compactionDue()) {
+			std::string records;
+			if (v.sealPending(records)) {
+				out += records;
+				appended.push_back(&v);
+				requests.push_back(r);
+				continue;
+			}
+			st = VaultStatus::CryptoFailed;
+		}
+		else if (st == VaultStatus::Ok) {
+			flush();
+			st = v.writeLocked();
+		}
+		r->status = st;
 	}
+	flush();
+}
 
+// After a group append every member has its own records but not the
+// others'. All of them were refreshed against the same file, so applying
+// the others' records brings each one up to the file without a reload,
+// unless a tombstone in the group hits a site another member put: the two
+// don't commute, so those members keep their old stamp and reload on their
+// next save.
+void Vault::catchUp(const std::vector<Vault*>& group) {
+	const FileStamp now = stampOf(group.front()->filePath);
 
-	nlohmann::json root = makeHeaderJson();
-	root["ciphertext_b64"] = ctB64;
+	std::vector<size_t> counts;
+	size_t records = 0;
+	for (const Vault* v : group) {
+		counts.push_back(v->pending_.size());
+		records += v->pending_.size();
+	}
 
-	// write file
-	bool ok = writeAllText(filePath, root.dump(2));
+	std::vector<SiteTouches> touches(group.size());
+	for (size_t i = 0; i < group.size(); ++i) {
+		for (const auto& op : group[i]->pending_) touches[i].add(op.kind == FrameDel, op.tags);
+	}
+	bool exact = true;
+	for (size_t i = 0; i < group.size(); ++i) {
+		for (size_t j = i + 1; j < group.size(); ++j) exact = exact && touches[i].commutesWith(touches[j]);
+	}
 
-	// scrub plaintext
-	if (!plaintext.empty()) Crypto::secureZero(plaintext.data(), plaintext.size());
+	for (size_t j = 0; j < group.size(); ++j) {
+		Vault& v = *group[j];
+		VaultStatus st = VaultStatus::Ok;
+		for (size_t i = 0; i < group.size() && exact && st == VaultStatus::Ok; ++i) {
+			if (i == j) continue;
+			for (size_t k = 0; k < counts[i] && st == VaultStatus::Ok; ++k) st = v.replay(group[i]->pending_[k]);
+		}
+		v.fileRecords_ += records;
+		// otherwise the stamp still names the file before the append, and
+		// with the end unknown the next save reloads it whole
+		if (exact && st == VaultStatus::Ok) {
+			v.stamp_ = now;
+			v.fileEnd_ = now.size;
+		}
+		else v.fileEnd_ = 0;
+	}
+	// replay queued the applied records again: drop them with our own
+	for (Vault* v : group) v->clearPending();
+}
 
-	if (!ok) lastError_ = "Failed to write vault file.";
-	return ok;
+// dead records = superseded puts + tombstones, once appended
+bool Vault::compactionDue() const {
+	const size_t total = fileRecords_ + pending_.size();
+	const size_t waste = total > entries.size() ? total - entries.size() : 0;
+	const size_t tail = total > rewriteRecords_ ? total - rewriteRecords_ : 0;
+	// a bulk batch over a small rewrite (an import into a new vault) is
+	// appended as is; the save after it folds it into the paged region
+	const bool tailFiled = rewriteRecords_ >= kCompactMinTail || fileRecords_ > rewriteRecords_;
+	// a vault that outgrew writing plain records gets its first dictionary
+	const bool untrained = compress_ && !codec_.ready() && entries.size() >= Compressor::kMinSamples && tail >= Compressor::kMinSamples;
+	return (waste >= kCompactMinWaste && waste > entries.size()) || (tailFiled && tail >= kCompactMinTail && tail * kCompactTailShare >= rewriteRecords_) || untrained;
 }
 
-// Securely load vault from disk, derive key, and decrypt entries
-bool Vault::load(const std::string& masterPassword) {
-	std::string text;
-	if (!readAllText(filePath, text)) {
-		lastError_ = "Could not open vault file: " + filePath;
-		return false;
+// One vault's save on its own; the caller holds the write lock.
+VaultStatus Vault::writeLocked() {
+	if (const VaultStatus st = refreshIfChanged(); st != VaultStatus::Ok) return st;
+
+	VaultStatus st = VaultStatus::Ok;
+	if (needsRewrite_ || compactionDue()) st = rewriteAll();
+	else {
+		if (headerDirty_) st = writeHeaderInPlace();
+		if (st == VaultStatus::Ok && !pending_.empty()) st = appendPending();
 	}
 
-	nlohmann::json root;
-	try { root = nlohmann::json::parse(text); } // parse json for decryption
+	if (st == VaultStatus::Ok) stamp_ = stampOf(filePath);
+	return st;
+}
+
+// Reload and replay when the file on disk is no longer the one we last saw.
+VaultStatus Vault::refreshIfChanged() {
+	if (!stamp_.valid) return VaultStatus::Ok; // new vault, nothing to merge
+	const FileStamp now = stampOf(filePath);
+	if (!now.valid) return VaultStatus::Ok;
+	// in-place header updates keep size and inode: compare the sequence too.
+	// A partial load always reloads: the write needs every entry.
+	if (!partial_ && now.device == stamp_.device && now.inode == stamp_.inode && diskHeaderSeq() == headerSeq_) {
+		if (fileEnd_ != 0 ? now.size == fileEnd_ : now == stamp_) {
+			stamp_ = now;
+			return VaultStatus::Ok;
+		}
+		// other writers only appended: read just their records
+		if (fileEnd_ != 0 && now.size > fileEnd_) {
+			bool applied = false;
+			const VaultStatus st = readTail(now, applied);
+			if (st != VaultStatus::Ok || applied) return st;
+		}
+	}
 
-	catch (...) { lastError_ = "Vault is not valid JSON."; return false; }
+	std::vector<PendingOp> ops = std::move(pending_);
+	pending_.clear();
 
-	if (!parseHeaderFromJson(root)) {
-		lastError_ = "Vault header is invalid (salt/nonce/version).";
-		return false;
+	// our own header change (rekdf, passwd, slots, compression) wins over the file's
+	Crypto::KdfParams kdf = kdf_;
+	std::vector<unsigned char> wrapped = wrappedKey_;
+	std::vector<KeySlot> slots = slots_;
+	const bool compress = compress_;
+	const int level = compressLevel_;
+	const bool keepHeader = headerDirty_;
+
+	// the data key outlives password / KDF changes by other writers
+	std::vector<unsigned char> k = key;
+	VaultStatus st = loadWith([&](const Crypto::KdfParams&, std::vector<unsigned char>& outKey) { outKey = k; return true; }, true);
+	Crypto::secureZero(k.data(), k.size());
+
+	if (st == VaultStatus::Ok && keepHeader) {
+		kdf_ = std::move(kdf);
+		wrappedKey_ = std::move(wrapped);
+		slots_ = std::move(slots);
+		if (compress != compress_ || level != compressLevel_) needsRewrite_ = true;
+		compress_ = compress;
+		compressLevel_ = level;
+		headerDirty_ = true;
 	}
-		
-	if (!deriveKey(masterPassword)) {
-		lastError_ = "Key derivation failed (argon2id).";
-		return false;
+
+	for (size_t i = 0; i < ops.size() && st == VaultStatus::Ok; ++i) st = replay(ops[i]);
+	for (auto& op : ops) wipeString(op.plain);
+	return st;
+}
+
+// Records appended after fileEnd_ by other writers, applied on top of our
+// entries without reloading the rest. Only when they commute with our
+// pending mutations (which the file will get after them); otherwise, or
+// for anything but indexed puts / tombstones, applied stays false and the
+// caller reloads the whole file.
+VaultStatus Vault::readTail(const FileStamp& now, bool& applied) {
+	applied = false;
+
+	FrameReader reader;
+	const unsigned char* header = nullptr;
+	size_t headerLen = 0;
+	HeaderInfo info;
+	if (!reader.open(filePath) || !reader.isMapped() || !reader.isV2() || !reader.readHeader(header, headerLen) ||
+		!decodeHeaderRegion(header, headerLen, info) || info.seq != headerSeq_ || !reader.seek(fileEnd_)) return VaultStatus::Ok;
+
+	struct Op {
+		std::uint8_t kind;
+		Entry entry; // puts
+		std::string_view site; // tombstones
+	};
+	std::vector<Op> ops;
+	SecureArena tail; // adopted once the records are applied
+	SiteTouches theirs;
+	bool eager = false;
+
+	std::string plaintext;
+	std::string unpacked;
+	Compressor::Workspace ws;
+	std::string_view password;
+	auto addLoaded = [&](const Entry& e) {
+		Entry loaded = e;
+		if (!password.empty()) loaded.sealedPassword = tail.store(password);
+		else eager = true;
+		ops.push_back({ FramePut, loaded, {} });
+	};
+
+	VaultStatus st = VaultStatus::Ok;
+	for (;;) {
+		std::uint8_t kind = 0;
+		const unsigned char* data = nullptr;
+		size_t len = 0;
+		const FrameReader::Status rs = reader.next(kind, data, len);
+		if (rs == FrameReader::Status::End) break;
+
+		IndexedFrame ix;
+		if (rs != FrameReader::Status::Ok || (kind != FramePutIndexed && kind != FrameDelIndexed && kind != FramePutSplit) || !splitIndexed(data, len, ix)) {
+			wipeString(plaintext);
+			return VaultStatus::Ok;
+		}
+		theirs.add(kind == FrameDelIndexed, std::string_view(reinterpret_cast<const char*>(ix.tags), ix.tagCount * kBlindTagBytes));
+
+		const std::uint8_t frameKind = kind;
+		st = openRecord(key, nonce, kind, data, len, plaintext, password);
+		if (st != VaultStatus::Ok) break;
+		if (kind == FramePut) {
+			const std::string* text = unpackRecord(codec_, ws, plaintext, unpacked);
+			if (!text || !parseEntries(*text, tail, addLoaded, frameKind == FramePutSplit)) st = VaultStatus::Corrupt;
+			Crypto::secureZero(unpacked.data(), unpacked.size());
+		}
+		else ops.push_back({ FrameDel, {}, tail.store(plaintext) });
+		Crypto::secureZero(plaintext.data(), plaintext.size());
+		if (st != VaultStatus::Ok) break;
+	}
+	wipeString(plaintext);
+	wipeString(unpacked);
+	if (st != VaultStatus::Ok) return st;
+
+	SiteTouches mine;
+	for (const auto& op : pending_) mine.add(op.kind == FrameDel, op.tags);
+	if (!mine.commutesWith(theirs)) return VaultStatus::Ok;
+
+	for (const auto& op : ops) {
+		if (op.kind == FramePut) {
+			entries.push_back(op.entry);
+			index_.insert(op.entry.site, entries.size() - 1);
+		}
+		else {
+			eraseSite(std::string(op.site));
+			SecureArena::wipe(op.site);
+		}
+	}
+	searchStale_ = true;
+	arena_.adopt(std::move(tail));
+	if (eager) needsRewrite_ = true; // seal their passwords on our next rewrite
+	fileRecords_ += ops.size();
+	fileEnd_ = reader.offset();
+	stamp_ = now;
+	applied = true;
+	return VaultStatus::Ok;
+}
+
+// apply a queued mutation again (queueing it anew)
+VaultStatus Vault::replay(const PendingOp& op) {
+	if (op.kind == FrameDel) {
+		removeBySite(op.plain);
+		return VaultStatus::Ok;
+	}
+	// split puts queued their sealed password beside the record
+	SecureArena scratch; // addEntry copies into arena_
+	auto add = [&](const Entry& e) { Entry r = e; r.sealedPassword = op.secret; addEntry(r); };
+	return parseEntries(op.plain, scratch, add, !op.secret.empty()) ? VaultStatus::Ok : VaultStatus::Corrupt;
+}
+
+// Write header plus one sealed record per live entry, replacing the file.
+// Entries are serialized and sealed in contiguous segments on the thread
+// pool; each segment is an independent run of frames written out in order.
+// The tag index and page tree follow the records, and the check record in
+// front of them seals the tree's root.
+VaultStatus Vault::rewriteAll() {
+	if (!sealEager()) return VaultStatus::CryptoFailed;
+	nonce = Crypto::randomBytes(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES); // new nonce generated
+
+	// a fresh dictionary for every rewrite, sealed in front of the records
+	if (compress_) trainOn(entries, compressLevel_, codec_);
+	else codec_.clear();
+	std::string dictFrame;
+	if (codec_.ready()) {
+		std::string dict(codec_.dictionary());
+		const bool ok = putRecord(dictFrame, key, FrameDict, dict);
+		wipeString(dict);
+		if (!ok) return VaultStatus::CryptoFailed;
+	}
+
+	const size_t segCount = segmentsFor(entries.size());
+	std::vector<std::string> segs(segCount);
+	std::vector<std::vector<TagRef>> refs(segCount); // offsets within the segment
+	std::vector<char> failed(segCount, 0);
+	std::vector<std::uint64_t> saved(segCount, 0); // bytes compression took off
+
+	ThreadPool::shared().run(segCount, [&](size_t s) {
+		const size_t first = entries.size() * s / segCount;
+		const size_t last = entries.size() * (s + 1) / segCount;
+		std::string& out = segs[s];
+		refs[s].reserve((last - first) * (1 + kBlindPrefixMax));
+		Compressor::Workspace ws;
+		std::string packed;
+
+		for (size_t i = first; i < last; ++i) {
+			// serialize via plaintext to json
+			std::string plaintext = encodeMeta(entries[i]);
+			const std::string tags = blindTags(indexKey_, entries[i].site);
+			addTagRefs(refs[s], tags, out.size());
+			const bool small = codec_.ready() && codec_.compress(ws, plaintext, packed);
+			if (small) saved[s] += plaintext.size() - packed.size();
+			const bool ok = putSplitRecord(out, key, small ? packed : plaintext, tags, entries[i].sealedPassword);
+			wipeString(plaintext);
+			if (!ok) { failed[s] = 1; break; }
+		}
+		wipeString(packed);
+	});
+
+	if (std::find(failed.begin(), failed.end(), 1) != failed.end()) return VaultStatus::CryptoFailed;
+
+	// offsets count from the frame after the check record (the dictionary
+	// or the first record), so they hold whatever the header and check
+	// record in front of them grow to
+	std::vector<TagRef> all;
+	std::uint64_t base = dictFrame.size();
+	std::uint64_t plain = 0;
+	for (size_t s = 0; s < segCount; ++s) {
+		for (auto& r : refs[s]) all.push_back({ r.tag, r.offset + base });
+		base += segs[s].size();
+		plain += segs[s].size() + saved[s];
+		refs[s] = {};
 	}
 
+	PageLayout pages;
+	pages.pageBytes = kPageBytes;
+	pages.index = base;
+	std::string index;
+	if (!putTagIndex(index, all)) return VaultStatus::CryptoFailed;
+	pages.end = base + index.size();
+
+	std::string tree;
+	{
+		PM_TIME(Serialize);
+		std::vector<std::string_view> region{ dictFrame };
+		region.insert(region.end(), segs.begin(), segs.end());
+		region.push_back(index);
+		if (!putPageTree(tree, pageKey_, region, pages.root)) return VaultStatus::CryptoFailed;
+	}
+
+	std::string head = makeHead();
+
+	// the check record carries the record count so a body cut short at a
+	// frame boundary is detected on load
+	if (!putRecord(head, key, FrameCheck, encodeCheck(entries.size(), pages))) return VaultStatus::CryptoFailed;
+
+	// write file (temp + fsync + rename)
+	segs.insert(segs.begin(), std::move(dictFrame));
+	segs.insert(segs.begin(), std::move(head));
+	segs.push_back(std::move(index));
+	segs.push_back(std::move(tree));
+	if (!replaceFile(filePath, segs)) return VaultStatus::WriteFailed;
+
+	fileEnd_ = 0;
+	for (const auto& part : segs) fileEnd_ += part.size();
+	fileRecords_ = entries.size();
+	rewriteRecords_ = entries.size();
+	rewriteWritten_ = pages.index;
+	rewritePlain_ = plain;
+	needsRewrite_ = false;
+	headerDirty_ = false;
+	formatVersion_ = 2;
+	clearPending();
+	return VaultStatus::Ok;
+}
+
+// Entries loaded from records written before passwords were sealed on their
+// own hold the plaintext; seal it (and wipe the plaintext) before writing.
+bool Vault::sealEager() {
+	std::string sealed;
+	for (auto& e : entries) {
+		if (!e.sealedPassword.empty()) continue;
+		if (!sealSecret(secretKey_, e, e.password, sealed)) return false;
+		SecureArena::wipe(e.password);
+		e.password = {};
+		e.sealedPassword = arena_.store(sealed);
+	}
+	return true;
+}
+
+// Header-only change: copy the record frames verbatim behind the new
+// header, so no record is decrypted or re-sealed.
+VaultStatus Vault::rewriteHeader() {
+	FrameReader reader;
+	if (!reader.open(filePath) || !reader.isV2()) return VaultStatus::OpenFailed;
+
+	const unsigned char* oldHeader = nullptr;
+	size_t oldHeaderLen = 0;
+	if (!reader.readHeader(oldHeader, oldHeaderLen)) return VaultStatus::Truncated;
+
+	std::string body;
+	body.reserve(reader.sizeHint());
+	for (;;) {
+		std::uint8_t kind = 0;
+		const unsigned char* data = nullptr;
+		size_t len = 0;
+		// a torn tail is dropped here just as load drops it
+		if (reader.next(kind, data, len) != FrameReader::Status::Ok) break;
+		putFrame(body, kind, data, len);
+	}
+
+	const std::string head = makeHead();
+	if (!replaceFile(filePath, { head, body })) return VaultStatus::WriteFailed;
+	fileEnd_ = head.size() + body.size();
+	headerDirty_ = false;
+	return VaultStatus::Ok;
+}
+
+// Overwrite the header region's two copies one at a time: the stale copy
+// first (readers and crashes fall back to the current one while it is
+// written), then the current one so the old wrapping leaves the file.
+VaultStatus Vault::writeHeaderInPlace() {
+	if (headerCapacity_ == 0) return rewriteHeader(); // plain JSON header: convert
+
+	const std::string json = makeHeaderJson().dump();
+	const int stale = 1 - headerCopy_;
+
+	std::string copy = encodeHeaderCopy(json, headerSeq_ + 1, headerCapacity_);
+	if (copy.empty()) return rewriteHeader(); // outgrew the region: copy path resizes it
+	if (!writeAt(filePath, kHeaderRegionOffset + stale * headerCapacity_, copy)) return VaultStatus::WriteFailed;
+	headerSeq_ += 1;
+	headerCopy_ = stale;
+
+	copy = encodeHeaderCopy(json, headerSeq_ + 1, headerCapacity_);
+	if (!writeAt(filePath, kHeaderRegionOffset + (1 - stale) * headerCapacity_, copy)) return VaultStatus::WriteFailed;
+	headerSeq_ += 1;
+	headerCopy_ = 1 - stale;
+
+	headerDirty_ = false;
+	return VaultStatus::Ok;
+}
+
+// magic, region length and a fresh header region (both copies current)
+std::string Vault::makeHead() {
+	PM_TIME(Serialize);
+	const std::string region = encodeHeaderRegion(makeHeaderJson().dump(), ++headerSeq_);
+	headerCapacity_ = region.size() / 2;
+	headerCopy_ = 0;
+
+	std::string head;
+	head.append(kMagic, sizeof(kMagic));
+	putU32(head, static_cast<std::uint32_t>(region.size()));
+	head.append(region);
+	return head;
+}
+
+// sequence of the newest header on disk, 0 for plain or unreadable headers
+std::uint64_t Vault::diskHeaderSeq() const {
+	FrameReader reader;
+	const unsigned char* region = nullptr;
+	size_t len = 0;
+	HeaderInfo info;
+	if (!reader.open(filePath) || !reader.isV2() || !reader.readHeader(region, len) || !decodeHeaderRegion(region, len, info)) return 0;
+	return info.seq;
+}
+
+// frames for the mutations made since the last save
+bool Vault::sealPending(std::string& out) const {
+	// split puts (site / username only) go out compressed against the
+	// dictionary of the file's last rewrite
+	Compressor::Workspace ws;
+	std::string packed;
+	for (const auto& op : pending_) {
+		bool ok = false;
+		if (op.secret.empty()) ok = putIndexedRecord(out, key, op.kind, op.plain, op.tags);
+		else {
+			const bool small = codec_.ready() && codec_.compress(ws, op.plain, packed);
+			ok = putSplitRecord(out, key, small ? packed : op.plain, op.tags, op.secret);
+		}
+		if (!ok) { wipeString(packed); return false; }
+	}
+	wipeString(packed);
+	return true;
+}
+
+// Append sealed records for mutations made since the last save.
+VaultStatus Vault::appendPending() {
+	std::string out;
+	if (!sealPending(out)) return VaultStatus::CryptoFailed;
+
+	// whole records in one write: a concurrent reader sees at most a torn
+	// last frame, which it drops
+	if (!appendFile(filePath, out)) return VaultStatus::WriteFailed;
+
+	if (fileEnd_ != 0) fileEnd_ += out.size();
+	fileRecords_ += pending_.size();
+	clearPending();
+	return VaultStatus::Ok;
+}
+
+// Securely load vault from disk, derive key, and decrypt entries
+VaultStatus Vault::load(const std::string& masterPassword) {
+	return load([&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		return Crypto::deriveKey(masterPassword, kdf, outKey);
+	});
+}
+
+// Load with a key supplied by the caller once the header (salt / limits) is known
+VaultStatus Vault::load(const KeyProvider& keyFor) {
+	return loadWith(keyFor, false);
+}
+
+VaultStatus Vault::loadMatching(const KeyProvider& keyFor, const std::string& query, bool prefix) {
+	const LoadFilter filter{ query, prefix };
+	return loadWith(keyFor, false, &filter);
+}
+
+VaultStatus Vault::loadWith(const KeyProvider& keyFor, bool dataKey, const LoadFilter* filter) {
+	PM_TIME(Load);
+	// stamp before reading: a write racing the read makes the next save
+	// reload instead of being missed
+	stamp_ = stampOf(filePath);
+
+	// a filtered load reads a few scattered pages of a paged file
+	FrameReader reader;
+	if (!reader.open(filePath, filter ? MappedFile::Access::Random : MappedFile::Access::Sequential)) return VaultStatus::OpenFailed;
+
+	// binary files start with the magic and are streamed record by record,
+	// anything else is treated as legacy JSON and read whole
+	partial_ = false;
+	if (reader.isV2()) return loadV2(reader, keyFor, dataKey, filter);
+
+	std::string data;
+	fileEnd_ = 0;
+	if (!reader.readAll(data)) return VaultStatus::OpenFailed;
+	return loadV1(data, keyFor, dataKey);
+}
+
+// Legacy format: pretty-printed JSON header with base64 ciphertext inside.
+VaultStatus Vault::loadV1(const std::string& text, const KeyProvider& keyFor, bool dataKey) {
+	nlohmann::json root;
+	try { PM_TIME(Parse); root = nlohmann::json::parse(text); } // parse json for decryption
+
+	catch (...) { return VaultStatus::BadHeader; }
+
+	if (!parseHeaderFromJson(root) || formatVersion_ != 1) return VaultStatus::BadHeader;
+	headerSeq_ = 0;
+	headerCapacity_ = 0;
+	clearPending();
+	codec_.clear();
+	needsRewrite_ = true;
+		
+	if (const VaultStatus st = obtainKey(keyFor, dataKey); st != VaultStatus::Ok) return st;
+	headerDirty_ = false;
+
 	std::string ctB64 = root.value("ciphertext_b64", "");
 
-	if (ctB64.empty()) { entries.clear(); return true; }
+	if (ctB64.empty()) { entries.clear(); index_.clear(); arena_.clear(); searchStale_ = true; return VaultStatus::Ok; }
 
 	std::string plaintext;
-	if (!Crypto::decrypt(key, nonce, ctB64, plaintext)) {
-		lastError_ = "Decryption failed. Wrong password or corrupted file.";
+	bool opened = false;
+	{
+		PM_TIME(Decrypt);
+		PM_COUNT(RecordsOpened, 1);
+		opened = Crypto::decrypt(key, nonce, ctB64, plaintext);
+	}
+	if (!opened) {
 		if (!plaintext.empty()) Crypto::secureZero(plaintext.data(), plaintext.size());
-		return false;
+		return VaultStatus::AuthFailed;
 	}
 
-	try {
-		auto arr = nlohmann::json::parse(plaintext);
-		entries = arr.get<std::vector<Entry>>();
-	}
-	catch (...) {
-		lastError_ = "Decrypted data isn't valid JSON.";
+	entries.clear();
+	index_.clear();
+	searchStale_ = true;
+	arena_.clear();
+	arena_.reserve(plaintext.size()); // one allocation for every entry
+	if (!parseEntries(plaintext, arena_, [&](const Entry& e) { entries.push_back(e); })) {
 		if (!plaintext.empty()) Crypto::secureZero(plaintext.data(), plaintext.size());
-		return false;
+		return VaultStatus::Corrupt;
+	}
+	{
+		PM_TIME(Index);
+		index_.rebuild(entries);
 	}
-
 
 	if (!plaintext.empty()) Crypto::secureZero(plaintext.data(), plaintext.size());
-	return true;
+	return VaultStatus::Ok;
+}
+
+// Binary format: length-prefixed header followed by sealed record frames,
+// decrypted and parsed one record at a time as they are read.
+VaultStatus Vault::loadV2(FrameReader& reader, const KeyProvider& keyFor, bool dataKey, const LoadFilter* filter) {
+	const unsigned char* header = nullptr;
+	size_t headerLen = 0;
+	if (!reader.readHeader(header, headerLen)) return VaultStatus::Truncated;
+
+	HeaderInfo info;
+	if (!decodeHeaderRegion(header, headerLen, info)) return VaultStatus::BadHeader;
+
+	// parsed in place (mapping or read buffer), no intermediate string
+	nlohmann::json root;
+	try { PM_TIME(Parse); root = nlohmann::json::parse(info.json, info.json + info.jsonLen); }
+	catch (...) { return VaultStatus::BadHeader; }
+
+	if (!parseHeaderFromJson(root) || formatVersion_ != 2) return VaultStatus::BadHeader;
+	headerSeq_ = info.seq;
+	headerCapacity_ = info.halfCapacity;
+	headerCopy_ = info.half;
+
+	if (const VaultStatus st = obtainKey(keyFor, dataKey); st != VaultStatus::Ok) return st;
+	headerDirty_ = false;
+
+	entries.clear();
+	index_.clear();
+	searchStale_ = true;
+	arena_.clear();
+	clearPending();
+	codec_.clear();
+	fileRecords_ = 0;
+	rewriteRecords_ = 0;
+	fileEnd_ = 0;
+	needsRewrite_ = false;
+
+	// with a filter, indexed records without the query's tag are skipped
+	// unopened (counted for the truncation check); unindexed ones are opened
+	const std::string match = filter ? blindQuery(indexKey_, filter->query, filter->prefix) : std::string();
+	partial_ = !match.empty();
+	size_t skippedPuts = 0;
+
+	// a paged file hands over just the matching records and its tail
+	PagedHits hits;
+	if (partial_ && reader.isMapped()) {
+		if (const VaultStatus st = findPaged(reader, key, nonce, pageKey_, match, hits); st != VaultStatus::Ok) return st;
+		if (hits.paged) {
+			skippedPuts = hits.records - hits.matches;
+			fileRecords_ = skippedPuts;
+		}
+	}
+	size_t nextSeek = 0;
+
+	// Frames are read serially in batches, opened and parsed in parallel
+	// segments (each into a private arena), then applied in file order since
+	// a tombstone only removes the puts before it.
+	struct Frame {
+		std::uint8_t kind;
+		const unsigned char* data;
+		size_t len;
+		size_t off; // into copies when streaming
+	};
+	std::vector<Frame> batch;
+	std::vector<unsigned char> copies; // stream buffer is reused per frame
+	size_t expected = 0; // records promised by the check record
+	size_t puts = 0;
+	bool sawFrame = false;
+	bool torn = false;
+	bool end = false;
+
+	while (!end) {
+		batch.clear();
+		copies.clear();
+
+		while (batch.size() < kLoadBatchFrames && copies.size() < kLoadBatchBytes) {
+			std::uint8_t kind = 0;
+			const unsigned char* data = nullptr;
+			size_t len = 0;
+
+			if (nextSeek < hits.seeks.size()) reader.seek(hits.seeks[nextSeek++]);
+			const FrameReader::Status st = reader.next(kind, data, len);
+			if (st == FrameReader::Status::End) { end = true; break; }
+
+			// a torn record at the end is an interrupted append: drop it and
+			// rewrite cleanly on the next save
+			if (st == FrameReader::Status::Torn) {
+				if (!sawFrame && batch.empty()) return VaultStatus::Truncated;
+				needsRewrite_ = true;
+				torn = true;
+				end = true;
+				break;
+			}
+
+			sawFrame = true;
+			// lookup structures of a paged region, nothing to open
+			if (kind == FrameTagIndex || kind == FramePageTree) continue;
+
+			// the dictionary of the records after it: loaded before any of
+			// them is opened
+			if (kind == FrameDict) {
+				std::string dict;
+				std::string_view none;
+				VaultStatus ds = openRecord(key, nonce, kind, data, len, dict, none);
+				if (ds == VaultStatus::Ok && !codec_.load(dict, compressLevel_)) ds = VaultStatus::Corrupt;
+				wipeString(dict);
+				if (ds != VaultStatus::Ok) return ds;
+				continue;
+			}
+			if (!match.empty() && (kind == FramePutIndexed || kind == FrameDelIndexed || kind == FramePutSplit)) {
+				IndexedFrame ix;
+				if (splitIndexed(data, len, ix) && !ix.hasTag(match)) {
+					if (kind != FrameDelIndexed) ++skippedPuts;
+					++fileRecords_;
+					continue;
+				}
+			}
+
+			Frame f{ kind, data, len, 0 };
+			if (!reader.isMapped()) {
+				f.off = copies.size();
+				copies.insert(copies.end(), data, data + len);
+			}
+			batch.push_back(f);
+		}
+		if (batch.empty()) break;
+		if (!reader.isMapped()) {
+			for (auto& f : batch) f.data = copies.data() + f.off;
+		}
+
+		const size_t segCount = segmentsFor(batch.size());
+		std::vector<LoadSegment> segs(segCount);
+
+		ThreadPool::shared().run(segCount, [&](size_t s) {
+			LoadSegment& seg = segs[s];
+			const size_t first = batch.size() * s / segCount;
+			const size_t last = batch.size() * (s + 1) / segCount;
+
+			// plaintext never exceeds the ciphertext, so one arena chunk
+			size_t bytes = 0;
+			for (size_t i = first; i < last; ++i) bytes += batch[i].len;
+			seg.arena.reserve(bytes);
+
+			// split puts: the password is kept sealed, copied as is
+			std::string_view password;
+			auto addLoaded = [&](const Entry& e) {
+				Entry loaded = e;
+				if (!password.empty()) loaded.sealedPassword = seg.arena.store(password);
+				else seg.eager = true;
+				seg.ops.push_back({ FramePut, loaded, {}, 0 });
+			};
+
+			std::string plaintext; // reused for every record
+			std::string unpacked; // decompressed put records
+			Compressor::Workspace ws;
+			for (size_t i = first; i < last && seg.status == VaultStatus::Ok; ++i) {
+				const Frame& f = batch[i];
+
+				std::uint8_t kind = f.kind;
+				seg.status = openRecord(key, nonce, kind, f.data, f.len, plaintext, password);
+				if (seg.status != VaultStatus::Ok) break;
+				if (f.kind == FramePut || f.kind == FrameDel) seg.unindexed = true;
+
+				bool parsed = true;
+				if (kind == FrameBlob || kind == FramePut) {
+					const std::string* text = kind == FramePut ? unpackRecord(codec_, ws, plaintext, unpacked) : &plaintext;
+					parsed = text && parseEntries(*text, seg.arena, addLoaded, f.kind == FramePutSplit);
+					Crypto::secureZero(unpacked.data(), unpacked.size());
+				}
+				else if (kind == FrameDel) {
+					seg.ops.push_back({ FrameDel, {}, seg.arena.store(plaintext), 0 });
+				}
+				else {
+					size_t count = 0;
+					parsed = decodeCheck(plaintext, count);
+					seg.ops.push_back({ FrameCheck, {}, {}, count });
+				}
+				if (kind == FrameBlob) seg.sawBlob = true;
+				else if (kind == FramePut || kind == FrameDel) ++seg.records;
+				if (kind == FramePut) ++seg.puts;
+
+				Crypto::secureZero(plaintext.data(), plaintext.size());
+				if (!parsed) seg.status = VaultStatus::Corrupt;
+			}
+			wipeString(plaintext);
+			wipeString(unpacked);
+		});
+
+		// apply in order; the first failing segment decides the status
+		PM_TIME(Index);
+		for (auto& seg : segs) {
+			if (seg.status != VaultStatus::Ok) return seg.status;
+
+			for (const auto& op : seg.ops) {
+				if (op.kind == FramePut) {
+					entries.push_back(op.entry);
+					index_.insert(op.entry.site, entries.size() - 1);
+				}
+				else if (op.kind == FrameDel) {
+					removeBySite(std::string(op.site));
+					SecureArena::wipe(op.site);
+				}
+				else {
+					expected = std::max(expected, op.count);
+				}
+			}
+			// convert to indexed records with sealed passwords on next save
+			if (seg.sawBlob || seg.unindexed || seg.eager) needsRewrite_ = true;
+			fileRecords_ += seg.records;
+			puts += seg.puts;
+			arena_.adopt(std::move(seg.arena));
+		}
+	}
+
+	// fewer records than the rewrite wrote: the file was cut short
+	if (puts + skippedPuts < expected) return VaultStatus::Truncated;
+	rewriteRecords_ = expected;
+
+	// where records appended by other writers will start
+	fileEnd_ = reader.isMapped() && !torn ? reader.offset() : 0;
+
+	// replayed tombstones must not be queued again
+	clearPending();
+	return VaultStatus::Ok;
 }
 
 // JSON header creation storing vault contents
 nlohmann::json Vault::makeHeaderJson() const {
 	nlohmann::json hdr;
-	hdr["version"] = 1; // version
+	hdr["version"] = 2; // version
 
-	nlohmann::json k;
+	// KDF ops / memory limits and salt of the password slot
+	hdr["kdf"] = kdfToJson(kdf_);
 
-	// KDF ops / memory limits
-	k["opslimit"] = kdf_.opslimit;
-	k["memlimit"] = kdf_.memlimit;
+	// nonce, encoded as base64
+	hdr["nonce_b64"] = Crypto::b64encode(nonce); 
+	if (!wrappedKey_.empty()) hdr["wrapped_key_b64"] = Crypto::b64encode(wrappedKey_);
 
-	// Salt and nonce, encoded as base64
-	k["salt_b64"] = Crypto::b64encode(kdf_.salt); 
-	hdr["kdf"] = k;
+	// put records compressed before sealing (the dictionary is a record)
+	if (compress_) hdr["compression"] = { { "codec", "zstd" }, { "level", compressLevel_ } };
 
-	hdr["nonce_b64"] = Crypto::b64encode(nonce); 
+	// extra unlock slots, each wrapping the same data key
+	if (!slots_.empty()) {
+		nlohmann::json arr = nlohmann::json::array();
+		for (const auto& slot : slots_) {
+			arr.push_back({ { "label", slot.label }, { "kdf", kdfToJson(slot.kdf) }, { "wrapped_key_b64", Crypto::b64encode(slot.wrapped) } });
+		}
+		hdr["slots"] = arr;
+	}
 
 	return hdr;
 }
@@ -189,21 +1499,39 @@ nlohmann::json Vault::makeHeaderJson() const {
 // Parsing the header 
 bool Vault::parseHeaderFromJson(const nlohmann::json& root) {
 	try {
-		if (root.value("version", 0) != 1) return false;
-
-		const auto& kdfJ = root.at("kdf");
-		kdf_.opslimit = kdfJ.at("opslimit").get<unsigned long long>();
-		kdf_.memlimit = kdfJ.at("memlimit").get<std::size_t>();
-
-		const std::string saltB64 = kdfJ.at("salt_b64").get<std::string>();
-		kdf_.salt = Crypto::b64decode(saltB64);
-		if (kdf_.salt.size() != crypto_pwhash_SALTBYTES) return false;
+		const int version = root.value("version", 0);
+		if (version != 1 && version != 2) return false;
+		formatVersion_ = version;
 
+		if (!kdfFromJson(root.at("kdf"), kdf_)) return false;
 
 		const std::string nonceB64 = root.at("nonce_b64").get<std::string>();
 		nonce = Crypto::b64decode(nonceB64);
 		if (nonce.size() != crypto_aead_xchacha20poly1305_ietf_NPUBBYTES) return false;
 
+		// files written before key wrapping have none
+		wrappedKey_ = Crypto::b64decode(root.value("wrapped_key_b64", ""));
+
+		compress_ = root.contains("compression");
+		compressLevel_ = Compressor::kDefaultLevel;
+		if (compress_) {
+			const nlohmann::json& c = root.at("compression");
+			if (c.at("codec").get<std::string>() != "zstd") return false;
+			compressLevel_ = c.at("level").get<int>();
+			if (compressLevel_ < Compressor::minLevel() || compressLevel_ > Compressor::maxLevel()) return false;
+		}
+
+		slots_.clear();
+		if (root.contains("slots")) {
+			for (const auto& j : root.at("slots")) {
+				KeySlot slot;
+				slot.label = j.at("label").get<std::string>();
+				if (!kdfFromJson(j.at("kdf"), slot.kdf)) return false;
+				slot.wrapped = Crypto::b64decode(j.at("wrapped_key_b64").get<std::string>());
+				slots_.push_back(std::move(slot));
+			}
+		}
+
 		return true;
 	}
 	catch (...) {
@@ -213,16 +1541,89 @@ bool Vault::parseHeaderFromJson(const nlohmann::json& root) {
 
 // remove an entry from encrypted vault securely and terminate information.
 size_t Vault::removeBySite(const std::string& site) {
-	auto first_to_remove = std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) { return e.site == site;  });
-	size_t removed = static_cast<size_t>(std::distance(first_to_remove, entries.end()));
+	// copy the site first in case it is a view into an entry that gets wiped
+	const std::string target = site;
+	const size_t removed = eraseSite(target);
+	if (removed > 0) {
+		pending_.push_back({ FrameDel, target, blindTags(indexKey_, target), {} });
+		reclaimArena();
+	}
+	return removed;
+}
 
-	// scrub metadata before deletion
-	for (auto it = first_to_remove; it != entries.end(); ++it) {
-		if (!it->password.empty()) {
-			Crypto::secureZero(it->password.data(), it->password.size());
+// drop every entry of site (exact, case-sensitive match among the
+// case-folded candidates) without queueing a tombstone
+size_t Vault::eraseSite(const std::string& target) {
+	std::vector<size_t> doomed;
+	auto [first, last] = index_.equalRange(target);
+	for (auto it = first; it != last; ++it) {
+		if (entries[it->second].site == target) doomed.push_back(it->second);
+	}
+
+	// swap-remove from the back so earlier positions stay valid
+	std::sort(doomed.begin(), doomed.end(), std::greater<size_t>());
+	for (size_t pos : doomed) {
+		Entry& e = entries[pos];
+		index_.erase(e.site, pos);
+
+		// scrub the arena bytes before dropping the views
+		SecureArena::wipe(e.password);
+		SecureArena::wipe(e.username);
+		SecureArena::wipe(e.site);
+
+		const size_t back = entries.size() - 1;
+		if (pos != back) {
+			index_.relocate(entries[back].site, back, pos);
+			e = entries[back];
 		}
+		entries.pop_back();
 	}
-	entries.erase(first_to_remove, entries.end());
 
-	return removed;
+	if (!doomed.empty()) searchStale_ = true;
+	return doomed.size();
+}
+
+SiteIndex::View Vault::findSite(const std::string& site) const {
+	return index_.exact(entries, site);
+}
+
+SiteIndex::View Vault::findPrefix(const std::string& prefix) const {
+	return index_.prefix(entries, prefix);
+}
+
+SiteIndex::View Vault::findRange(const std::string& lo, const std::string& hi) const {
+	return index_.range(entries, lo, hi);
+}
+
+VaultStatus Vault::reveal(const Entry& e, Secret& out) const {
+	out.clear();
+	if (e.sealedPassword.empty()) {
+		out.assign(e.password);
+		return VaultStatus::Ok;
+	}
+	if (!hasKey_) return VaultStatus::Locked;
+
+	std::string plain;
+	const bool ok = openSecret(secretKey_, e, plain);
+	if (ok) out.assign(plain);
+	wipeString(plain);
+	return ok ? VaultStatus::Ok : VaultStatus::AuthFailed;
+}
+
+std::vector<Entry> Vault::search(const std::string& query, size_t limit) const {
+	std::vector<Entry> out;
+	for (const auto& m : searchRanked(query, limit)) out.push_back(m.entry);
+	return out;
+}
+
+std::vector<Vault::Match> Vault::searchRanked(const std::string& query, size_t limit) const {
+	if (searchStale_) {
+		PM_TIME(Index);
+		search_.build(entries);
+		searchStale_ = false;
+	}
+
+	std::vector<Match> out;
+	for (const auto& hit : search_.search(query, limit)) out.push_back({ entries[hit.pos], hit.rank });
+	return out;
 }
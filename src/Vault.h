@@ -2,74 +2,274 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <cstdint>
+#include <functional>
+#include <span>
 #include "../include/crypto.h"
+#include "Compressor.h"
+#include "Entry.h"
+#include "SecureArena.h"
+#include "Secret.h"
+#include "SearchIndex.h"
+#include "SiteIndex.h"
+#include "VaultFile.h"
 #include <nlohmann/json.hpp>
 
-// represents saved credential entry
-struct Entry {
-	std::string site;
-	std::string username;
-	std::string password;
+// outcome of a vault operation. The numeric values are part of the pmcore C
+// ABI (pm_status in pmcore.h): append new codes, never renumber.
+enum class VaultStatus : int {
+	Ok = 0,
+	OpenFailed = 1,     // vault file missing or unreadable
+	WriteFailed = 2,    // could not write / append the vault file
+	Truncated = 3,      // file ends inside the header or first record
+	BadHeader = 4,      // header is not JSON or has bad salt / nonce / version
+	KeyUnavailable = 5, // key provider failed (KDF error, agent miss)
+	AuthFailed = 6,     // wrong password or tampered record
+	Corrupt = 7,        // record decrypted but isn't a valid entry / frame
+	Locked = 8,         // no key yet: initNew() or load() first
+	CryptoFailed = 9,   // encryption failed
+	LockFailed = 10,    // could not take the vault's write lock
+	BadKdf = 11,        // KDF parameters out of range
+	BadSlot = 12,       // unknown or reserved key slot label
+	BadManifest = 13,   // collection manifest is not valid (or shard count out of range)
+	Exists = 14,        // refusing to overwrite an existing file
 };
 
-inline void to_json(nlohmann::json& j, const Entry& e) {
-	j = {
-		{"site", e.site},
-		{"username", e.username},
-		{"password", e.password}
-	};
-}
-
-inline void from_json(const nlohmann::json& j, Entry& e) {
-	j.at("site").get_to(e.site);
-	j.at("username").get_to(e.username);
-	j.at("password").get_to(e.password);
-}
+// short human readable description of a status code
+const char* describe(VaultStatus status);
 
+// supplies the vault key for the KDF parameters read from the header, e.g. by
+// running Argon2id on a master password or by asking the unlock agent
+using KeyProvider = std::function<bool(const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey)>;
 
 class Vault {
 
 private:
 
 	std::string filePath;
-	std::vector<Entry> entries;
+	SecureArena arena_; // owns every decrypted entry byte
+	size_t arenaCheckAt_ = 0; // arena size at which reclaimArena() next counts dead bytes
+	std::vector<Entry> entries; // views into arena_
+	SiteIndex index_; // case-folded site -> position in entries
+	mutable SearchIndex search_; // built on the first search() after a change
+	mutable bool searchStale_ = true;
 	Crypto::KdfParams kdf_;
-	std::vector<unsigned char> key;
+	std::vector<unsigned char> key; // data key: seals every record
+	std::vector<unsigned char> wrappedKey_; // data key under the password KEK (empty in older files)
+	std::vector<unsigned char> indexKey_; // blind index subkey of the data key
+	std::vector<unsigned char> secretKey_; // subkey sealing each password on its own
+	std::vector<unsigned char> pageKey_; // subkey of the page MACs of a rewrite's paged region
 	std::vector<unsigned char> nonce;
+	bool compress_ = false; // header: put records are compressed (see Compressor)
+	int compressLevel_ = Compressor::kDefaultLevel;
+	Compressor codec_; // dictionary of the file's last rewrite, if it has one
 	bool hasKey_ = false;
-	mutable std::string lastError_; // stores most recent error msg
-	
+	int formatVersion_ = 2; // on-disk version of the vault file
+
+	// record log bookkeeping: mutations since the last save are appended to the
+	// file as individually sealed records instead of rewriting the whole vault
+	struct PendingOp {
+		std::uint8_t kind;
+		std::string plain; // entry JSON for puts, site for tombstones
+		std::string tags; // blind index tags of the site
+		std::string secret; // sealed password of a split put (plain = site / username only)
+	};
+	std::vector<PendingOp> pending_;
+	size_t fileRecords_ = 0; // put + tombstone records currently in the file
+	size_t rewriteRecords_ = 0; // of those, puts written by the last rewrite (paged for lookups)
+	bool needsRewrite_ = true; // file is not in record layout (new, v1 or blob)
+	VaultFile::FileStamp stamp_; // file as of our last load / save
+	std::uint64_t fileEnd_ = 0; // bytes of the file our entries reflect (0 = unknown)
+	bool headerDirty_ = false; // KDF / wrapped key / slots changed since the last save
+	bool partial_ = false; // loaded by loadMatching: entries hold only the matches
+	std::uint64_t rewriteWritten_ = 0; // see lastRewriteBytes()
+	std::uint64_t rewritePlain_ = 0;
+
+	// extra unlock slots (e.g. a recovery key), each wrapping the data key;
+	// the password slot is kdf_ / wrappedKey_
+	struct KeySlot {
+		std::string label;
+		Crypto::KdfParams kdf;
+		std::vector<unsigned char> wrapped;
+	};
+	std::vector<KeySlot> slots_;
+
+	// header region on disk: newest copy and its sequence, capacity of each
+	// copy (0 = plain JSON header, no in-place updates)
+	std::uint64_t headerSeq_ = 0;
+	size_t headerCapacity_ = 0;
+	int headerCopy_ = 0;
 
-	// re-derive key with current kdf and provided master. 
-	bool deriveKey(const std::string& masterPassword);
+
+	// get the data key for the parsed header: the provider supplies the KEK,
+	// which unwraps it (or is the data key itself in files without a wrapped
+	// key). With dataKey set the provider hands over the data key directly.
+	VaultStatus obtainKey(const KeyProvider& keyFor, bool dataKey);
+	// index / secret subkeys of a freshly obtained data key
+	bool deriveSubkeys();
+	// seal the plain passwords of entries loaded from older records
+	bool sealEager();
+	// restricts a v2 load to the records tagged for one site or prefix
+	struct LoadFilter {
+		std::string_view query;
+		bool prefix = false;
+	};
+	VaultStatus loadWith(const KeyProvider& keyFor, bool dataKey, const LoadFilter* filter = nullptr);
+	bool opensWith(const std::string& secret) const;
+	VaultStatus wrapFor(const std::string& secret, const Crypto::KdfParams& params, Crypto::KdfParams& outKdf, std::vector<unsigned char>& outWrapped) const;
 
 	// helpers to deserialized the vault header / body
 	nlohmann::json makeHeaderJson() const;
 	bool parseHeaderFromJson(const nlohmann::json& root);
 
+	// format specific load paths, called by load() after sniffing the file
+	VaultStatus loadV1(const std::string& text, const KeyProvider& keyFor, bool dataKey);
+	VaultStatus loadV2(VaultFile::FrameReader& reader, const KeyProvider& keyFor, bool dataKey, const LoadFilter* filter);
+
+	// write every live entry to a fresh file (also used for compaction)
+	VaultStatus rewriteAll();
+	// same records under a new header, frames copied without re-sealing
+	VaultStatus rewriteHeader();
+	// header change only: overwrite the header copies in place
+	VaultStatus writeHeaderInPlace();
+	std::string makeHead();
+	std::uint64_t diskHeaderSeq() const;
+	// append pending mutations to the end of the existing file
+	VaultStatus appendPending();
+	bool sealPending(std::string& out) const;
+	bool compactionDue() const;
+	// save() of this vault alone, caller holds the write lock
+	VaultStatus writeLocked();
+	// apply a pending mutation again, e.g. on top of a reloaded file
+	VaultStatus replay(const PendingOp& op);
+
+	// group commit: concurrent saves of one file in this process share a
+	// write lock, an append and an fsync
+	struct CommitRequest;
+	struct CommitQueue;
+	static CommitQueue& commitQueueFor(const std::string& path);
+	static void commitBatch(const std::string& path, const std::vector<CommitRequest*>& batch);
+	static void catchUp(const std::vector<Vault*>& group);
+	void clearPending();
+	// another process saved since our last load / save: reload the file
+	// and replay our pending mutations on top (caller holds the write lock)
+	VaultStatus refreshIfChanged();
+	// the cheap case of that: others only appended records after fileEnd_
+	VaultStatus readTail(const VaultFile::FileStamp& now, bool& applied);
+	size_t eraseSite(const std::string& site);
+	void storeEntry(const Entry& entry);
+	void reclaimArena();
+
 public:
 
 	explicit Vault(std::string path);
 	~Vault();
 
-	// create new empty vault with fresh salt, derives a key and writes file
-	bool initNew(const std::string& masterPassword);
+	// create new empty vault: fresh salt and random data key wrapped under
+	// the password (KDF cost from params, salt ignored), then writes the file
+	VaultStatus initNew(const std::string& masterPassword, const Crypto::KdfParams& params = {});
 
 	// loads existing vault, parses header, derives by key w/ provided password,
 	// decrypts and fills entries 
-	bool load(const std::string& masterPassword);
+	VaultStatus load(const std::string& masterPassword);
+	VaultStatus load(const KeyProvider& keyFor);
+
+	// Open only the records of site (or, with prefix set, of sites starting
+	// with it), found through the blind index; the others stay sealed. Query
+	// the result with findSite / findPrefix: list() holds the candidates
+	// only. Files without an index (v1, older v2 records) load as usual.
+	// save() reloads the whole vault before writing.
+	VaultStatus loadMatching(const KeyProvider& keyFor, const std::string& query, bool prefix);
+	bool partial() const { return partial_; }
 
-	// save current entries
-	bool save() const;
+	// save current entries (always writes the binary v2 format). Appends only
+	// the records changed since load, compacting once tombstones and
+	// superseded records outweigh live ones. Concurrent savers serialize on
+	// the vault's write lock and merge each other's changes; outstanding
+	// views are invalidated when that merge reloads the vault. Saves of the
+	// same path from several threads of this process are group committed:
+	// one of them writes every waiting vault's records in a single fsync'd
+	// append and the others pick up each other's records from memory.
+	VaultStatus save();
+
+	// Pick up saves made by other writers since our last load / save, for a
+	// vault kept open for long: appended records are read incrementally,
+	// anything else reloads the file. Pending mutations are kept.
+	VaultStatus refresh();
+
+	// version of the vault file on disk (1 = legacy JSON, 2 = binary)
+	int formatVersion() const { return formatVersion_; }
+
+	// Turn record compression on or off (recorded in the header). The next
+	// save() rewrites every record: with compression on it trains a
+	// dictionary on the vault's site / username records and compresses them
+	// and later appends against it. False for a level outside Compressor's.
+	bool setCompression(bool on, int level = Compressor::kDefaultLevel);
+	bool compressed() const { return compress_; }
+	int compressionLevel() const { return compressLevel_; }
+	// the file holds a dictionary (vaults under Compressor::kMinSamples
+	// entries are written uncompressed even with compression on)
+	bool hasDictionary() const { return codec_.ready(); }
+	// record frames written by this object's last rewrite (the dictionary
+	// included) and what the same records take uncompressed; the paging
+	// structures around them aren't counted
+	struct RecordBytes {
+		std::uint64_t written = 0;
+		std::uint64_t plain = 0;
+	};
+	RecordBytes lastRewriteBytes() const { return { rewriteWritten_, rewritePlain_ }; }
+
+	// Re-wrap the data key under new KDF parameters (fresh salt). The master
+	// password is checked against the current header first. Records are
+	// untouched: save() only replaces the header.
+	VaultStatus rekdf(const std::string& masterPassword, const Crypto::KdfParams& params);
+
+	// Header-only key management; like rekdf, nothing changes on disk until
+	// save(), which then rewrites just the header copies in place. current is
+	// any secret that opens the vault (password or a slot's secret).
+	VaultStatus changePassword(const std::string& current, const std::string& next);
+	// add (or replace) an unlock slot for secret, e.g. "recovery"
+	VaultStatus addSlot(const std::string& current, const std::string& label, const std::string& secret, const Crypto::KdfParams& params);
+	VaultStatus removeSlot(const std::string& label);
+	// "password" first, then the extra slots
+	std::vector<std::string> slotLabels() const;
+	const Crypto::KdfParams& kdfParams() const { return kdf_; }
 
 	// simple CRUD helpers
 	void addEntry(const Entry& entry);
+
+	// batch add: skips entries whose (site, username) already exists, in the
+	// vault or earlier in the batch. Returns how many were added; like
+	// addEntry nothing reaches disk until save().
+	size_t addEntries(std::span<const Entry> batch);
 	const std::vector<Entry>& list() const { return entries; }
 
 	const std::vector<Entry>& getEntries() const { return entries; }
 
-	const std::string& getLastError() const { return lastError_; }
-
 	size_t removeBySite(const std::string& site);
 
+	// Decrypt e's password into out, which wipes it once it goes out of
+	// scope (or on the next reveal into it). Listing and searching never
+	// need this: only site and username are decrypted at load.
+	VaultStatus reveal(const Entry& e, Secret& out) const;
+
+	// indexed, case-insensitive site lookups; views stay valid until the next
+	// addEntry / removeBySite / load
+	SiteIndex::View sites() const { return index_.all(entries); }
+	SiteIndex::View findSite(const std::string& site) const;
+	SiteIndex::View findPrefix(const std::string& prefix) const;
+	SiteIndex::View findRange(const std::string& lo, const std::string& hi) const;
+
+	// ranked substring / typo-tolerant search over site and username (see
+	// SearchIndex); same view lifetime as above
+	std::vector<Entry> search(const std::string& query, size_t limit) const;
+
+	// the same with each result's rank (lower is better), for merging the
+	// results of several vaults
+	struct Match {
+		Entry entry;
+		std::uint32_t rank;
+	};
+	std::vector<Match> searchRanked(const std::string& query, size_t limit) const;
+
 };
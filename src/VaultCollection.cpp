@@ -0,0 +1,300 @@
+#include "VaultCollection.h"
+#include "ThreadPool.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+namespace {
+
+	const char kFormat[] = "pm-collection";
+	const size_t kMaxManifestBytes = 1 << 20;
+	const size_t kMaxShards = 1024;
+
+	// FNV-1a 64 of the case-folded site: stable across runs and platforms
+	std::uint64_t siteHash(std::string_view site) {
+		const std::string folded = SiteIndex::fold(site);
+		std::uint64_t h = 1469598103934665603ull;
+		for (unsigned char c : folded) {
+			h ^= c;
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	// Argon2id memory handed out to derivations in flight. One derivation
+	// always proceeds, even if it alone exceeds the budget.
+	class MemoryBudget {
+
+	public:
+
+		explicit MemoryBudget(size_t total) : total_(total) {}
+
+		void acquire(size_t n) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			cv_.wait(lk, [&]() { return used_ == 0 || used_ + n <= total_; });
+			used_ += n;
+		}
+
+		void release(size_t n) {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				used_ -= n;
+			}
+			cv_.notify_all();
+		}
+
+	private:
+
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		size_t total_;
+		size_t used_ = 0;
+	};
+
+	// threads for one fan-out over n vaults
+	size_t poolSize(size_t n) {
+		return std::min(n, ThreadPool::shared().size());
+	}
+
+}
+
+VaultCollection::VaultCollection(std::string manifestPath) : manifestPath_(std::move(manifestPath)) {}
+
+bool VaultCollection::isManifest(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in || in.peek() != '{') return false;
+
+	std::string text;
+	text.resize(kMaxManifestBytes + 1);
+	in.read(text.data(), static_cast<std::streamsize>(text.size()));
+	if (static_cast<size_t>(in.gcount()) > kMaxManifestBytes) return false;
+	text.resize(static_cast<size_t>(in.gcount()));
+
+	const nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+	return j.is_object() && j.value("format", "") == kFormat;
+}
+
+VaultStatus VaultCollection::loadManifest() {
+	std::ifstream in(manifestPath_, std::ios::binary);
+	if (!in) return VaultStatus::OpenFailed;
+	const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	const nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+	if (!j.is_object() || j.value("format", "") != kFormat || j.value("version", 0) != 1) return VaultStatus::BadManifest;
+
+	const std::string sharding = j.value("sharding", "none");
+	if (sharding != "none" && sharding != "site-hash") return VaultStatus::BadManifest;
+	sharded_ = sharding == "site-hash";
+
+	auto it = j.find("vaults");
+	if (it == j.end() || !it->is_array() || it->empty() || it->size() > kMaxShards) return VaultStatus::BadManifest;
+
+	const std::filesystem::path dir = std::filesystem::path(manifestPath_).parent_path();
+	members_.clear();
+	for (const auto& v : *it) {
+		if (!v.is_object() || !v.contains("path") || !v["path"].is_string()) return VaultStatus::BadManifest;
+		const std::filesystem::path p = v["path"].get<std::string>();
+		Member m;
+		m.path = (p.is_absolute() ? p : dir / p).string();
+		m.name = v.value("name", p.stem().string());
+		members_.push_back(std::move(m));
+	}
+	return VaultStatus::Ok;
+}
+
+VaultStatus VaultCollection::saveManifest() const {
+	nlohmann::json vaults = nlohmann::json::array();
+	const std::filesystem::path dir = std::filesystem::path(manifestPath_).parent_path();
+	for (const auto& m : members_) {
+		// relative where possible, so the set can be moved as a whole
+		std::error_code ec;
+		std::filesystem::path p = std::filesystem::relative(m.path, dir.empty() ? "." : dir, ec);
+		if (ec || p.empty()) p = m.path;
+		vaults.push_back({ {"name", m.name}, {"path", p.generic_string()} });
+	}
+	const nlohmann::json j = {
+		{"format", kFormat},
+		{"version", 1},
+		{"sharding", sharded_ ? "site-hash" : "none"},
+		{"vaults", vaults}
+	};
+	return VaultFile::replaceFile(manifestPath_, { j.dump(4) + "\n" }) ? VaultStatus::Ok : VaultStatus::WriteFailed;
+}
+
+void VaultCollection::addMember(const std::string& name, const std::string& path) {
+	Member m;
+	m.name = name;
+	m.path = path;
+	members_.push_back(std::move(m));
+}
+
+size_t VaultCollection::shardOf(std::string_view site) const {
+	return members_.empty() ? 0 : static_cast<size_t>(siteHash(site) % members_.size());
+}
+
+size_t VaultCollection::defaultMemBudget() {
+	if (const char* env = std::getenv("PM_KDF_BUDGET_MB")) {
+		const unsigned long long mb = std::strtoull(env, nullptr, 10);
+		if (mb > 0) return static_cast<size_t>(mb) * 1024 * 1024;
+	}
+	return size_t(512) * 1024 * 1024;
+}
+
+VaultStatus VaultCollection::open(const KeyProvider& keyFor, size_t memBudget, const std::vector<size_t>& which) {
+	std::vector<size_t> todo = which;
+	if (todo.empty()) {
+		for (size_t i = 0; i < members_.size(); ++i) todo.push_back(i);
+	}
+
+	MemoryBudget budget(memBudget);
+	const KeyProvider budgeted = [&](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) {
+		budget.acquire(kdf.memlimit);
+		bool ok = false;
+		try { ok = keyFor(kdf, outKey); }
+		catch (...) { budget.release(kdf.memlimit); throw; }
+		budget.release(kdf.memlimit);
+		return ok;
+	};
+
+	ThreadPool pool(poolSize(todo.size()));
+	pool.run(todo.size(), [&](size_t t) {
+		Member& m = members_[todo[t]];
+		auto v = std::make_unique<Vault>(m.path);
+		m.status = v->load(budgeted);
+		m.vault = m.status == VaultStatus::Ok ? std::move(v) : nullptr;
+	});
+
+	for (size_t i : todo) {
+		if (members_[i].status != VaultStatus::Ok) return members_[i].status;
+	}
+	return VaultStatus::Ok;
+}
+
+template <typename F>
+void VaultCollection::forEachOpen(F&& f) const {
+	std::vector<size_t> open;
+	for (size_t i = 0; i < members_.size(); ++i) {
+		if (members_[i].vault) open.push_back(i);
+	}
+	ThreadPool pool(poolSize(open.size()));
+	pool.run(open.size(), [&](size_t t) { f(open[t], *members_[open[t]].vault); });
+}
+
+std::vector<VaultCollection::Match> VaultCollection::search(const std::string& query, size_t limit) const {
+	std::vector<std::vector<Vault::Match>> found(members_.size());
+	forEachOpen([&](size_t i, const Vault& v) { found[i] = v.searchRanked(query, limit); });
+
+	// each list is best first already; a stable sort keeps that within a rank
+	std::vector<Match> out;
+	for (size_t i = 0; i < found.size(); ++i) {
+		for (const auto& m : found[i]) out.push_back({ i, m.entry, m.rank });
+	}
+	std::stable_sort(out.begin(), out.end(), [](const Match& a, const Match& b) { return a.rank < b.rank; });
+	if (out.size() > limit) out.resize(limit);
+	return out;
+}
+
+// merge per-member site-ordered results into one site order
+static std::vector<VaultCollection::Match> mergeBySite(std::vector<std::vector<VaultCollection::Match>>& found) {
+	std::vector<std::pair<std::string, VaultCollection::Match>> keyed;
+	for (auto& list : found) {
+		for (auto& m : list) keyed.emplace_back(SiteIndex::fold(m.entry.site), m);
+	}
+	std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	std::vector<VaultCollection::Match> out;
+	out.reserve(keyed.size());
+	for (auto& k : keyed) out.push_back(k.second);
+	return out;
+}
+
+std::vector<VaultCollection::Match> VaultCollection::findPrefix(const std::string& prefix) const {
+	std::vector<std::vector<Match>> found(members_.size());
+	forEachOpen([&](size_t i, const Vault& v) {
+		for (const auto& e : v.findPrefix(prefix)) found[i].push_back({ i, e, 0 });
+	});
+	return mergeBySite(found);
+}
+
+std::vector<VaultCollection::Match> VaultCollection::findSite(const std::string& site) const {
+	std::vector<std::vector<Match>> found(members_.size());
+	const size_t shard = shardOf(site);
+	for (size_t i = 0; i < members_.size(); ++i) {
+		if (!members_[i].vault || (sharded_ && i != shard)) continue;
+		for (const auto& e : members_[i].vault->findSite(site)) found[i].push_back({ i, e, 0 });
+	}
+	return mergeBySite(found);
+}
+
+VaultStatus VaultCollection::shard(const Vault& source, const std::string& sourcePath, const std::string& master,
+	const std::string& manifestPath, size_t count, size_t memBudget) {
+	if (count == 0 || count > kMaxShards) return VaultStatus::BadManifest;
+
+	namespace fs = std::filesystem;
+	const fs::path dir = fs::path(manifestPath).parent_path();
+	const std::string stem = fs::path(sourcePath).stem().string();
+
+	VaultCollection out(manifestPath);
+	out.setSharded(true);
+	for (size_t i = 0; i < count; ++i) {
+		const std::string file = stem + "." + std::to_string(i) + ".vault";
+		out.addMember(stem + "." + std::to_string(i), (dir / file).string());
+	}
+	std::error_code ec;
+	if (fs::exists(manifestPath, ec)) return VaultStatus::Exists;
+	for (const auto& m : out.members_) {
+		if (fs::exists(m.path, ec)) return VaultStatus::Exists;
+	}
+
+	// which shard each entry goes to
+	std::vector<std::vector<size_t>> parts(count);
+	const auto& entries = source.list();
+	for (size_t i = 0; i < entries.size(); ++i) parts[out.shardOf(entries[i].site)].push_back(i);
+
+	// shards are created (one Argon2id each, under the budget), filled and
+	// saved in parallel; passwords move across in the clear only inside
+	// Secret / the new vault's arena
+	MemoryBudget budget(memBudget);
+	const Crypto::KdfParams params = source.kdfParams();
+	std::vector<VaultStatus> status(count, VaultStatus::Ok);
+
+	ThreadPool pool(poolSize(count));
+	pool.run(count, [&](size_t s) {
+		Vault v(out.members_[s].path);
+		budget.acquire(params.memlimit);
+		VaultStatus st = VaultStatus::Ok;
+		try { st = v.initNew(master, params); }
+		catch (...) { budget.release(params.memlimit); throw; }
+		budget.release(params.memlimit);
+
+		Secret password;
+		for (size_t i : parts[s]) {
+			if (st != VaultStatus::Ok) break;
+			const Entry& e = entries[i];
+			st = source.reveal(e, password);
+			if (st == VaultStatus::Ok) v.addEntry(Entry{ e.site, e.username, password.view() });
+		}
+		if (st == VaultStatus::Ok) st = v.save();
+		status[s] = st;
+	});
+
+	VaultStatus st = VaultStatus::Ok;
+	for (VaultStatus s : status) {
+		if (s != VaultStatus::Ok) { st = s; break; }
+	}
+	if (st == VaultStatus::Ok) st = out.saveManifest();
+
+	// all or nothing: a half-split set is worse than none
+	if (st != VaultStatus::Ok) {
+		for (const auto& m : out.members_) {
+			fs::remove(m.path, ec);
+			fs::remove(m.path + ".lock", ec);
+		}
+	}
+	return st;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Vault.h"
+
+// Several vault files used as one, listed in a manifest:
+//   {"format": "pm-collection", "version": 1, "sharding": "none" | "site-hash",
+//    "vaults": [{"name": "prod", "path": "prod.vault"}, ...]}
+// Paths are relative to the manifest. With site-hash sharding a site lives
+// in vault (FNV-1a of its case-folded name) mod count, so a lookup or add
+// touches one shard. The hash is not keyed: the manifest tells which shard
+// holds a site, nothing more.
+class VaultCollection {
+
+public:
+
+	struct Member {
+		std::string name;
+		std::string path; // resolved against the manifest's directory
+		std::unique_ptr<Vault> vault; // set once opened
+		VaultStatus status = VaultStatus::Ok; // of the last open
+	};
+
+	// an entry found in members_[member]; views into that vault
+	struct Match {
+		size_t member;
+		Entry entry;
+		std::uint32_t rank;
+	};
+
+	explicit VaultCollection(std::string manifestPath);
+
+	// does path hold a collection manifest rather than a vault?
+	static bool isManifest(const std::string& path);
+
+	VaultStatus loadManifest();
+	VaultStatus saveManifest() const;
+	void addMember(const std::string& name, const std::string& path);
+	void setSharded(bool sharded) { sharded_ = sharded; }
+
+	bool sharded() const { return sharded_; }
+	const std::vector<Member>& members() const { return members_; }
+	Vault* vault(size_t member) { return members_[member].vault.get(); }
+	size_t shardOf(std::string_view site) const;
+
+	// KDF memory allowed in flight while opening: $PM_KDF_BUDGET_MB, else
+	// 512 MB
+	static size_t defaultMemBudget();
+
+	// Load the members (all, or those listed) in parallel. Derivations run
+	// concurrently only while their Argon2id memory fits memBudget (one runs
+	// regardless); keyFor is called from several threads. Each member keeps
+	// its own status; the first failure is returned.
+	VaultStatus open(const KeyProvider& keyFor, size_t memBudget, const std::vector<size_t>& which = {});
+
+	// fan out to every open member: ranked search merged best rank first,
+	// prefix / exact lookups merged in site order
+	std::vector<Match> search(const std::string& query, size_t limit) const;
+	std::vector<Match> findPrefix(const std::string& prefix) const;
+	std::vector<Match> findSite(const std::string& site) const;
+
+	// Split source into count new vaults under master (the source's KDF
+	// cost, a fresh salt each), written next to the manifest as
+	// <source stem>.<i>.vault, plus a site-hash manifest at manifestPath.
+	// Existing files are never overwritten. The source is left as is.
+	static VaultStatus shard(const Vault& source, const std::string& sourcePath, const std::string& master,
+		const std::string& manifestPath, size_t count, size_t memBudget);
+
+private:
+
+	// the members a fan-out visits, on a pool of its own (member loads
+	// already use the shared one)
+	template <typename F>
+	void forEachOpen(F&& f) const;
+
+	std::string manifestPath_;
+	bool sharded_ = false;
+	std::vector<Member> members_;
+};
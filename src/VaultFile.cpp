@@ -0,0 +1,946 @@
+#include "VaultFile.h"
+#include "SiteIndex.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "../include/crypto.h"
+#include <nlohmann/json.hpp>
+#include <sodium.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	const size_t kReadChunk = 1 << 20;
+
+	const char kSecretAd[] = "pm-secret";
+
+	const char kHeaderCopyMagic[4] = { 'P', 'M', 'H', 'D' };
+	const size_t kHeaderSumBytes = 32; // BLAKE2b-256, Crypto::checksum
+	const size_t kHeaderCopyOverhead = sizeof(kHeaderCopyMagic) + 8 + 4 + kHeaderSumBytes;
+
+	// checksum of one header copy: seq then json
+	std::vector<unsigned char> headerSum(std::uint64_t seq, const unsigned char* json, size_t len) {
+		std::string buf;
+		VaultFile::putU64(buf, seq);
+		buf.append(reinterpret_cast<const char*>(json), len);
+		return Crypto::checksum(buf.data(), buf.size());
+	}
+
+	// domain byte keeps exact-name and prefix tags apart
+	std::string blindTag(const std::vector<unsigned char>& indexKey, char domain, std::string_view folded) {
+		std::string in(1, domain);
+		in.append(folded);
+		std::string tag(VaultFile::kBlindTagBytes, '\0');
+		if (!Crypto::keyedHash(indexKey, in.data(), in.size(), reinterpret_cast<unsigned char*>(tag.data()), tag.size())) tag.clear();
+		Crypto::secureZero(in.data(), in.size());
+		return tag;
+	}
+
+	// page tree: leaves MAC a page with its number, inner nodes their two
+	// children; a node without a sibling moves up unchanged
+	const unsigned char kLeafDomain = 'L';
+	const unsigned char kNodeDomain = 'N';
+
+	// below this many pages one thread MACs them all
+	const size_t kParallelMinPages = 1024;
+	const size_t kSegmentMinPages = 256;
+
+	void pageLeaf(const std::vector<unsigned char>& key, std::uint64_t page, const std::vector<std::string_view>& parts,
+		const std::vector<std::uint64_t>& starts, std::uint64_t from, std::uint64_t to, unsigned char* out) {
+		crypto_generichash_state st;
+		crypto_generichash_init(&st, key.data(), key.size(), VaultFile::kPageHashBytes);
+		std::string prefix(1, static_cast<char>(kLeafDomain));
+		VaultFile::putU64(prefix, page);
+		crypto_generichash_update(&st, reinterpret_cast<const unsigned char*>(prefix.data()), prefix.size());
+		// a page may span the end of one part and the start of the next
+		size_t k = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), from) - starts.begin()) - 1;
+		for (std::uint64_t at = from; at < to; ++k) {
+			const std::uint64_t partEnd = starts[k] + parts[k].size();
+			const std::uint64_t take = std::min(to, partEnd) - at;
+			crypto_generichash_update(&st, reinterpret_cast<const unsigned char*>(parts[k].data()) + (at - starts[k]), take);
+			at += take;
+		}
+		crypto_generichash_final(&st, out, VaultFile::kPageHashBytes);
+	}
+
+	void pageNode(const std::vector<unsigned char>& key, const unsigned char* left, const unsigned char* right, unsigned char* out) {
+		unsigned char in[1 + 2 * VaultFile::kPageHashBytes];
+		in[0] = kNodeDomain;
+		std::memcpy(in + 1, left, VaultFile::kPageHashBytes);
+		std::memcpy(in + 1 + VaultFile::kPageHashBytes, right, VaultFile::kPageHashBytes);
+		crypto_generichash(out, VaultFile::kPageHashBytes, in, sizeof(in), key.data(), key.size());
+	}
+
+	// nodes per level of a tree over leaves, leaves first
+	std::vector<size_t> treeLevels(size_t leaves) {
+		std::vector<size_t> sizes{ leaves };
+		while (sizes.back() > 1) sizes.push_back((sizes.back() + 1) / 2);
+		return sizes;
+	}
+
+	// binds a sealed password to its entry, so it can't be moved to another
+	std::string secretAd(const Entry& e) {
+		std::string ad(kSecretAd);
+		VaultFile::putU32(ad, static_cast<std::uint32_t>(e.site.size()));
+		ad.append(e.site);
+		ad.append(e.username);
+		return ad;
+	}
+
+	// SAX handler copying Entry fields into the arena as the parser streams
+	// through the text. Accepts a single entry object or an array of flat
+	// entry objects.
+	class EntrySax : public nlohmann::json_sax<nlohmann::json> {
+
+	public:
+
+		EntrySax(SecureArena& arena, const std::function<void(const Entry&)>& onEntry, bool meta)
+			: arena_(arena), onEntry_(onEntry), required_(meta ? 3 : 7) {}
+
+		bool null() override { return skip(); }
+		bool boolean(bool) override { return skip(); }
+		bool number_integer(number_integer_t) override { return skip(); }
+		bool number_unsigned(number_unsigned_t) override { return skip(); }
+		bool number_float(number_float_t, const string_t&) override { return skip(); }
+		bool binary(binary_t&) override { return skip(); }
+
+		bool string(string_t& val) override {
+			if (!inEntry_ || !field_) return skip();
+			*field_ = arena_.store(val);
+			Crypto::secureZero(val.data(), val.size()); // parser's token buffer
+			seen_ |= bit_;
+			field_ = nullptr;
+			return true;
+		}
+
+		bool start_object(std::size_t) override {
+			if (inEntry_) return false; // entries are flat
+			inEntry_ = true;
+			cur_ = Entry{};
+			seen_ = 0;
+			return true;
+		}
+
+		bool key(string_t& val) override {
+			field_ = nullptr;
+			if (val == "site") { field_ = &cur_.site; bit_ = 1; }
+			else if (val == "username") { field_ = &cur_.username; bit_ = 2; }
+			else if (val == "password") { field_ = &cur_.password; bit_ = 4; }
+			return true;
+		}
+
+		bool end_object() override {
+			inEntry_ = false;
+			if (seen_ != required_) return false; // every field is required
+			onEntry_(cur_);
+			cur_ = Entry{};
+			return true;
+		}
+
+		bool start_array(std::size_t) override { return !inEntry_; }
+		bool end_array() override { return true; }
+
+		bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+
+	private:
+
+		// values we don't store are fine anywhere except as a known field
+		bool skip() { bool ok = field_ == nullptr; field_ = nullptr; return ok; }
+
+		SecureArena& arena_;
+		const std::function<void(const Entry&)>& onEntry_;
+		Entry cur_;
+		std::string_view* field_ = nullptr;
+		int bit_ = 0;
+		int seen_ = 0;
+		const int required_;
+		bool inEntry_ = false;
+	};
+
+}
+
+namespace VaultFile {
+
+	const char kMagic[8] = { 'P', 'M', 'V', 'A', 'U', 'L', 'T', '\0' };
+
+	std::string frameAd(std::uint8_t kind) {
+		return std::string("pm-record-") + static_cast<char>('0' + kind);
+	}
+
+	void putU32(std::string& out, std::uint32_t v) {
+		for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+	}
+
+	std::uint32_t getU32(const unsigned char* p) {
+		return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+			(static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+	}
+
+	void putU64(std::string& out, std::uint64_t v) {
+		for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+	}
+
+	std::uint64_t getU64(const unsigned char* p) {
+		std::uint64_t v = 0;
+		for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+		return v;
+	}
+
+	bool putFrame(std::string& out, std::uint8_t kind, const unsigned char* data, size_t len) {
+		if (len > UINT32_MAX) return false;
+		out.push_back(static_cast<char>(kind));
+		putU32(out, static_cast<std::uint32_t>(len));
+		out.append(reinterpret_cast<const char*>(data), len);
+		return true;
+	}
+
+	bool putRecord(std::string& out, const std::vector<unsigned char>& key, std::uint8_t kind, const std::string& plain) {
+		PM_TIME(Encrypt);
+		PM_COUNT(RecordsSealed, 1);
+		std::vector<unsigned char> sealed;
+		if (!Crypto::seal(key, plain, frameAd(kind), sealed)) return false;
+		return putFrame(out, kind, sealed.data(), sealed.size());
+	}
+
+	bool blindIndexKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outIndexKey) {
+		return Crypto::deriveSubkey(dataKey, 1, "pmblindx", outIndexKey);
+	}
+
+	bool secretKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outSecretKey) {
+		return Crypto::deriveSubkey(dataKey, 2, "pmsecret", outSecretKey);
+	}
+
+	bool sealSecret(const std::vector<unsigned char>& secretKey, const Entry& e, std::string_view password, std::string& outSealed) {
+		PM_TIME(Encrypt);
+		std::string plain(password);
+		std::vector<unsigned char> sealed;
+		const bool ok = Crypto::seal(secretKey, plain, secretAd(e), sealed);
+		Crypto::secureZero(plain.data(), plain.size());
+		if (ok) outSealed.assign(reinterpret_cast<const char*>(sealed.data()), sealed.size());
+		return ok;
+	}
+
+	bool openSecret(const std::vector<unsigned char>& secretKey, const Entry& e, std::string& outPassword) {
+		PM_TIME(Decrypt);
+		const auto* sealed = reinterpret_cast<const unsigned char*>(e.sealedPassword.data());
+		return Crypto::open(secretKey, sealed, e.sealedPassword.size(), secretAd(e), outPassword);
+	}
+
+	std::string blindTags(const std::vector<unsigned char>& indexKey, std::string_view site) {
+		std::string folded = SiteIndex::fold(site);
+		std::string tags = blindTag(indexKey, '=', folded);
+		for (size_t n = 1; n <= std::min(kBlindPrefixMax, folded.size()); ++n) tags += blindTag(indexKey, '<', std::string_view(folded).substr(0, n));
+		Crypto::secureZero(folded.data(), folded.size());
+		return tags;
+	}
+
+	std::string blindQuery(const std::vector<unsigned char>& indexKey, std::string_view query, bool prefix) {
+		std::string folded = SiteIndex::fold(query);
+		std::string tag;
+		if (!prefix) tag = blindTag(indexKey, '=', folded);
+		else if (!folded.empty()) tag = blindTag(indexKey, '<', std::string_view(folded).substr(0, std::min(kBlindPrefixMax, folded.size())));
+		Crypto::secureZero(folded.data(), folded.size());
+		return tag;
+	}
+
+	bool putIndexedRecord(std::string& out, const std::vector<unsigned char>& key, std::uint8_t kind, const std::string& plain, const std::string& tags) {
+		if (tags.empty()) return putRecord(out, key, kind, plain);
+
+		const std::uint8_t indexed = kind == FrameDel ? FrameDelIndexed : FramePutIndexed;
+		const size_t count = tags.size() / kBlindTagBytes;
+		if (count > 255) return false;
+		PM_TIME(Encrypt);
+		PM_COUNT(RecordsSealed, 1);
+
+		std::vector<unsigned char> sealed;
+		if (!Crypto::seal(key, plain, frameAd(indexed) + tags, sealed)) return false;
+
+		std::string payload;
+		payload.reserve(1 + tags.size() + sealed.size());
+		payload.push_back(static_cast<char>(count));
+		payload.append(tags);
+		payload.append(reinterpret_cast<const char*>(sealed.data()), sealed.size());
+		return putFrame(out, indexed, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+	}
+
+	bool splitIndexed(const unsigned char* data, size_t len, IndexedFrame& out) {
+		if (len < 1) return false;
+		out.tagCount = data[0];
+		const size_t tagBytes = out.tagCount * kBlindTagBytes;
+		if (len < 1 + tagBytes) return false;
+		out.tags = data + 1;
+		out.sealed = data + 1 + tagBytes;
+		out.sealedLen = len - 1 - tagBytes;
+		return true;
+	}
+
+	bool putSplitRecord(std::string& out, const std::vector<unsigned char>& key, const std::string& meta, const std::string& tags, std::string_view sealedPassword) {
+		const size_t count = tags.size() / kBlindTagBytes;
+		if (count > 255) return false;
+		PM_TIME(Encrypt);
+		PM_COUNT(RecordsSealed, 1);
+
+		std::vector<unsigned char> sealed;
+		if (!Crypto::seal(key, meta, frameAd(FramePutSplit) + tags, sealed)) return false;
+		if (sealed.size() > UINT32_MAX) return false;
+
+		std::string payload;
+		payload.reserve(1 + tags.size() + 4 + sealed.size() + sealedPassword.size());
+		payload.push_back(static_cast<char>(count));
+		payload.append(tags);
+		putU32(payload, static_cast<std::uint32_t>(sealed.size()));
+		payload.append(reinterpret_cast<const char*>(sealed.data()), sealed.size());
+		payload.append(sealedPassword);
+		return putFrame(out, FramePutSplit, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+	}
+
+	bool splitSecret(const IndexedFrame& ix, const unsigned char*& record, size_t& recordLen, const unsigned char*& password, size_t& passwordLen) {
+		if (ix.sealedLen < 4) return false;
+		recordLen = getU32(ix.sealed);
+		if (recordLen > ix.sealedLen - 4) return false;
+		record = ix.sealed + 4;
+		password = record + recordLen;
+		passwordLen = ix.sealedLen - 4 - recordLen;
+		return true;
+	}
+
+	bool IndexedFrame::hasTag(const std::string& tag) const {
+		if (tag.size() != kBlindTagBytes) return false;
+		for (size_t i = 0; i < tagCount; ++i) {
+			if (std::memcmp(tags + i * kBlindTagBytes, tag.data(), kBlindTagBytes) == 0) return true;
+		}
+		return false;
+	}
+
+	std::string IndexedFrame::ad(std::uint8_t kind) const {
+		return frameAd(kind) + std::string(reinterpret_cast<const char*>(tags), tagCount * kBlindTagBytes);
+	}
+
+	bool pageKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outPageKey) {
+		return Crypto::deriveSubkey(dataKey, 3, "pmpagemc", outPageKey);
+	}
+
+	void addTagRefs(std::vector<TagRef>& out, std::string_view tags, std::uint64_t offset) {
+		for (size_t i = 0; i + kBlindTagBytes <= tags.size(); i += kBlindTagBytes) {
+			out.push_back({ getU64(reinterpret_cast<const unsigned char*>(tags.data()) + i), offset });
+		}
+	}
+
+	bool putTagIndex(std::string& out, std::vector<TagRef>& refs) {
+		std::sort(refs.begin(), refs.end());
+		std::string payload;
+		payload.reserve(8 + refs.size() * kTagRowBytes);
+		putU64(payload, refs.size());
+		for (const auto& r : refs) {
+			putU64(payload, r.tag);
+			putU64(payload, r.offset);
+		}
+		return putFrame(out, FrameTagIndex, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+	}
+
+	bool putPageTree(std::string& out, const std::vector<unsigned char>& pageKey, const std::vector<std::string_view>& region,
+		std::vector<unsigned char>& root) {
+		std::vector<std::uint64_t> starts;
+		std::uint64_t total = 0;
+		for (const auto& part : region) {
+			starts.push_back(total);
+			total += part.size();
+		}
+		const size_t leaves = static_cast<size_t>((total + kPageBytes - 1) / kPageBytes);
+		if (leaves == 0 || leaves > UINT32_MAX) return false;
+
+		const std::vector<size_t> sizes = treeLevels(leaves);
+		size_t nodes = 0;
+		for (size_t n : sizes) nodes += n;
+		std::vector<unsigned char> tree(nodes * kPageHashBytes);
+
+		const size_t segCount = ThreadPool::shared().segmentsFor(leaves, kParallelMinPages, kSegmentMinPages);
+		ThreadPool::shared().run(segCount, [&](size_t s) {
+			const size_t first = leaves * s / segCount;
+			const size_t last = leaves * (s + 1) / segCount;
+			for (size_t p = first; p < last; ++p) {
+				const std::uint64_t from = std::uint64_t(p) * kPageBytes;
+				pageLeaf(pageKey, p, region, starts, from, std::min(total, from + kPageBytes), tree.data() + p * kPageHashBytes);
+			}
+		});
+
+		size_t below = 0;
+		for (size_t l = 1; l < sizes.size(); ++l) {
+			const size_t at = below + sizes[l - 1];
+			for (size_t i = 0; i < sizes[l]; ++i) {
+				const unsigned char* left = tree.data() + (below + 2 * i) * kPageHashBytes;
+				unsigned char* parent = tree.data() + (at + i) * kPageHashBytes;
+				if (2 * i + 1 < sizes[l - 1]) pageNode(pageKey, left, left + kPageHashBytes, parent);
+				else std::memcpy(parent, left, kPageHashBytes);
+			}
+			below = at;
+		}
+		root.assign(tree.end() - kPageHashBytes, tree.end());
+
+		std::string payload;
+		putU32(payload, static_cast<std::uint32_t>(leaves));
+		payload.append(reinterpret_cast<const char*>(tree.data()), tree.size());
+		return putFrame(out, FramePageTree, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+	}
+
+	bool PagedRegion::open(const std::vector<unsigned char>& pageKey, const PageLayout& layout, const unsigned char* region, size_t regionLen,
+		const unsigned char* tree, size_t treeLen) {
+		if (layout.pageBytes != kPageBytes || layout.root.size() != kPageHashBytes || layout.end != regionLen || layout.index >= layout.end) return false;
+		const size_t leaves = static_cast<size_t>((layout.end + kPageBytes - 1) / kPageBytes);
+		if (treeLen < 4 || getU32(tree) != leaves) return false;
+
+		levelSize_ = treeLevels(leaves);
+		levelStart_.clear();
+		size_t nodes = 0;
+		for (size_t n : levelSize_) {
+			levelStart_.push_back(nodes);
+			nodes += n;
+		}
+		if (treeLen != 4 + nodes * kPageHashBytes) return false;
+
+		key_ = pageKey;
+		layout_ = layout;
+		region_ = region;
+		tree_ = tree + 4;
+		checked_.assign(leaves, 0);
+		return true;
+	}
+
+	const unsigned char* PagedRegion::node(size_t level, size_t i) const {
+		return tree_ + (levelStart_[level] + i) * kPageHashBytes;
+	}
+
+	// MAC the page, then hash up to the root with the stored siblings
+	bool PagedRegion::verifyPage(size_t page) {
+		if (checked_[page]) return true;
+		PM_COUNT(PagesVerified, 1);
+		PM_COUNT(BytesRead, kPageBytes);
+
+		const std::uint64_t from = std::uint64_t(page) * kPageBytes;
+		const std::uint64_t to = std::min<std::uint64_t>(layout_.end, from + kPageBytes);
+		const std::vector<std::string_view> whole{ std::string_view(reinterpret_cast<const char*>(region_), static_cast<size_t>(layout_.end)) };
+		const std::vector<std::uint64_t> starts{ 0 };
+
+		unsigned char h[kPageHashBytes];
+		pageLeaf(key_, page, whole, starts, from, to, h);
+		size_t i = page;
+		for (size_t l = 0; l + 1 < levelSize_.size(); ++l, i /= 2) {
+			const size_t sibling = i ^ 1;
+			if (sibling >= levelSize_[l]) continue;
+			if (i % 2 == 0) pageNode(key_, h, node(l, sibling), h);
+			else pageNode(key_, node(l, sibling), h, h);
+		}
+		if (sodium_memcmp(h, layout_.root.data(), kPageHashBytes) != 0) return false;
+		checked_[page] = 1;
+		return true;
+	}
+
+	bool PagedRegion::verify(std::uint64_t offset, std::uint64_t len) {
+		if (offset > layout_.end || len > layout_.end - offset) return false;
+		if (len == 0) return true;
+		for (std::uint64_t p = offset / kPageBytes; p <= (offset + len - 1) / kPageBytes; ++p) {
+			if (!verifyPage(static_cast<size_t>(p))) return false;
+		}
+		return true;
+	}
+
+	bool PagedRegion::lookup(std::string_view tag, std::vector<std::uint64_t>& offsets) {
+		offsets.clear();
+		if (tag.size() < kTagRowPrefix) return false;
+		const std::uint64_t want = getU64(reinterpret_cast<const unsigned char*>(tag.data()));
+
+		// frame header and row count, then every row the search probes
+		const std::uint64_t at = layout_.index;
+		if (!verify(at, 5 + 8) || region_[at] != FrameTagIndex) return false;
+		const std::uint64_t len = getU32(region_ + at + 1);
+		const std::uint64_t rows = getU64(region_ + at + 5);
+		if (at + 5 + len != layout_.end || len != 8 + rows * kTagRowBytes) return false;
+		const std::uint64_t base = at + 5 + 8;
+
+		std::uint64_t lo = 0;
+		std::uint64_t hi = rows;
+		while (lo < hi) {
+			const std::uint64_t mid = lo + (hi - lo) / 2;
+			const std::uint64_t row = base + mid * kTagRowBytes;
+			if (!verify(row, kTagRowBytes)) return false;
+			if (getU64(region_ + row) < want) lo = mid + 1;
+			else hi = mid;
+		}
+		for (; lo < rows; ++lo) {
+			const std::uint64_t row = base + lo * kTagRowBytes;
+			if (!verify(row, kTagRowBytes)) return false;
+			if (getU64(region_ + row) != want) break;
+			const std::uint64_t offset = getU64(region_ + row + 8);
+			if (offset >= layout_.index) return false;
+			offsets.push_back(offset);
+		}
+		return true;
+	}
+
+	std::string encodeHeaderCopy(const std::string& json, std::uint64_t seq, size_t halfCapacity) {
+		if (json.size() + kHeaderCopyOverhead > halfCapacity) return {};
+
+		std::string out;
+		out.reserve(halfCapacity);
+		out.append(kHeaderCopyMagic, sizeof(kHeaderCopyMagic));
+		putU64(out, seq);
+		putU32(out, static_cast<std::uint32_t>(json.size()));
+		out.append(json);
+		const auto sum = headerSum(seq, reinterpret_cast<const unsigned char*>(json.data()), json.size());
+		out.append(reinterpret_cast<const char*>(sum.data()), sum.size());
+		out.resize(halfCapacity, '\0');
+		return out;
+	}
+
+	std::string encodeHeaderRegion(const std::string& json, std::uint64_t seq, size_t halfCapacity) {
+		// 1 KiB steps with at least 512 bytes spare for added key slots
+		if (halfCapacity < json.size() + kHeaderCopyOverhead) {
+			halfCapacity = (json.size() + kHeaderCopyOverhead + 512 + 1023) / 1024 * 1024;
+		}
+		const std::string copy = encodeHeaderCopy(json, seq, halfCapacity);
+		return copy + copy;
+	}
+
+	bool decodeHeaderRegion(const unsigned char* region, size_t len, HeaderInfo& out) {
+		// older files: the region is the JSON itself
+		if (len > 0 && region[0] == '{') {
+			out = HeaderInfo{ region, len, 0, 0, 0 };
+			return true;
+		}
+		if (len == 0 || len % 2 != 0) return false;
+
+		const size_t half = len / 2;
+		bool found = false;
+		for (int i = 0; i < 2; ++i) {
+			const unsigned char* p = region + i * half;
+			if (half < kHeaderCopyOverhead || std::memcmp(p, kHeaderCopyMagic, sizeof(kHeaderCopyMagic)) != 0) continue;
+
+			const std::uint64_t seq = getU64(p + 4);
+			const size_t jsonLen = getU32(p + 12);
+			if (jsonLen > half - kHeaderCopyOverhead) continue;
+
+			// a copy torn by a crash or read mid-update fails its checksum
+			const unsigned char* json = p + 16;
+			const auto sum = headerSum(seq, json, jsonLen);
+			if (sum.size() != kHeaderSumBytes || std::memcmp(sum.data(), json + jsonLen, kHeaderSumBytes) != 0) continue;
+
+			if (!found || seq > out.seq) out = HeaderInfo{ json, jsonLen, seq, half, i };
+			found = true;
+		}
+		return found;
+	}
+
+	std::string encodeEntry(const Entry& e) {
+		PM_TIME(Serialize);
+		nlohmann::json j = e;
+		std::string out = j.dump();
+
+		auto& pw = j["password"].get_ref<std::string&>();
+		Crypto::secureZero(pw.data(), pw.size());
+		return out;
+	}
+
+	std::string encodeMeta(const Entry& e) {
+		PM_TIME(Serialize);
+		const nlohmann::json j = { {"site", e.site}, {"username", e.username} };
+		return j.dump();
+	}
+
+	bool parseEntries(const std::string& json, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, bool meta) {
+		PM_TIME(Parse);
+		EntrySax sax(arena, onEntry, meta);
+		try { return nlohmann::json::sax_parse(json, &sax); }
+		catch (...) { return false; }
+	}
+
+	bool parseEntries(std::istream& json, SecureArena& arena, const std::function<void(const Entry&)>& onEntry) {
+		PM_TIME(Parse);
+		EntrySax sax(arena, onEntry, false);
+		try { return nlohmann::json::sax_parse(json, &sax); }
+		catch (...) { return false; }
+	}
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+#if defined(_WIN32)
+	bool MappedFile::open(const std::string& path, Access) {
+		close();
+		HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (f == INVALID_HANDLE_VALUE) return false;
+		if (GetFileType(f) != FILE_TYPE_DISK) { CloseHandle(f); return false; }
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(f, &size)) { CloseHandle(f); return false; }
+		file_ = f;
+		size_ = static_cast<size_t>(size.QuadPart);
+		if (size_ == 0) return true; // nothing to map
+
+		HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m) { close(); return false; }
+		mapping_ = m;
+
+		data_ = static_cast<const unsigned char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+		if (!data_) { close(); return false; }
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+		if (file_) CloseHandle(static_cast<HANDLE>(file_));
+		data_ = nullptr;
+		mapping_ = nullptr;
+		file_ = nullptr;
+		size_ = 0;
+	}
+#else
+	bool MappedFile::open(const std::string& path, Access access) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st {};
+		if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { ::close(fd); return false; }
+
+		size_ = static_cast<size_t>(st.st_size);
+		if (size_ > 0) {
+			void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) { ::close(fd); size_ = 0; return false; }
+			data_ = static_cast<const unsigned char*>(p);
+			::madvise(p, size_, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+		}
+		::close(fd); // the mapping keeps the file referenced
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (data_) ::munmap(const_cast<unsigned char*>(data_), size_);
+		data_ = nullptr;
+		size_ = 0;
+	}
+#endif
+
+#if defined(_WIN32)
+	FileStamp stampOf(const std::string& path) {
+		FileStamp st;
+		HANDLE f = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (f == INVALID_HANDLE_VALUE) return st;
+
+		BY_HANDLE_FILE_INFORMATION info{};
+		if (GetFileInformationByHandle(f, &info)) {
+			st.device = info.dwVolumeSerialNumber;
+			st.inode = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+			st.size = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+			st.valid = true;
+		}
+		CloseHandle(f);
+		return st;
+	}
+
+	WriteLock::WriteLock(const std::string& vaultPath) {
+		HANDLE h = CreateFileA((vaultPath + ".lock").c_str(), GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE) return;
+		handle_ = h;
+
+		PM_TIME(LockWait);
+		OVERLAPPED ov{};
+		locked_ = LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &ov) != 0;
+	}
+
+	WriteLock::~WriteLock() {
+		if (!handle_) return;
+		if (locked_) {
+			OVERLAPPED ov{};
+			UnlockFileEx(static_cast<HANDLE>(handle_), 0, MAXDWORD, MAXDWORD, &ov);
+		}
+		CloseHandle(static_cast<HANDLE>(handle_));
+	}
+
+	static bool writeHandle(HANDLE h, const std::string& data) {
+		size_t done = 0;
+		while (done < data.size()) {
+			const DWORD step = static_cast<DWORD>(std::min<size_t>(data.size() - done, 1u << 30));
+			DWORD wrote = 0;
+			if (!WriteFile(h, data.data() + done, step, &wrote, nullptr) || wrote == 0) return false;
+			PM_COUNT(BytesWritten, wrote);
+			done += wrote;
+		}
+		return true;
+	}
+
+	bool createPrivate(const std::string& path, bool overwrite) {
+		HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, overwrite ? CREATE_ALWAYS : CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE) return false;
+		CloseHandle(h);
+		return true;
+	}
+
+	bool replaceFile(const std::string& path, const std::vector<std::string>& parts) {
+		PM_TIME(FileWrite);
+		const std::string tmp = path + ".tmp";
+		HANDLE h = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE) return false;
+
+		bool ok = true;
+		for (const auto& part : parts) {
+			if (!(ok = writeHandle(h, part))) break;
+		}
+		ok = ok && FlushFileBuffers(h);
+		PM_COUNT(Fsyncs, 1);
+		CloseHandle(h);
+		if (!ok) { DeleteFileA(tmp.c_str()); return false; }
+
+		// a reader that still has the old file mapped blocks the replace
+		// for the length of its load: retry briefly
+		for (int attempt = 0; attempt < 200; ++attempt) {
+			if (MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) return true;
+			const DWORD err = GetLastError();
+			if (err != ERROR_ACCESS_DENIED && err != ERROR_SHARING_VIOLATION) break;
+			Sleep(10);
+		}
+		DeleteFileA(tmp.c_str());
+		return false;
+	}
+
+	bool writeAt(const std::string& path, std::uint64_t offset, const std::string& data) {
+		PM_TIME(FileWrite);
+		PM_COUNT(Fsyncs, 1);
+		HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER at{};
+		at.QuadPart = static_cast<LONGLONG>(offset);
+		const bool ok = SetFilePointerEx(h, at, nullptr, FILE_BEGIN) && writeHandle(h, data) && FlushFileBuffers(h);
+		CloseHandle(h);
+		return ok;
+	}
+
+	bool appendFile(const std::string& path, const std::string& data) {
+		PM_TIME(FileWrite);
+		PM_COUNT(Fsyncs, 1);
+		HANDLE h = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE) return false;
+		const bool ok = writeHandle(h, data) && FlushFileBuffers(h);
+		CloseHandle(h);
+		return ok;
+	}
+#else
+	FileStamp stampOf(const std::string& path) {
+		FileStamp st;
+		struct stat sb {};
+		if (::stat(path.c_str(), &sb) != 0) return st;
+		st.device = static_cast<std::uint64_t>(sb.st_dev);
+		st.inode = static_cast<std::uint64_t>(sb.st_ino);
+		st.size = static_cast<std::uint64_t>(sb.st_size);
+		st.valid = true;
+		return st;
+	}
+
+	WriteLock::WriteLock(const std::string& vaultPath) {
+		fd_ = ::open((vaultPath + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (fd_ < 0) return;
+		PM_TIME(LockWait);
+		int rc;
+		do { rc = ::flock(fd_, LOCK_EX); } while (rc != 0 && errno == EINTR);
+		locked_ = rc == 0;
+	}
+
+	WriteLock::~WriteLock() {
+		if (fd_ >= 0) ::close(fd_); // releases the flock
+	}
+
+	static bool writeFd(int fd, const std::string& data) {
+		size_t done = 0;
+		while (done < data.size()) {
+			const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			PM_COUNT(BytesWritten, n);
+			done += static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	bool createPrivate(const std::string& path, bool overwrite) {
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (overwrite ? O_TRUNC : O_EXCL), 0600);
+		if (fd < 0) return false;
+		// the mode only applies to a new file; an overwritten one keeps its own
+		const bool ok = ::fchmod(fd, 0600) == 0;
+		return ::close(fd) == 0 && ok;
+	}
+
+	bool replaceFile(const std::string& path, const std::vector<std::string>& parts) {
+		PM_TIME(FileWrite);
+		const std::string tmp = path + ".tmp";
+		const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd < 0) return false;
+
+		bool ok = true;
+		for (const auto& part : parts) {
+			if (!(ok = writeFd(fd, part))) break;
+		}
+		ok = ok && ::fsync(fd) == 0;
+		PM_COUNT(Fsyncs, 1);
+		ok = ::close(fd) == 0 && ok;
+		if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) { ::unlink(tmp.c_str()); return false; }
+
+		// make the rename itself durable
+		const size_t slash = path.find_last_of('/');
+		const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+		const int dfd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+		if (dfd >= 0) { ::fsync(dfd); ::close(dfd); PM_COUNT(Fsyncs, 1); }
+		return true;
+	}
+
+	bool writeAt(const std::string& path, std::uint64_t offset, const std::string& data) {
+		PM_TIME(FileWrite);
+		PM_COUNT(Fsyncs, 1);
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		bool ok = true;
+		size_t done = 0;
+		while (ok && done < data.size()) {
+			const ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, static_cast<off_t>(offset + done));
+			if (n < 0 && errno == EINTR) continue;
+			ok = n > 0;
+			if (ok) done += static_cast<size_t>(n);
+			if (ok) PM_COUNT(BytesWritten, n);
+		}
+		ok = ok && ::fsync(fd) == 0;
+		ok = ::close(fd) == 0 && ok;
+		return ok;
+	}
+
+	bool appendFile(const std::string& path, const std::string& data) {
+		PM_TIME(FileWrite);
+		PM_COUNT(Fsyncs, 1);
+		const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+		if (fd < 0) return false;
+		bool ok = writeFd(fd, data) && ::fsync(fd) == 0;
+		ok = ::close(fd) == 0 && ok;
+		return ok;
+	}
+#endif
+
+	bool FrameReader::open(const std::string& path, MappedFile::Access access) {
+		PM_TIME(FileRead);
+		mapped_ = map_.open(path, access);
+		if (mapped_) {
+			// pages fault in later, as frames are taken
+			pos_ = 0;
+			remaining_ = map_.size();
+			v2_ = remaining_ >= sizeof(kMagic) && std::memcmp(map_.data(), kMagic, sizeof(kMagic)) == 0;
+			if (v2_) { pos_ = sizeof(kMagic); remaining_ -= sizeof(kMagic); }
+			return true;
+		}
+
+		// non-regular file (pipe, device): stream it
+		in_.open(path, std::ios::binary);
+		if (!in_) return false;
+		remaining_ = UINT64_MAX; // unknown length, bounded by kReadChunk growth
+
+		char magic[sizeof(kMagic)] = {};
+		in_.read(magic, sizeof(magic));
+		PM_COUNT(BytesRead, in_.gcount());
+		sniffed_.assign(magic, static_cast<size_t>(in_.gcount()));
+		v2_ = sniffed_.size() == sizeof(kMagic) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+		return true;
+	}
+
+	bool FrameReader::readAll(std::string& out) {
+		if (mapped_) {
+			PM_COUNT(BytesRead, map_.size());
+			out.assign(reinterpret_cast<const char*>(map_.data()), map_.size());
+			return true;
+		}
+
+		// pipes can't be reopened, so keep the bytes open() already sniffed
+		PM_TIME(FileRead);
+		out = sniffed_;
+		char chunk[64 * 1024];
+		while (in_.read(chunk, sizeof(chunk)) || in_.gcount() > 0) {
+			PM_COUNT(BytesRead, in_.gcount());
+			out.append(chunk, static_cast<size_t>(in_.gcount()));
+		}
+		return true;
+	}
+
+	bool FrameReader::take(size_t n, const unsigned char*& out) {
+		if (n > remaining_) return false; // never size the buffer past the file
+		if (mapped_) {
+			PM_COUNT(BytesRead, n);
+			out = map_.data() + pos_;
+			pos_ += n;
+			remaining_ -= n;
+			return true;
+		}
+
+		// length is unknown up front, so grow the buffer only as bytes arrive
+		PM_TIME(FileRead);
+		PM_COUNT(BytesRead, n);
+		size_t got = 0;
+		while (got < n) {
+			const size_t step = std::min(n - got, kReadChunk);
+			if (buf_.size() < got + step) buf_.resize(got + step);
+			in_.read(reinterpret_cast<char*>(buf_.data() + got), static_cast<std::streamsize>(step));
+			if (static_cast<size_t>(in_.gcount()) != step) return false;
+			got += step;
+		}
+		out = buf_.data();
+		return true;
+	}
+
+	bool FrameReader::readHeader(const unsigned char*& data, size_t& len) {
+		const unsigned char* p = nullptr;
+		if (!take(4, p)) return false;
+		len = getU32(p);
+		return take(len, data);
+	}
+
+	bool FrameReader::seek(size_t offset) {
+		if (!mapped_ || offset < sizeof(kMagic) || offset > map_.size()) return false;
+		pos_ = offset;
+		remaining_ = map_.size() - offset;
+		return true;
+	}
+
+	FrameReader::Status FrameReader::next(std::uint8_t& kind, const unsigned char*& data, size_t& len) {
+		const unsigned char* hdr = nullptr;
+		unsigned char tmp[5];
+		if (mapped_) {
+			if (remaining_ == 0) return Status::End;
+			if (!take(5, hdr)) return Status::Torn;
+		}
+		else {
+			in_.read(reinterpret_cast<char*>(tmp), 5);
+			PM_COUNT(BytesRead, in_.gcount());
+			if (in_.gcount() == 0) return Status::End;
+			if (in_.gcount() != 5) return Status::Torn;
+			hdr = tmp;
+		}
+
+		kind = hdr[0];
+		len = getU32(hdr + 1);
+		return take(len, data) ? Status::Ok : Status::Torn;
+	}
+
+}
@@ -0,0 +1,352 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <cstdint>
+#include "Entry.h"
+#include "SecureArena.h"
+
+// Binary vault format (version 2):
+//   magic "PMVAULT\0" | u32 header length | header region | frames...
+// each frame is u8 kind | u32 length | payload, integers little-endian.
+// Indexed frames carry blind index tags in front of the sealed record:
+//   u8 tag count | tags (kBlindTagBytes each) | sealed record
+// tags are keyed BLAKE2b of the folded site and its first few characters,
+// so a lookup finds its records without opening any others. Split puts seal
+// the password apart from site and username, so a load opens neither it nor
+// the bytes around it:
+//   u8 tag count | tags | u32 record length | sealed record | sealed password
+// The header region is either the header JSON itself (older files) or two
+// fixed-size copies A and B, each
+//   "PMHD" | u64 seq | u32 json length | json | BLAKE2b(seq, json) | padding
+// Readers take the valid copy with the highest seq, so a header can be
+// rewritten in place (one copy at a time) without a reader or a crash ever
+// seeing a half-written one.
+// A rewrite pages its records for lookups that read only part of the file:
+//   check | [dictionary] | records... | tag index | page tree | frames appended since
+// The bytes from the frame after the check record to the end of the tag
+// index are cut into kPageBytes pages. The tag index lists (tag prefix,
+// record offset) rows sorted by tag; the page tree is a Merkle tree whose
+// leaves are keyed MACs of the pages, and the check record seals its root
+// with the layout.
+// A lookup verifies each page it touches against that root, so the whole
+// region stays tamper-evident while only a few pages of it are read. The
+// dictionary frame is there when the header turns on record compression
+// (see Compressor).
+namespace VaultFile {
+
+	extern const char kMagic[8];
+
+	enum FrameKind : std::uint8_t {
+		FrameBlob = 1, // whole-vault ciphertext (early v2 files, read only)
+		FramePut = 2, // one sealed entry
+		FrameDel = 3, // sealed tombstone, removes every entry for a site
+		FrameCheck = 4, // sealed {"records": N} written first by a rewrite (empty in
+		                // older files): verifies the key, detects a cut-short body
+		FramePutIndexed = 5, // FramePut behind blind index tags
+		FrameDelIndexed = 6, // FrameDel behind blind index tags
+		FramePutSplit = 7, // FramePutIndexed of site / username, password sealed beside it
+		FrameTagIndex = 8, // u64 row count | rows of tag prefix and u64 record offset, plain
+		FramePageTree = 9, // u32 leaf count | every tree level, leaves first, plain
+		FrameDict = 10, // sealed zstd dictionary the put records after it are compressed with
+	};
+
+	// blind index: tags of a site's exact name and of its first 1..kBlindPrefixMax
+	// characters (case-folded), each a kBlindTagBytes keyed hash
+	const size_t kBlindTagBytes = 16;
+	const size_t kBlindPrefixMax = 3;
+
+	// subkey for the tags, derived from the data key
+	bool blindIndexKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outIndexKey);
+	// every tag of site, concatenated
+	std::string blindTags(const std::vector<unsigned char>& indexKey, std::string_view site);
+	// the one tag to look for: an exact site, or a prefix (longer prefixes
+	// match on their first kBlindPrefixMax characters; empty = no tag)
+	std::string blindQuery(const std::vector<unsigned char>& indexKey, std::string_view query, bool prefix);
+
+	// Passwords of split puts: sealed under their own subkey of the data key,
+	// bound to the entry's site and username. sealed = nonce || ciphertext.
+	bool secretKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outSecretKey);
+	bool sealSecret(const std::vector<unsigned char>& secretKey, const Entry& e, std::string_view password, std::string& outSealed);
+	bool openSecret(const std::vector<unsigned char>& secretKey, const Entry& e, std::string& outPassword);
+
+	// put / del frame of kind behind tags (the tags are authenticated with
+	// the record); plain puts and dels when tags is empty
+	bool putIndexedRecord(std::string& out, const std::vector<unsigned char>& key, std::uint8_t kind, const std::string& plain, const std::string& tags);
+
+	// parts of an indexed frame payload; false if malformed
+	struct IndexedFrame {
+		const unsigned char* tags = nullptr;
+		size_t tagCount = 0;
+		const unsigned char* sealed = nullptr;
+		size_t sealedLen = 0;
+
+		bool hasTag(const std::string& tag) const;
+		std::string ad(std::uint8_t kind) const;
+	};
+	bool splitIndexed(const unsigned char* data, size_t len, IndexedFrame& out);
+
+	// split put of entry e: meta is its site / username record (encodeMeta),
+	// e.sealedPassword goes beside it as is
+	bool putSplitRecord(std::string& out, const std::vector<unsigned char>& key, const std::string& meta, const std::string& tags, std::string_view sealedPassword);
+	// record and password parts of a split put's sealed bytes (ix.sealed)
+	bool splitSecret(const IndexedFrame& ix, const unsigned char*& record, size_t& recordLen, const unsigned char*& password, size_t& passwordLen);
+
+	// paged region of a rewrite (offsets relative to its first frame after the check record)
+	const size_t kPageBytes = 4096;
+	const size_t kPageHashBytes = 32;
+	const size_t kTagRowPrefix = 8; // leading bytes of a blind tag kept per index row
+	const size_t kTagRowBytes = kTagRowPrefix + 8;
+
+	// subkey for the page MACs, derived from the data key
+	bool pageKey(const std::vector<unsigned char>& dataKey, std::vector<unsigned char>& outPageKey);
+
+	// where a rewrite's paged region ends, sealed in its check record
+	struct PageLayout {
+		size_t pageBytes = 0; // 0 = not paged (files written before the tag index)
+		std::uint64_t index = 0; // tag index frame
+		std::uint64_t end = 0; // end of the tag index frame, start of the page tree frame
+		std::vector<unsigned char> root;
+	};
+
+	// one tag index row before encoding
+	struct TagRef {
+		std::uint64_t tag; // first kTagRowPrefix bytes of a blind tag, as little-endian
+		std::uint64_t offset;
+
+		bool operator<(const TagRef& o) const { return tag != o.tag ? tag < o.tag : offset < o.offset; }
+	};
+	// a row per tag of a record frame at offset (tags as from blindTags)
+	void addTagRefs(std::vector<TagRef>& out, std::string_view tags, std::uint64_t offset);
+	// FrameTagIndex frame of refs, sorted here
+	bool putTagIndex(std::string& out, std::vector<TagRef>& refs);
+
+	// MAC every page of region (parts back to back) on the shared thread pool
+	// and append the FramePageTree frame; root gets the tree's top node
+	bool putPageTree(std::string& out, const std::vector<unsigned char>& pageKey, const std::vector<std::string_view>& region,
+		std::vector<unsigned char>& root);
+
+	// Verified view of the paged region of a mapped file. Every page is
+	// checked against the sealed root (its MAC, then the path up the tree)
+	// the first time a read touches it.
+	class PagedRegion {
+
+	public:
+
+		// region is the mapped bytes from the frame after the check record to layout.end,
+		// tree the FramePageTree payload; false if the tree doesn't fit the layout
+		bool open(const std::vector<unsigned char>& pageKey, const PageLayout& layout, const unsigned char* region, size_t regionLen,
+			const unsigned char* tree, size_t treeLen);
+
+		// are [offset, offset + len) inside the region and on intact pages
+		bool verify(std::uint64_t offset, std::uint64_t len);
+
+		// offsets of the records indexed under tag (a full blind tag), in
+		// file order; false if a page read on the way fails verification
+		bool lookup(std::string_view tag, std::vector<std::uint64_t>& offsets);
+
+		const unsigned char* data() const { return region_; }
+
+	private:
+
+		bool verifyPage(size_t page);
+		const unsigned char* node(size_t level, size_t i) const;
+
+		std::vector<unsigned char> key_;
+		PageLayout layout_;
+		const unsigned char* region_ = nullptr;
+		const unsigned char* tree_ = nullptr;
+		std::vector<size_t> levelStart_; // node index of each level's first node
+		std::vector<size_t> levelSize_;
+		std::vector<char> checked_; // per page: verified already
+	};
+
+	// associated data per record kind so a record can't be replayed as another kind
+	std::string frameAd(std::uint8_t kind);
+
+	void putU32(std::string& out, std::uint32_t v);
+	std::uint32_t getU32(const unsigned char* p);
+	void putU64(std::string& out, std::uint64_t v);
+	std::uint64_t getU64(const unsigned char* p);
+
+	// append one frame to the output buffer
+	bool putFrame(std::string& out, std::uint8_t kind, const unsigned char* data, size_t len);
+
+	// seal plaintext as a record and append it as a frame
+	bool putRecord(std::string& out, const std::vector<unsigned char>& key, std::uint8_t kind, const std::string& plain);
+
+	// header region holding json twice at sequence seq; halfCapacity 0 picks a
+	// size with room for the header to grow (extra key slots)
+	std::string encodeHeaderRegion(const std::string& json, std::uint64_t seq, size_t halfCapacity = 0);
+	// one copy of the region, to overwrite in place at regionOffset + half *
+	// halfCapacity; empty if json doesn't fit
+	std::string encodeHeaderCopy(const std::string& json, std::uint64_t seq, size_t halfCapacity);
+
+	struct HeaderInfo {
+		const unsigned char* json = nullptr;
+		size_t jsonLen = 0;
+		std::uint64_t seq = 0;
+		size_t halfCapacity = 0; // 0 for a plain JSON header (no in-place updates)
+		int half = 0; // copy that was picked
+	};
+	// pick the newest intact copy; false if none is
+	bool decodeHeaderRegion(const unsigned char* region, size_t len, HeaderInfo& out);
+
+	// offset of the header region in the file
+	const size_t kHeaderRegionOffset = 8 + 4;
+
+	// entry as record plaintext JSON; the temporary json copy of the
+	// password is wiped before returning
+	std::string encodeEntry(const Entry& e);
+	// site and username only, the record of a split put
+	std::string encodeMeta(const Entry& e);
+
+	// parse an entry object, or an array of them, straight into the arena
+	// (SAX, no intermediate json tree). onEntry is called once per entry with
+	// views into the arena. With meta set the objects are encodeMeta records
+	// (no password field).
+	bool parseEntries(const std::string& json, SecureArena& arena, const std::function<void(const Entry&)>& onEntry, bool meta = false);
+	bool parseEntries(std::istream& json, SecureArena& arena, const std::function<void(const Entry&)>& onEntry);
+
+	// identity of the file currently at a path (device, inode, size), taken
+	// at load and after each save to notice writes by other processes
+	struct FileStamp {
+		std::uint64_t device = 0;
+		std::uint64_t inode = 0;
+		std::uint64_t size = 0;
+		bool valid = false;
+
+		bool operator==(const FileStamp&) const = default;
+	};
+
+	// invalid stamp if the path doesn't exist
+	FileStamp stampOf(const std::string& path);
+
+	// Exclusive advisory lock on "<vault>.lock" (flock / LockFileEx), held
+	// for the object's lifetime. Only writers lock; readers never block
+	// because writers replace the vault by rename or append whole records.
+	// flock locks belong to the open file, so threads of one process using
+	// separate Vault objects exclude each other too.
+	class WriteLock {
+
+	public:
+
+		explicit WriteLock(const std::string& vaultPath);
+		~WriteLock();
+		WriteLock(const WriteLock&) = delete;
+		WriteLock& operator=(const WriteLock&) = delete;
+
+		bool locked() const { return locked_; }
+
+	private:
+
+		bool locked_ = false;
+#if defined(_WIN32)
+		void* handle_ = nullptr;
+#else
+		int fd_ = -1;
+#endif
+	};
+
+	// Write parts in order to "<path>.tmp", fsync it and rename it over path
+	// (fsyncing the directory), so readers see the old or the new file and
+	// never a partial one. Caller holds the WriteLock.
+	bool replaceFile(const std::string& path, const std::vector<std::string>& parts);
+
+	// Create an empty file readable by our user only (0600, like the vault
+	// itself), for plaintext that leaves the vault. An existing file is
+	// truncated and made private when overwrite is set, else left alone
+	// (false).
+	bool createPrivate(const std::string& path, bool overwrite);
+
+	// append data to an existing file and fsync it
+	bool appendFile(const std::string& path, const std::string& data);
+
+	// overwrite bytes at offset inside an existing file and fsync it
+	bool writeAt(const std::string& path, std::uint64_t offset, const std::string& data);
+
+	// Read-only view of a whole regular file (mmap / MapViewOfFile). open()
+	// fails for pipes, devices and other non-regular files.
+	class MappedFile {
+
+	public:
+
+		// read-ahead hint: one front-to-back pass, or scattered lookups
+		enum class Access { Sequential, Random };
+
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path, Access access = Access::Sequential);
+		void close();
+
+		const unsigned char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+
+		const unsigned char* data_ = nullptr;
+		size_t size_ = 0;
+#if defined(_WIN32)
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+#endif
+	};
+
+	// Reads a v2 file front to back. Regular files are memory-mapped and frames
+	// point straight into the mapping; other files are streamed through one
+	// reusable record buffer. Either way memory stays bounded by the largest
+	// record rather than the file size.
+	class FrameReader {
+
+	public:
+
+		enum class Status { Ok, End, Torn };
+
+		// false if the file can't be opened; isV2() tells whether it has the magic
+		bool open(const std::string& path, MappedFile::Access access = MappedFile::Access::Sequential);
+		bool isV2() const { return v2_; }
+		bool isMapped() const { return mapped_; }
+
+		// upper bound on the bytes still to read, 0 when unknown (streams)
+		size_t sizeHint() const { return mapped_ ? static_cast<size_t>(remaining_) : 0; }
+
+		// whole file as text (legacy v1 files); call instead of readHeader/next
+		bool readAll(std::string& out);
+
+		// header JSON bytes; valid until the next call
+		bool readHeader(const unsigned char*& data, size_t& len);
+
+		// next frame; data stays valid until the following call
+		Status next(std::uint8_t& kind, const unsigned char*& data, size_t& len);
+
+		// mapped files only: byte offset of the next frame, and jumping to
+		// one read earlier (e.g. the end of a previous load, a paged record)
+		size_t offset() const { return pos_; }
+		bool seek(size_t offset);
+		// mapped files only: the whole mapping
+		const unsigned char* mapping() const { return map_.data(); }
+		size_t mappingSize() const { return map_.size(); }
+
+	private:
+
+		// copy-free in mapped mode, buffered otherwise
+		bool take(size_t n, const unsigned char*& out);
+
+		MappedFile map_;
+		bool mapped_ = false;
+		size_t pos_ = 0; // offset into the mapping
+
+		std::ifstream in_;
+		std::vector<unsigned char> buf_;
+		std::string sniffed_; // magic-sized prefix already consumed from the stream
+		std::uint64_t remaining_ = 0; // bytes left after the current position
+		bool v2_ = false;
+	};
+
+}
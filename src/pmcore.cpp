@@ -0,0 +1,152 @@
+#include "../include/pmcore.h"
+#include "../include/crypto.h"
+#include "Vault.h"
+#include <memory>
+#include <new>
+#include <string>
+
+// the C handle is just the C++ vault
+struct pm_vault {
+	Vault vault;
+	explicit pm_vault(std::string path) : vault(std::move(path)) {}
+};
+
+static_assert(PM_OK == static_cast<int>(VaultStatus::Ok), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_OPEN == static_cast<int>(VaultStatus::OpenFailed), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_WRITE == static_cast<int>(VaultStatus::WriteFailed), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_TRUNCATED == static_cast<int>(VaultStatus::Truncated), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_BAD_HEADER == static_cast<int>(VaultStatus::BadHeader), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_KEY == static_cast<int>(VaultStatus::KeyUnavailable), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_AUTH == static_cast<int>(VaultStatus::AuthFailed), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_CORRUPT == static_cast<int>(VaultStatus::Corrupt), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_LOCKED == static_cast<int>(VaultStatus::Locked), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_CRYPTO == static_cast<int>(VaultStatus::CryptoFailed), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_LOCK == static_cast<int>(VaultStatus::LockFailed), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_BAD_KDF == static_cast<int>(VaultStatus::BadKdf), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_BAD_SLOT == static_cast<int>(VaultStatus::BadSlot), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_BAD_MANIFEST == static_cast<int>(VaultStatus::BadManifest), "pm_status must mirror VaultStatus");
+static_assert(PM_ERR_EXISTS == static_cast<int>(VaultStatus::Exists), "pm_status must mirror VaultStatus");
+
+namespace {
+
+	pm_status toC(VaultStatus s) {
+		return static_cast<pm_status>(static_cast<int>(s));
+	}
+
+	// no exception may cross the C boundary
+	template <typename F>
+	pm_status guarded(F&& f) {
+		try { return f(); }
+		catch (const std::bad_alloc&) { return PM_ERR_NO_MEMORY; }
+		catch (...) { return PM_ERR_INTERNAL; }
+	}
+
+	// each password is decrypted just for its callback and wiped after
+	pm_status visit(const Vault& vault, const SiteIndex::View& view, pm_entry_cb cb, void* ctx) {
+		Secret password;
+		for (const auto& e : view) {
+			if (const VaultStatus st = vault.reveal(e, password); st != VaultStatus::Ok) return toC(st);
+			const pm_entry out{ e.site.data(), e.site.size(), e.username.data(), e.username.size(), password.view().data(), password.view().size() };
+			const int stop = cb(&out, ctx);
+			password.clear();
+			if (stop != 0) break;
+		}
+		return PM_OK;
+	}
+
+	// shared by create / open: the master copy is wiped whatever happens
+	template <typename F>
+	pm_status openWith(const char* path, const char* master, size_t masterLen, pm_vault** out, F&& run) {
+		if (!path || !out || (!master && masterLen > 0)) return PM_ERR_INVALID_ARG;
+		*out = nullptr;
+
+		return guarded([&]() {
+			auto h = std::make_unique<pm_vault>(path);
+			std::string pw(master ? master : "", masterLen);
+			VaultStatus st = VaultStatus::Ok;
+			try { st = run(h->vault, pw); }
+			catch (...) { Crypto::secureZero(pw.data(), pw.size()); throw; }
+			Crypto::secureZero(pw.data(), pw.size());
+
+			if (st != VaultStatus::Ok) return toC(st);
+			*out = h.release();
+			return PM_OK;
+		});
+	}
+
+}
+
+extern "C" {
+
+	int pm_abi_version(void) {
+		return PMCORE_ABI_VERSION;
+	}
+
+	const char* pm_strerror(pm_status status) {
+		switch (status) {
+		case PM_ERR_INVALID_ARG: return "Invalid argument.";
+		case PM_ERR_NO_MEMORY: return "Out of memory.";
+		case PM_ERR_INTERNAL: return "Internal error.";
+		default: return describe(static_cast<VaultStatus>(status));
+		}
+	}
+
+	pm_status pm_vault_create(const char* path, const char* master, size_t master_len, pm_vault** out) {
+		return openWith(path, master, master_len, out, [](Vault& v, const std::string& pw) { return v.initNew(pw); });
+	}
+
+	pm_status pm_vault_open(const char* path, const char* master, size_t master_len, pm_vault** out) {
+		return openWith(path, master, master_len, out, [](Vault& v, const std::string& pw) { return v.load(pw); });
+	}
+
+	void pm_vault_close(pm_vault* vault) {
+		delete vault; // ~Vault wipes the key and the arena
+	}
+
+	size_t pm_vault_count(const pm_vault* vault) {
+		return vault ? vault->vault.list().size() : 0;
+	}
+
+	pm_status pm_vault_find(const pm_vault* vault, const char* site, pm_entry_cb cb, void* ctx) {
+		if (!vault || !site || !cb) return PM_ERR_INVALID_ARG;
+		return guarded([&]() { return visit(vault->vault, vault->vault.findSite(site), cb, ctx); });
+	}
+
+	pm_status pm_vault_find_prefix(const pm_vault* vault, const char* prefix, pm_entry_cb cb, void* ctx) {
+		if (!vault || !prefix || !cb) return PM_ERR_INVALID_ARG;
+		return guarded([&]() { return visit(vault->vault, vault->vault.findPrefix(prefix), cb, ctx); });
+	}
+
+	pm_status pm_vault_list(const pm_vault* vault, pm_entry_cb cb, void* ctx) {
+		if (!vault || !cb) return PM_ERR_INVALID_ARG;
+		return guarded([&]() { return visit(vault->vault, vault->vault.sites(), cb, ctx); });
+	}
+
+	pm_status pm_vault_add(pm_vault* vault, const pm_entry* entry) {
+		if (!vault || !entry || !entry->site || entry->site_len == 0) return PM_ERR_INVALID_ARG;
+		if ((!entry->username && entry->username_len) || (!entry->password && entry->password_len)) return PM_ERR_INVALID_ARG;
+
+		return guarded([&]() {
+			vault->vault.addEntry(Entry{
+				std::string_view(entry->site, entry->site_len),
+				std::string_view(entry->username ? entry->username : "", entry->username_len),
+				std::string_view(entry->password ? entry->password : "", entry->password_len) });
+			return PM_OK;
+		});
+	}
+
+	pm_status pm_vault_remove(pm_vault* vault, const char* site, size_t* removed) {
+		if (!vault || !site || !*site) return PM_ERR_INVALID_ARG;
+		return guarded([&]() {
+			const size_t n = vault->vault.removeBySite(site);
+			if (removed) *removed = n;
+			return PM_OK;
+		});
+	}
+
+	pm_status pm_vault_save(pm_vault* vault) {
+		if (!vault) return PM_ERR_INVALID_ARG;
+		return guarded([&]() { return toC(vault->vault.save()); });
+	}
+
+}
@@ -0,0 +1,418 @@
+// Checks of the vault format paths that only the benchmarks exercised: v1
+// upgrade, verified paged lookups, torn-tail recovery, merging concurrent
+// saves and record compression. Every check runs on its own files in the
+// temp directory with a cheap KDF.
+//
+//   pm_tests            run every check
+//   pm_tests NAME...    run the named checks (one ctest test each)
+#include "../src/Server.h"
+#include "../src/Vault.h"
+#include "../src/VaultFile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#if !defined(_WIN32)
+#include <csignal>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace {
+
+	const char* const kMaster = "correct horse";
+
+	// failed checks of the current test, reported by main
+	int failures = 0;
+
+	// this executable, for checks that run part of themselves in a child
+	const char* self = nullptr;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { std::fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+#define CHECK_STATUS(expr, want) \
+	do { const VaultStatus st_ = (expr); if (st_ != (want)) { std::fprintf(stderr, "  %s:%d: %s gave \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #expr, describe(st_), describe(want)); ++failures; } } while (0)
+
+	// Argon2id at its floor: the checks are about the file, not the KDF
+	Crypto::KdfParams cheapKdf() {
+		Crypto::KdfParams kdf;
+		kdf.opslimit = 1;
+		kdf.memlimit = 8 * 1024 * 1024;
+		return kdf;
+	}
+
+	KeyProvider passwordKey() {
+		return [](const Crypto::KdfParams& kdf, std::vector<unsigned char>& outKey) { return Crypto::deriveKey(kMaster, kdf, outKey); };
+	}
+
+	// fresh path in the temp directory (each check uses its own names)
+	std::string tempPath(const std::string& name) {
+		const auto dir = std::filesystem::temp_directory_path() / "pm_tests";
+		std::filesystem::create_directories(dir);
+		const auto path = dir / name;
+		std::filesystem::remove(path);
+		std::filesystem::remove(path.string() + ".lock");
+		return path.string();
+	}
+
+	std::string siteName(size_t i) { return "site" + std::to_string(i) + ".example"; }
+	std::string userName(size_t i) { return "user" + std::to_string(i); }
+	std::string passwordOf(size_t i) { return "pw-" + std::to_string(i * 7919) + "-secret"; }
+
+	// new vault holding entries [0, n)
+	bool makeVault(const std::string& path, size_t n) {
+		{
+			Vault v(path);
+			if (v.initNew(kMaster, cheapKdf()) != VaultStatus::Ok) return false;
+		}
+		Vault v(path);
+		if (v.load(kMaster) != VaultStatus::Ok) return false;
+		for (size_t i = 0; i < n; ++i) v.addEntry(Entry{ siteName(i), userName(i), passwordOf(i) });
+		return v.save() == VaultStatus::Ok;
+	}
+
+	// the entry of site i is there with its username and password
+	bool holds(const Vault& v, size_t i) {
+		const auto found = v.findSite(siteName(i));
+		if (found.size() != 1) return false;
+		const Entry& e = *found.begin();
+		Secret pw;
+		return e.username == userName(i) && v.reveal(e, pw) == VaultStatus::Ok && pw.view() == passwordOf(i);
+	}
+
+	bool holdsAll(const Vault& v, size_t n) {
+		if (v.list().size() != n) return false;
+		for (size_t i = 0; i < n; ++i) if (!holds(v, i)) return false;
+		return true;
+	}
+
+	// offset of the first frame of kind after the check record
+	size_t frameOffset(const std::string& path, std::uint8_t want) {
+		VaultFile::FrameReader reader;
+		const unsigned char* header = nullptr;
+		size_t headerLen = 0;
+		if (!reader.open(path, VaultFile::MappedFile::Access::Random) || !reader.readHeader(header, headerLen)) return 0;
+		std::uint8_t kind = 0;
+		const unsigned char* data = nullptr;
+		size_t len = 0;
+		while (reader.next(kind, data, len) == VaultFile::FrameReader::Status::Ok) {
+			if (kind == want) return static_cast<size_t>(data - reader.mapping());
+		}
+		return 0;
+	}
+
+	void flipByte(const std::string& path, size_t offset) {
+		std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+		f.seekg(static_cast<std::streamoff>(offset));
+		char c = 0;
+		f.get(c);
+		f.seekp(static_cast<std::streamoff>(offset));
+		f.put(static_cast<char>(c ^ 0x5a));
+	}
+
+	// a legacy JSON vault: one ciphertext over the whole entry array, keyed
+	// straight from the password
+	void upgradeV1() {
+		const std::string path = tempPath("v1.vault");
+		const size_t n = 20;
+
+		Crypto::KdfParams kdf = cheapKdf();
+		kdf.salt = Crypto::randomBytes(16);
+		std::vector<unsigned char> key;
+		CHECK(Crypto::deriveKey(kMaster, kdf, key));
+		const std::vector<unsigned char> nonce = Crypto::randomBytes(24);
+
+		nlohmann::json arr = nlohmann::json::array();
+		std::vector<std::string> fields;
+		fields.reserve(3 * n);
+		for (size_t i = 0; i < n; ++i) {
+			fields.push_back(siteName(i));
+			fields.push_back(userName(i));
+			fields.push_back(passwordOf(i));
+			arr.push_back(Entry{ fields[3 * i], fields[3 * i + 1], fields[3 * i + 2] });
+		}
+		std::string ct;
+		CHECK(Crypto::encrypt(key, nonce, arr.dump(), ct));
+
+		nlohmann::json root;
+		root["version"] = 1;
+		root["kdf"] = { { "opslimit", kdf.opslimit }, { "memlimit", kdf.memlimit }, { "salt_b64", Crypto::b64encode(kdf.salt) } };
+		root["nonce_b64"] = Crypto::b64encode(nonce);
+		root["ciphertext_b64"] = ct;
+		std::ofstream(path) << root.dump(2);
+
+		{
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			CHECK(v.formatVersion() == 1);
+			CHECK(holdsAll(v, n));
+			v.addEntry(Entry{ siteName(n), userName(n), passwordOf(n) });
+			CHECK_STATUS(v.save(), VaultStatus::Ok);
+		}
+
+		Vault v(path);
+		CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+		CHECK(v.formatVersion() == 2);
+		CHECK(holdsAll(v, n + 1));
+		Vault wrong(path);
+		CHECK_STATUS(wrong.load("not it"), VaultStatus::AuthFailed);
+	}
+
+	// a rewrite pages the records; a flipped byte in the record a lookup
+	// reads must fail its page check, not hand back altered data
+	void tamperedPage() {
+		const std::string path = tempPath("paged.vault");
+		CHECK(makeVault(path, 0));
+		{
+			// compression on forces the rewrite that pages the records
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			for (size_t i = 0; i < 8; ++i) v.addEntry(Entry{ siteName(i), userName(i), passwordOf(i) });
+			CHECK(v.setCompression(true));
+			CHECK_STATUS(v.save(), VaultStatus::Ok);
+		}
+		{
+			Vault v(path);
+			CHECK_STATUS(v.loadMatching(passwordKey(), siteName(3), false), VaultStatus::Ok);
+			CHECK(v.partial());
+			CHECK(holds(v, 3));
+		}
+
+		// a few records: the whole region is one page, read by every lookup
+		const size_t at = frameOffset(path, VaultFile::FramePutSplit);
+		CHECK(at != 0);
+		flipByte(path, at + 40);
+
+		Vault v(path);
+		CHECK_STATUS(v.loadMatching(passwordKey(), siteName(3), false), VaultStatus::AuthFailed);
+	}
+
+	// an append cut short by a crash: the torn frame is dropped and the next
+	// save rewrites the file cleanly
+	void tornTail() {
+		const std::string path = tempPath("torn.vault");
+		const size_t n = 10;
+		CHECK(makeVault(path, n));
+		{
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			v.addEntry(Entry{ siteName(n), userName(n), passwordOf(n) });
+			CHECK_STATUS(v.save(), VaultStatus::Ok);
+		}
+		std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+		{
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			CHECK(holdsAll(v, n));
+			v.addEntry(Entry{ siteName(n + 1), userName(n + 1), passwordOf(n + 1) });
+			CHECK_STATUS(v.save(), VaultStatus::Ok);
+		}
+
+		Vault v(path);
+		CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+		CHECK(v.list().size() == n + 1);
+		CHECK(holds(v, n + 1));
+		CHECK(v.findSite(siteName(n)).size() == 0);
+	}
+
+	// vaults loaded before each other's saves: one after the other, then
+	// from several threads at once (group commit)
+	void concurrentSaves() {
+		const std::string path = tempPath("merge.vault");
+		const size_t n = 10;
+		CHECK(makeVault(path, n));
+		{
+			Vault a(path);
+			Vault b(path);
+			CHECK_STATUS(a.load(kMaster), VaultStatus::Ok);
+			CHECK_STATUS(b.load(kMaster), VaultStatus::Ok);
+			a.addEntry(Entry{ siteName(n), userName(n), passwordOf(n) });
+			b.addEntry(Entry{ siteName(n + 1), userName(n + 1), passwordOf(n + 1) });
+			CHECK(b.removeBySite(siteName(0)) == 1);
+			CHECK_STATUS(a.save(), VaultStatus::Ok);
+			CHECK_STATUS(b.save(), VaultStatus::Ok);
+			CHECK(holds(b, n));
+		}
+		{
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			CHECK(v.list().size() == n + 1);
+			CHECK(v.findSite(siteName(0)).size() == 0);
+			for (size_t i = 1; i < n + 2; ++i) CHECK(holds(v, i));
+		}
+
+		const size_t writers = 4;
+		const size_t each = 25;
+		const size_t base = n + 2;
+		std::vector<std::unique_ptr<Vault>> vaults;
+		for (size_t w = 0; w < writers; ++w) {
+			vaults.push_back(std::make_unique<Vault>(path));
+			CHECK_STATUS(vaults.back()->load(kMaster), VaultStatus::Ok);
+		}
+		std::vector<VaultStatus> results(writers * each, VaultStatus::Ok);
+		std::vector<std::thread> threads;
+		for (size_t w = 0; w < writers; ++w) {
+			threads.emplace_back([&, w]() {
+				for (size_t i = 0; i < each; ++i) {
+					const size_t k = base + w * each + i;
+					vaults[w]->addEntry(Entry{ siteName(k), userName(k), passwordOf(k) });
+					results[w * each + i] = vaults[w]->save();
+				}
+			});
+		}
+		for (auto& t : threads) t.join();
+		for (VaultStatus st : results) CHECK_STATUS(st, VaultStatus::Ok);
+
+		Vault v(path);
+		CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+		CHECK(v.list().size() == n + 1 + writers * each);
+		for (size_t k = base; k < base + writers * each; ++k) CHECK(holds(v, k));
+	}
+
+	// compression on, then off again, each read back by a fresh load
+	void compressionRoundTrip() {
+		const std::string path = tempPath("compressed.vault");
+		const size_t n = Compressor::kMinSamples + 44;
+		CHECK(makeVault(path, n));
+
+		for (bool on : { true, false }) {
+			{
+				Vault v(path);
+				CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+				CHECK(v.setCompression(on));
+				CHECK_STATUS(v.save(), VaultStatus::Ok);
+			}
+			{
+				// an append after the rewrite goes through the dictionary too
+				Vault v(path);
+				CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+				CHECK(v.compressed() == on);
+				CHECK(v.hasDictionary() == on);
+				CHECK(holdsAll(v, n));
+				v.addEntry(Entry{ siteName(n), userName(n), passwordOf(n) });
+				CHECK_STATUS(v.save(), VaultStatus::Ok);
+			}
+			Vault v(path);
+			CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+			CHECK(holdsAll(v, n + 1));
+			CHECK(v.removeBySite(siteName(n)) == 1);
+			CHECK_STATUS(v.save(), VaultStatus::Ok);
+		}
+	}
+
+#if !defined(_WIN32)
+	// `pm_tests --serve <vault> <socket>`: the server half of serveSignal,
+	// loaded the way `pm serve` does it (shared pool started first)
+	int serveChild(const std::string& path, const std::string& socket) {
+		Vault v(path);
+		if (v.load(kMaster) != VaultStatus::Ok) return 2;
+		Server::Options options;
+		options.socketPath = socket;
+		options.batchMs = 20000; // the ADD is still waiting for its save at the signal
+		return Server::run(v, options);
+	}
+
+	// SIGINT while a write waits for its batched save: the server saves it,
+	// removes its socket and exits cleanly, with several pool threads running
+	void serveSignal() {
+		const std::string path = tempPath("serve.vault");
+		const std::string socket = tempPath("serve.sock");
+		const size_t n = 3;
+		CHECK(makeVault(path, n));
+
+		std::vector<std::string> args{ self, "--serve", path, socket };
+		std::vector<char*> argv;
+		for (auto& a : args) argv.push_back(a.data());
+		argv.push_back(nullptr);
+		std::vector<std::string> env{ "PM_THREADS=4" };
+		for (char** e = environ; *e; ++e) if (std::strncmp(*e, "PM_THREADS=", 11) != 0) env.emplace_back(*e);
+		std::vector<char*> envp;
+		for (auto& e : env) envp.push_back(e.data());
+		envp.push_back(nullptr);
+		pid_t pid = 0;
+		if (posix_spawn(&pid, self, nullptr, nullptr, argv.data(), envp.data()) != 0) { CHECK(!"spawn failed"); return; }
+
+		Server::Client probe;
+		for (int i = 0; i < 500 && !probe.connect(socket); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		// answered only after the save, so ask from a thread
+		std::string added;
+		std::thread writer([&]() {
+			Server::Client c;
+			if (c.connect(socket)) c.call("ADD " + Server::field(siteName(n)) + " " + Server::field(userName(n)) + " " + Server::field(passwordOf(n)), added);
+		});
+		std::string reply;
+		bool applied = false;
+		for (int i = 0; i < 500 && !applied; ++i) {
+			applied = probe.call("GET " + Server::field(siteName(n)), reply) && reply != "OK";
+			if (!applied) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		CHECK(applied);
+
+		::kill(pid, SIGINT);
+		int status = 0;
+		::waitpid(pid, &status, 0);
+		writer.join();
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		CHECK(added == "OK");
+		CHECK(!std::filesystem::exists(socket));
+
+		Vault v(path);
+		CHECK_STATUS(v.load(kMaster), VaultStatus::Ok);
+		CHECK(holdsAll(v, n + 1));
+	}
+#endif
+
+	struct Test {
+		const char* name;
+		void (*run)();
+	};
+
+	const Test kTests[] = {
+		{ "upgrade_v1", upgradeV1 },
+		{ "tampered_page", tamperedPage },
+		{ "torn_tail", tornTail },
+		{ "concurrent_saves", concurrentSaves },
+		{ "compression_round_trip", compressionRoundTrip },
+#if !defined(_WIN32)
+		{ "serve_signal", serveSignal },
+#endif
+	};
+
+}
+
+int main(int argc, char** argv) {
+	self = argv[0];
+#if !defined(_WIN32)
+	if (argc == 4 && std::strcmp(argv[1], "--serve") == 0) return serveChild(argv[2], argv[3]);
+#endif
+
+	int failed = 0;
+	int ran = 0;
+	for (const Test& t : kTests) {
+		bool wanted = argc < 2;
+		for (int i = 1; i < argc; ++i) wanted = wanted || std::strcmp(argv[i], t.name) == 0;
+		if (!wanted) continue;
+
+		failures = 0;
+		t.run();
+		std::printf("%-24s %s\n", t.name, failures ? "FAILED" : "ok");
+		if (failures) ++failed;
+		++ran;
+	}
+	if (ran == 0) {
+		std::fprintf(stderr, "no such test\n");
+		return 1;
+	}
+	return failed ? 1 : 0;
+}